@@ -0,0 +1,290 @@
+#ifndef AUGAVL_H
+#define AUGAVL_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <limits>
+#include "avlbst.h"
+
+/**
+* Monoids for AugmentedAVLTree. A monoid names the aggregate type and gives
+* its identity, an associative combine, and how a single key/value pair is
+* lifted into an aggregate. combine need not be commutative: aggregates are
+* always combined in key order.
+*/
+template <typename T>
+struct SumMonoid
+{
+    typedef T value_type;
+    static T identity() { return T(); }
+    static T combine(const T& a, const T& b) { return a + b; }
+    template<typename Key>
+    static T lift(const Key&, const T& value) { return value; }
+};
+
+template <typename T>
+struct MinMonoid
+{
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::max(); }
+    static T combine(const T& a, const T& b) { return (b < a) ? b : a; }
+    template<typename Key>
+    static T lift(const Key&, const T& value) { return value; }
+};
+
+template <typename T>
+struct MaxMonoid
+{
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    static T combine(const T& a, const T& b) { return (a < b) ? b : a; }
+    template<typename Key>
+    static T lift(const Key&, const T& value) { return value; }
+};
+
+/**
+* An AVLNode that also stores the aggregate of its whole subtree.
+*/
+template <typename Key, typename Value, typename Monoid>
+class AugAVLNode : public AVLNode<Key, Value>
+{
+public:
+    typedef typename Monoid::value_type aggregate_type;
+
+    // Constructor/destructor.
+    AugAVLNode(const Key& key, const Value& value, AugAVLNode<Key, Value, Monoid>* parent);
+    virtual ~AugAVLNode();
+
+    const aggregate_type& getAggregate() const;
+    void setAggregate(const aggregate_type& aggregate);
+
+    // Getters for parent, left, and right, redefined to return AugAVLNodes.
+    virtual AugAVLNode<Key, Value, Monoid>* getParent() const override;
+    virtual AugAVLNode<Key, Value, Monoid>* getLeft() const override;
+    virtual AugAVLNode<Key, Value, Monoid>* getRight() const override;
+
+protected:
+    aggregate_type aggregate_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the AugAVLNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value, class Monoid>
+AugAVLNode<Key, Value, Monoid>::AugAVLNode(const Key& key, const Value& value, AugAVLNode<Key, Value, Monoid> *parent) :
+    AVLNode<Key, Value>(key, value, parent), aggregate_(Monoid::lift(key, value))
+{
+
+}
+
+template<class Key, class Value, class Monoid>
+AugAVLNode<Key, Value, Monoid>::~AugAVLNode()
+{
+
+}
+
+template<class Key, class Value, class Monoid>
+const typename AugAVLNode<Key, Value, Monoid>::aggregate_type& AugAVLNode<Key, Value, Monoid>::getAggregate() const
+{
+    return aggregate_;
+}
+
+template<class Key, class Value, class Monoid>
+void AugAVLNode<Key, Value, Monoid>::setAggregate(const aggregate_type& aggregate)
+{
+    aggregate_ = aggregate;
+}
+
+template<class Key, class Value, class Monoid>
+AugAVLNode<Key, Value, Monoid> *AugAVLNode<Key, Value, Monoid>::getParent() const
+{
+    return static_cast<AugAVLNode<Key, Value, Monoid>*>(this->parent_);
+}
+
+template<class Key, class Value, class Monoid>
+AugAVLNode<Key, Value, Monoid> *AugAVLNode<Key, Value, Monoid>::getLeft() const
+{
+    return static_cast<AugAVLNode<Key, Value, Monoid>*>(this->left_);
+}
+
+template<class Key, class Value, class Monoid>
+AugAVLNode<Key, Value, Monoid> *AugAVLNode<Key, Value, Monoid>::getRight() const
+{
+    return static_cast<AugAVLNode<Key, Value, Monoid>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the AugAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree where every node caches the Monoid aggregate of its subtree, so
+* reduce(lo, hi) answers a range aggregate in O(log n) instead of iterating
+* over the range. The aggregates are kept current through AVLTree's hooks:
+* rotations, insert/remove (including their fixups), nodeSwap, bulk loads
+* and relaxed mode all go through them.
+*
+* Values must be changed with insert(); writing through an iterator would
+* bypass the aggregates, so only the const operator[] is exposed.
+*/
+template <class Key, class Value, class Monoid>
+class AugmentedAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef typename Monoid::value_type aggregate_type;
+
+    aggregate_type reduce(const Key& lo, const Key& hi) const;
+    aggregate_type aggregate() const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void pull(AVLNode<Key, Value>* node);
+    virtual void pullPath(AVLNode<Key, Value>* node, AVLNode<Key, Value>* stop);
+
+    // Helper functions
+    AugAVLNode<Key, Value, Monoid>* getRoot() const;
+    static aggregate_type aggregateOf(AugAVLNode<Key, Value, Monoid>* node);
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the AugmentedAVLTree class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value, class Monoid>
+AugAVLNode<Key, Value, Monoid> *AugmentedAVLTree<Key, Value, Monoid>::getRoot() const
+{
+    return static_cast<AugAVLNode<Key, Value, Monoid>*>(this->root_);
+}
+
+//Empty subtrees aggregate to the identity
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::aggregate_type
+AugmentedAVLTree<Key, Value, Monoid>::aggregateOf(AugAVLNode<Key, Value, Monoid>* node)
+{
+    return (node == nullptr) ? Monoid::identity() : node->getAggregate();
+}
+
+template<class Key, class Value, class Monoid>
+AVLNode<Key, Value>* AugmentedAVLTree<Key, Value, Monoid>::createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new AugAVLNode<Key, Value, Monoid>(key, value, static_cast<AugAVLNode<Key, Value, Monoid>*>(parent));
+}
+
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::pull(AVLNode<Key, Value>* node)
+{
+    AugAVLNode<Key, Value, Monoid>* augNode = static_cast<AugAVLNode<Key, Value, Monoid>*>(node);
+    augNode->setAggregate(Monoid::combine(Monoid::combine(aggregateOf(augNode->getLeft()),
+                                                          Monoid::lift(augNode->getKey(), augNode->getValue())),
+                                          aggregateOf(augNode->getRight())));
+}
+
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::pullPath(AVLNode<Key, Value>* node, AVLNode<Key, Value>* stop)
+{
+    while (node != stop) {
+        pull(node);
+        node = node->getParent();
+    }
+}
+
+/*
+ * Aggregates describe tree positions, so they trade places along with the
+ * nodes like the balances do. The swapped nodes now sit in each other's
+ * subtrees, which remove() corrects with a pullPath once the node is unlinked.
+ */
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2)
+{
+    AVLTree<Key, Value>::nodeSwap(n1, n2);
+    AugAVLNode<Key, Value, Monoid>* a1 = static_cast<AugAVLNode<Key, Value, Monoid>*>(n1);
+    AugAVLNode<Key, Value, Monoid>* a2 = static_cast<AugAVLNode<Key, Value, Monoid>*>(n2);
+    aggregate_type temp = a1->getAggregate();
+    a1->setAggregate(a2->getAggregate());
+    a2->setAggregate(temp);
+}
+
+/**
+* Aggregate of every item in the tree, in O(1).
+*/
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::aggregate_type
+AugmentedAVLTree<Key, Value, Monoid>::aggregate() const
+{
+    return aggregateOf(getRoot());
+}
+
+/**
+* Aggregate of every item with lo <= key < hi, in O(log n). Finds the top
+* node inside the range, then walks down towards each bound, combining
+* whole subtrees that lie entirely inside.
+*/
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::aggregate_type
+AugmentedAVLTree<Key, Value, Monoid>::reduce(const Key& lo, const Key& hi) const
+{
+    AugAVLNode<Key, Value, Monoid>* split = getRoot();
+    while (split != nullptr) {
+        if (split->getKey() < lo) {
+            split = split->getRight();
+        } else if (!(split->getKey() < hi)) {
+            split = split->getLeft();
+        } else {
+            break;
+        }
+    }
+    if (split == nullptr) {
+        return Monoid::identity();
+    }
+
+    //Left of split: nodes >= lo bring their right subtrees, and everything
+    //found later is smaller, so it goes in front
+    aggregate_type leftPart = Monoid::identity();
+    for (AugAVLNode<Key, Value, Monoid>* node = split->getLeft(); node != nullptr; ) {
+        if (node->getKey() < lo) {
+            node = node->getRight();
+        } else {
+            leftPart = Monoid::combine(Monoid::combine(Monoid::lift(node->getKey(), node->getValue()),
+                                                       aggregateOf(node->getRight())), leftPart);
+            node = node->getLeft();
+        }
+    }
+
+    //Right of split: nodes < hi bring their left subtrees, appended in order
+    aggregate_type rightPart = Monoid::identity();
+    for (AugAVLNode<Key, Value, Monoid>* node = split->getRight(); node != nullptr; ) {
+        if (node->getKey() < hi) {
+            rightPart = Monoid::combine(rightPart, Monoid::combine(aggregateOf(node->getLeft()),
+                                                                   Monoid::lift(node->getKey(), node->getValue())));
+            node = node->getRight();
+        } else {
+            node = node->getLeft();
+        }
+    }
+
+    return Monoid::combine(leftPart, Monoid::combine(Monoid::lift(split->getKey(), split->getValue()), rightPart));
+}
+
+template<class Key, class Value, class Monoid>
+Value const & AugmentedAVLTree<Key, Value, Monoid>::operator[](const Key& key) const
+{
+    return BinarySearchTree<Key, Value>::operator[](key);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the AugmentedAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -6,6 +6,8 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <vector>
+#include <thread>
 #include "bst.h"
 
 struct KeyError { };
@@ -28,6 +30,14 @@ public:
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
+    // Getter/setter for the relaxed-mode flag (see AVLTree::setRelaxed).
+    bool isDirty() const;
+    void setDirty(bool dirty);
+
+    // Getter/setter for the tombstone flag (see LazyAVLTree).
+    bool isDead() const;
+    void setDead(bool dead);
+
     // Getters for parent, left, and right. These need to be redefined since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
@@ -37,6 +47,8 @@ public:
 
 protected:
     int8_t balance_;    // effectively a signed char
+    bool dirty_;        // balance_ is stale; fits in the padding after balance_
+    bool dead_;         // lazily deleted; also fits in the padding
 };
 
 /*
@@ -50,7 +62,7 @@ protected:
 */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), balance_(0)
+    Node<Key, Value>(key, value, parent), balance_(0), dirty_(false), dead_(false)
 {
 
 }
@@ -91,6 +103,44 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
     balance_ += diff;
 }
 
+/**
+* Returns true if this node's subtree was changed in relaxed mode and its
+* balance has not been recomputed yet.
+*/
+template<class Key, class Value>
+bool AVLNode<Key, Value>::isDirty() const
+{
+    return dirty_;
+}
+
+/**
+* A setter for the relaxed-mode flag.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::setDirty(bool dirty)
+{
+    dirty_ = dirty;
+}
+
+/**
+* Returns true if this node's item was removed lazily and only waits for a
+* compaction to be unlinked.
+*/
+template<class Key, class Value>
+bool AVLNode<Key, Value>::isDead() const
+{
+    return dead_;
+}
+
+/**
+* A setter for the tombstone flag.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::setDead(bool dead)
+{
+    dead_ = dead;
+}
+
 /**
 * An overridden function for getting the parent since a static_cast is necessary to make sure
 * that our node is a AVLNode.
@@ -127,12 +177,43 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
+/**
+* One entry of a batch for AVLTree::apply_batch: an insert-or-assign of
+* value, or a remove of key.
+*/
+template <class Key, class Value>
+struct BatchUpdate
+{
+    BatchUpdate(const Key& k, const Value& v) : key(k), value(v), remove(false) { }
+    explicit BatchUpdate(const Key& k) : key(k), value(), remove(true) { }
+
+    Key key;
+    Value value;
+    bool remove;
+};
+
 template <class Key, class Value>
 class AVLTree : public BinarySearchTree<Key, Value>
 {
 public:
+    AVLTree();
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
     virtual void remove(const Key& key);  // TODO
+    template<typename Iter>
+    void insertSorted(Iter first, Iter last);
+    virtual void apply_batch(const std::vector<BatchUpdate<Key, Value> >& updates, unsigned threads = 1);
+
+    // Relaxed balance mode for write bursts
+    void setRelaxed(bool relaxed, int maxDepth = 64);
+    bool isRelaxed() const;
+    void settle();
+    virtual void rebalance();
+
+    // Priority queue access to both ends in O(1)
+    const std::pair<const Key, Value>& front() const;
+    const std::pair<const Key, Value>& back() const;
+    std::pair<Key, Value> pop_min();
+    std::pair<Key, Value> pop_max();
 protected:
     virtual void nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
@@ -141,16 +222,121 @@ protected:
     void rotateLeft(AVLNode<Key, Value>* node); //Int to represent zig-zig (0) or zig-zag (1)
     void rotateRight(AVLNode<Key, Value>* node); //Int to represent zig-zig (0) or zig-zag (1)
     AVLNode<Key, Value>* getRoot() const;
+    virtual Node<Key, Value>* getSmallestNode() const;
     void removeFix(AVLNode<Key, Value>* node, int diff);
+    void unlinkNode(AVLNode<Key, Value>* removeNode);
+    virtual void eraseNode(Node<Key, Value>* removeNode);
+    void collectNodes(std::vector<AVLNode<Key, Value>*>& nodes) const;
+    AVLNode<Key, Value>* buildBalanced(std::vector<AVLNode<Key, Value>*>& nodes, size_t lo, size_t hi,
+                                       AVLNode<Key, Value>* parent, int& height);
+    void markDirty(AVLNode<Key, Value>* node);
+    static int heightOf(AVLNode<Key, Value>* node);
+    int joinAt(AVLNode<Key, Value>* node, int leftHeight, int rightHeight);
+    int retraceGrowth(AVLNode<Key, Value>* node, AVLNode<Key, Value>* stop);
+    void batchMerge(AVLNode<Key, Value>* node, int height, const std::vector<BatchUpdate<Key, Value> >& updates,
+                    size_t lo, size_t hi, unsigned threads, std::vector<AVLNode<Key, Value>*>& doomed,
+                    int& leftHeight, int& rightHeight);
+    void batchChild(AVLNode<Key, Value>* node, bool left, int height, const std::vector<BatchUpdate<Key, Value> >& updates,
+                    size_t lo, size_t hi, unsigned threads, std::vector<AVLNode<Key, Value>*>& doomed,
+                    int& leftHeight, int& rightHeight);
+    AVLNode<Key, Value>* batchBuild(const std::vector<BatchUpdate<Key, Value> >& updates, size_t lo, size_t hi,
+                                    AVLNode<Key, Value>* parent, int& height);
+    int balanceAt(AVLNode<Key, Value>* node, int leftHeight, int rightHeight);
+    virtual void linkSorted(std::vector<AVLNode<Key, Value>*>& nodes);
 
+    // Hooks for trees that keep extra per-node data (see augavl.h); the
+    // defaults allocate a plain AVLNode and maintain nothing. apply_batch
+    // with threads > 1 calls them from several threads at once on disjoint
+    // subtrees, so an override must not touch shared state without its own
+    // synchronization, or must hide apply_batch (see shardedtree.h).
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void pull(AVLNode<Key, Value>* node);
+    virtual void pullPath(AVLNode<Key, Value>* node, AVLNode<Key, Value>* stop);
+
+    bool relaxed_;
+    int relaxedDepth_;  // relaxed inserts this deep trigger a settle()
+    AVLNode<Key, Value>* min_;  // leftmost and rightmost nodes, only valid
+    AVLNode<Key, Value>* max_;  // while root_ is not null
 };
 
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree() :
+    relaxed_(false), relaxedDepth_(64), min_(nullptr), max_(nullptr)
+{
+
+}
+
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLTree<Key, Value>::getRoot() const
 {
     return static_cast<AVLNode<Key, Value>*>(this->root_);
 }
 
+/*
+ * The leftmost node is cached, so begin() no longer walks the left spine.
+ * Checking root_ covers BinarySearchTree::clear(), which cannot reset it.
+ */
+template<class Key, class Value>
+Node<Key, Value>* AVLTree<Key, Value>::getSmallestNode() const
+{
+    return (this->root_ == nullptr) ? nullptr : min_;
+}
+
+/**
+* Smallest item, in O(1). Throws std::out_of_range if the tree is empty.
+*/
+template<class Key, class Value>
+const std::pair<const Key, Value>& AVLTree<Key, Value>::front() const
+{
+    if (this->root_ == nullptr) {
+        throw std::out_of_range("Empty tree");
+    }
+    return min_->getItem();
+}
+
+/**
+* Largest item (the newest of equal keys in multimap mode), in O(1).
+* Throws std::out_of_range if the tree is empty.
+*/
+template<class Key, class Value>
+const std::pair<const Key, Value>& AVLTree<Key, Value>::back() const
+{
+    if (this->root_ == nullptr) {
+        throw std::out_of_range("Empty tree");
+    }
+    return max_->getItem();
+}
+
+/**
+* Removes and returns the smallest item without searching for it. Throws
+* std::out_of_range if the tree is empty.
+*/
+template<class Key, class Value>
+std::pair<Key, Value> AVLTree<Key, Value>::pop_min()
+{
+    if (this->root_ == nullptr) {
+        throw std::out_of_range("Empty tree");
+    }
+    std::pair<Key, Value> item(min_->getKey(), min_->getValue());
+    eraseNode(min_);
+    return item;
+}
+
+/**
+* Removes and returns the largest item without searching for it. Throws
+* std::out_of_range if the tree is empty.
+*/
+template<class Key, class Value>
+std::pair<Key, Value> AVLTree<Key, Value>::pop_max()
+{
+    if (this->root_ == nullptr) {
+        throw std::out_of_range("Empty tree");
+    }
+    std::pair<Key, Value> item(max_->getKey(), max_->getValue());
+    eraseNode(max_);
+    return item;
+}
+
 //Rotate left from grandparent
 template<class Key, class Value>
 void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* grandparent)
@@ -178,7 +364,9 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* grandparent)
     parent->setLeft(grandparent);
     grandparent->setParent(parent);
 
-    
+    //grandparent is now below parent, so it is recomputed first
+    pull(grandparent);
+    pull(parent);
 }
 
 
@@ -207,6 +395,9 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* grandparent)
     //Update parent and grandparent relation
     parent->setRight(grandparent);
     grandparent->setParent(parent);
+
+    pull(grandparent);
+    pull(parent);
 }
 
 
@@ -219,38 +410,60 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
 {
     // If the tree is empty, set the new node as the root
     if (this->root_ == nullptr) {
-        this->root_ = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
+        this->root_ = createNode(new_item.first, new_item.second, nullptr);
         this->root_->setLeft(nullptr);
         this->root_->setRight(nullptr);
+        min_ = max_ = getRoot();
+        pull(getRoot());
         return;
     }
 
     // Otherwise, insert the new node into the tree
     AVLNode<Key, Value>* parent = nullptr;
     AVLNode<Key, Value>* currentNode = this->getRoot();
-    
+    int depth = 0;
+
     while (currentNode != nullptr) {
+        depth++;
         if (new_item.first < currentNode->getKey()) {
             parent = currentNode;
             currentNode = currentNode->getLeft();
-        } else if (new_item.first > currentNode->getKey()) {
+        } else if (new_item.first > currentNode->getKey() || this->multimap_) {
             parent = currentNode;
             currentNode = currentNode->getRight();
         } else {
             // If the key already exists, update the value and return
             currentNode->setValue(new_item.second);
+            pullPath(currentNode, nullptr);
             return;
         }
     }
 
-    AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
+    AVLNode<Key, Value>* newNode = createNode(new_item.first, new_item.second, parent);
     newNode->setLeft(nullptr);
     newNode->setRight(nullptr);
     // Attach the new node to its parent
     if (newNode->getKey() < parent->getKey()) {
         parent->setLeft(newNode);
+        if (parent == min_) {
+            min_ = newNode;
+        }
     } else {
         parent->setRight(newNode);
+        if (parent == max_) {
+            max_ = newNode;
+        }
+    }
+    pullPath(newNode, nullptr);
+
+    // In relaxed mode the fixup is deferred to settle(), unless the descent
+    // shows the unsettled part has grown too deep
+    if (relaxed_) {
+        markDirty(parent);
+        if (depth >= relaxedDepth_) {
+            settle();
+        }
+        return;
     }
 
     // Set balance to 0
@@ -348,8 +561,31 @@ void AVLTree<Key, Value>:: remove(const Key& key)
 {
     // TODO
     AVLNode<Key, Value>* removeNode = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::internalFind(key));
-    if (removeNode == nullptr) {
-        return;
+    if (removeNode != nullptr) {
+        unlinkNode(removeNode);
+    }
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::eraseNode(Node<Key, Value>* removeNode)
+{
+    unlinkNode(static_cast<AVLNode<Key, Value>*>(removeNode));
+}
+
+/*
+ * Removes a node the caller already holds and rebalances, without searching
+ * for its key. Other nodes keep their identity (nodeSwap moves nodes, not
+ * contents), so pointers to them stay valid.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::unlinkNode(AVLNode<Key, Value>* removeNode)
+{
+    //An end node has at most one child, so it is unlinked where it is
+    if (removeNode == min_) {
+        min_ = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::successor(removeNode));
+    }
+    if (removeNode == max_) {
+        max_ = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::predecessor(removeNode));
     }
 
     if (removeNode->getLeft() != nullptr && removeNode->getRight() != nullptr) {
@@ -411,7 +647,12 @@ void AVLTree<Key, Value>:: remove(const Key& key)
         delete removeNode;
     }
 
-    removeFix(parent, diff);
+    pullPath(parent, nullptr);
+    if (relaxed_) {
+        markDirty(parent);
+    } else {
+        removeFix(parent, diff);
+    }
 
 }
 
@@ -506,6 +747,326 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* node, int diff)
     } 
 }
 
+/*
+ * Inserts a run of key/value pairs sorted by key (a later duplicate wins,
+ * like repeated insert calls, or is kept after it in multimap mode). An empty tree is built directly from the run
+ * in O(n) with no rotations; otherwise each pair is inserted normally.
+ */
+template<class Key, class Value>
+template<typename Iter>
+void AVLTree<Key, Value>::insertSorted(Iter first, Iter last)
+{
+    if (this->root_ != nullptr) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+        return;
+    }
+
+    std::vector<AVLNode<Key, Value>*> nodes;
+    for (; first != last; ++first) {
+        if (!this->multimap_ && !nodes.empty() && !(nodes.back()->getKey() < first->first)) { //Duplicate of the previous key
+            nodes.back()->setValue(first->second);
+            continue;
+        }
+        nodes.push_back(createNode(first->first, first->second, nullptr));
+    }
+    linkSorted(nodes);
+}
+
+/*
+ * Helper for insertSorted: links freshly created nodes, in key order, as
+ * the whole of an empty tree. Virtual so that a subclass sees the bulk
+ * load, which never goes through insert().
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::linkSorted(std::vector<AVLNode<Key, Value>*>& nodes)
+{
+    int height = 0;
+    this->root_ = buildBalanced(nodes, 0, nodes.size(), nullptr, height);
+    if (!nodes.empty()) {
+        min_ = nodes.front();
+        max_ = nodes.back();
+    }
+}
+
+/**
+* Applies a batch of updates sorted by key (a key may repeat; its last
+* update wins) in one merge of the batch with the tree. The batch is split at
+* each node's key on the way down, so every node is visited once for the
+* whole batch instead of once per update. New keys that land under the same
+* empty child are built there as one balanced subtree, and each merged
+* subtree is rebalanced once on the way back up, with heights carried down
+* from the root instead of being measured. Removed keys are unlinked after
+* the merge, without searching for them.
+*
+* With threads > 1, two subtrees whose batch parts are both large are merged
+* in parallel. They are disjoint, and each is hung back under its parent
+* only once both are done; createNode and pull run on both threads, so
+* subclasses that override them must be safe to call concurrently. Multimap trees apply the batch one update at a
+* time. Throws std::invalid_argument if the batch is not sorted.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::apply_batch(const std::vector<BatchUpdate<Key, Value> >& updates, unsigned threads)
+{
+    for (size_t i = 1; i < updates.size(); ++i) {
+        if (updates[i].key < updates[i - 1].key) {
+            throw std::invalid_argument("apply_batch: updates are not sorted by key");
+        }
+    }
+    if (this->multimap_) {
+        for (size_t i = 0; i < updates.size(); ++i) {
+            if (updates[i].remove) {
+                remove(updates[i].key);
+            } else {
+                insert(std::make_pair(updates[i].key, updates[i].value));
+            }
+        }
+        return;
+    }
+    if (updates.empty()) {
+        return;
+    }
+
+    settle(); //The merge reads heights off the balance factors
+    std::vector<AVLNode<Key, Value>*> doomed;
+    if (this->root_ == nullptr) {
+        int height = 0;
+        this->root_ = batchBuild(updates, 0, updates.size(), nullptr, height);
+    } else {
+        int leftHeight = 0;
+        int rightHeight = 0;
+        batchMerge(getRoot(), heightOf(getRoot()), updates, 0, updates.size(), std::max(1u, threads),
+                   doomed, leftHeight, rightHeight);
+        balanceAt(getRoot(), leftHeight, rightHeight);
+    }
+    if (this->root_ == nullptr) {
+        return;
+    }
+
+    min_ = getRoot();
+    while (min_->getLeft() != nullptr) {
+        min_ = min_->getLeft();
+    }
+    max_ = getRoot();
+    while (max_->getRight() != nullptr) {
+        max_ = max_->getRight();
+    }
+    for (size_t i = 0; i < doomed.size(); ++i) {
+        unlinkNode(doomed[i]);
+    }
+}
+
+/*
+ * Helper for apply_batch: merges updates[lo, hi) into both subtrees of node,
+ * whose own height is height, and applies the update for node's key (nodes
+ * to remove go on doomed). Each child is rebalanced here, but node itself is
+ * left for the caller with its new subtree heights in leftHeight/rightHeight,
+ * so a merge never writes above its own subtree.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::batchMerge(AVLNode<Key, Value>* node, int height,
+                                     const std::vector<BatchUpdate<Key, Value> >& updates, size_t lo, size_t hi,
+                                     unsigned threads, std::vector<AVLNode<Key, Value>*>& doomed,
+                                     int& leftHeight, int& rightHeight)
+{
+    typedef typename std::vector<BatchUpdate<Key, Value> >::const_iterator UpdateIter;
+    const Key& key = node->getKey();
+    UpdateIter base = updates.begin();
+    size_t mid = std::lower_bound(base + lo, base + hi, key,
+                                  [](const BatchUpdate<Key, Value>& update, const Key& k) { return update.key < k; }) - base;
+    size_t eqEnd = std::upper_bound(base + mid, base + hi, key,
+                                    [](const Key& k, const BatchUpdate<Key, Value>& update) { return k < update.key; }) - base;
+
+    leftHeight = (node->getBalance() > 0) ? height - 2 : height - 1;
+    rightHeight = (node->getBalance() < 0) ? height - 2 : height - 1;
+
+    const size_t parallelCutoff = 4096;
+    if (threads > 1 && node->getLeft() != nullptr && node->getRight() != nullptr &&
+        mid - lo >= parallelCutoff && hi - eqEnd >= parallelCutoff) {
+        unsigned leftThreads = threads / 2;
+        std::vector<AVLNode<Key, Value>*> leftDoomed;
+        int leftInner[2];
+        int rightInner[2];
+        AVLNode<Key, Value>* left = node->getLeft();
+        AVLNode<Key, Value>* right = node->getRight();
+        std::thread worker([&]() {
+            batchMerge(left, leftHeight, updates, lo, mid, leftThreads, leftDoomed, leftInner[0], leftInner[1]);
+        });
+        batchMerge(right, rightHeight, updates, eqEnd, hi, threads - leftThreads, doomed, rightInner[0], rightInner[1]);
+        worker.join();
+        doomed.insert(doomed.end(), leftDoomed.begin(), leftDoomed.end());
+        leftHeight = balanceAt(left, leftInner[0], leftInner[1]);
+        rightHeight = balanceAt(right, rightInner[0], rightInner[1]);
+    } else {
+        if (mid > lo) {
+            batchChild(node, true, leftHeight, updates, lo, mid, threads, doomed, leftHeight, rightHeight);
+        }
+        if (hi > eqEnd) {
+            batchChild(node, false, rightHeight, updates, eqEnd, hi, threads, doomed, leftHeight, rightHeight);
+        }
+    }
+
+    if (eqEnd > mid) { //The last update for this key wins
+        const BatchUpdate<Key, Value>& update = updates[eqEnd - 1];
+        if (update.remove) {
+            doomed.push_back(node);
+        } else {
+            node->setValue(update.value);
+        }
+    }
+    pull(node);
+}
+
+/*
+ * Helper for batchMerge: merges updates[lo, hi) into node's left or right
+ * child, of height height, building a fresh subtree if there is none, and
+ * stores the child's new height in leftHeight or rightHeight.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::batchChild(AVLNode<Key, Value>* node, bool left, int height,
+                                     const std::vector<BatchUpdate<Key, Value> >& updates, size_t lo, size_t hi,
+                                     unsigned threads, std::vector<AVLNode<Key, Value>*>& doomed,
+                                     int& leftHeight, int& rightHeight)
+{
+    AVLNode<Key, Value>* child = left ? node->getLeft() : node->getRight();
+    int newHeight = 0;
+    if (child == nullptr) {
+        child = batchBuild(updates, lo, hi, node, newHeight);
+        if (left) {
+            node->setLeft(child);
+        } else {
+            node->setRight(child);
+        }
+    } else {
+        int innerLeft = 0;
+        int innerRight = 0;
+        batchMerge(child, height, updates, lo, hi, threads, doomed, innerLeft, innerRight);
+        newHeight = balanceAt(child, innerLeft, innerRight);
+    }
+    (left ? leftHeight : rightHeight) = newHeight;
+}
+
+/*
+ * Helper for apply_batch: a balanced subtree of the upserts in
+ * updates[lo, hi) (keeping each key's last update) to hang under parent.
+ */
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::batchBuild(const std::vector<BatchUpdate<Key, Value> >& updates,
+                                                     size_t lo, size_t hi, AVLNode<Key, Value>* parent, int& height)
+{
+    if (hi - lo == 1) { //The common case: a single new key under a leaf
+        height = 0;
+        if (updates[lo].remove) {
+            return nullptr;
+        }
+        AVLNode<Key, Value>* node = createNode(updates[lo].key, updates[lo].value, parent);
+        pull(node);
+        height = 1;
+        return node;
+    }
+    std::vector<AVLNode<Key, Value>*> nodes;
+    for (size_t i = lo; i < hi; ++i) {
+        if (i + 1 < hi && !(updates[i].key < updates[i + 1].key)) { //A later update replaces this one
+            continue;
+        }
+        if (!updates[i].remove) {
+            nodes.push_back(createNode(updates[i].key, updates[i].value, nullptr));
+        }
+    }
+    return buildBalanced(nodes, 0, nodes.size(), parent, height);
+}
+
+/*
+ * Helper for apply_batch: node's subtrees are AVL trees of the given
+ * heights. Sets node's balance, or joins them at node if they differ by two
+ * or more, and returns the height of whatever now stands in node's place.
+ */
+template<class Key, class Value>
+int AVLTree<Key, Value>::balanceAt(AVLNode<Key, Value>* node, int leftHeight, int rightHeight)
+{
+    if (std::abs(rightHeight - leftHeight) <= 1) {
+        node->setBalance((int8_t)(rightHeight - leftHeight));
+        return 1 + std::max(leftHeight, rightHeight);
+    }
+    return joinAt(node, leftHeight, rightHeight);
+}
+
+//Helper that gathers every node in key order without recursing
+template<class Key, class Value>
+void AVLTree<Key, Value>::collectNodes(std::vector<AVLNode<Key, Value>*>& nodes) const
+{
+    AVLNode<Key, Value>* currentNode = static_cast<AVLNode<Key, Value>*>(this->getSmallestNode());
+    while (currentNode != nullptr) {
+        nodes.push_back(currentNode);
+        if (currentNode->getRight() != nullptr) { //Leftmost node of the right subtree
+            currentNode = currentNode->getRight();
+            while (currentNode->getLeft() != nullptr) {
+                currentNode = currentNode->getLeft();
+            }
+        } else { //Climb until we come up from a left child
+            AVLNode<Key, Value>* parent = currentNode->getParent();
+            while (parent != nullptr && parent->getRight() == currentNode) {
+                currentNode = parent;
+                parent = parent->getParent();
+            }
+            currentNode = parent;
+        }
+    }
+}
+
+/*
+ * Links nodes[lo, hi) (already in key order) into a perfectly balanced subtree
+ * under parent and sets every balance factor. Returns the subtree root and
+ * stores its height in height. Recursion depth is only O(log n).
+ */
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::buildBalanced(std::vector<AVLNode<Key, Value>*>& nodes, size_t lo, size_t hi,
+                                                        AVLNode<Key, Value>* parent, int& height)
+{
+    if (lo >= hi) {
+        height = 0;
+        return nullptr;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    AVLNode<Key, Value>* node = nodes[mid];
+    int leftHeight = 0;
+    int rightHeight = 0;
+    node->setParent(parent);
+    node->setLeft(buildBalanced(nodes, lo, mid, node, leftHeight));
+    node->setRight(buildBalanced(nodes, mid + 1, hi, node, rightHeight));
+    node->setBalance((int8_t)(rightHeight - leftHeight));
+    pull(node);
+    height = 1 + std::max(leftHeight, rightHeight);
+    return node;
+}
+
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    return new AVLNode<Key, Value>(key, value, parent);
+}
+
+/*
+ * Called whenever node's children changed (after a rotation, a bulk build or
+ * a join) once the children themselves are up to date. Nothing to do here.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::pull(AVLNode<Key, Value>* node)
+{
+
+}
+
+/*
+ * Called after an insert, remove or value update changed the contents of
+ * every subtree from node up to (not including) stop, before any rebalancing.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>::pullPath(AVLNode<Key, Value>* node, AVLNode<Key, Value>* stop)
+{
+
+}
+
 template<class Key, class Value>
 void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
@@ -513,6 +1074,251 @@ void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>*
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
+    bool tempD = n1->isDirty();
+    n1->setDirty(n2->isDirty());
+    n2->setDirty(tempD);
+}
+
+/**
+* Switches relaxed balance mode on or off. While relaxed, insert and remove
+* only link/unlink the node and mark the path to the root as dirty; the
+* insertFix/removeFix work is deferred. Lookups stay correct but the tree can
+* get deeper until settle() runs. To keep that bounded, an insert whose
+* descent reaches maxDepth settles the dirty part of the tree right away.
+* Switching relaxed mode off settles the tree.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::setRelaxed(bool relaxed, int maxDepth)
+{
+    relaxed_ = relaxed;
+    relaxedDepth_ = maxDepth;
+    if (!relaxed_) {
+        settle();
+    }
+}
+
+template<class Key, class Value>
+bool AVLTree<Key, Value>::isRelaxed() const
+{
+    return relaxed_;
+}
+
+/**
+* An AVLTree is always within a factor of 1.44 of the optimal height, so
+* there is nothing to restructure beyond settling relaxed mode writes. The
+* base DSW fold is not used because it would leave stale balance factors.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::rebalance()
+{
+    settle();
+}
+
+/**
+* Restores the AVL property after relaxed mode writes. Only dirty nodes are
+* visited, bottom-up: by the time a node is reached both of its subtrees are
+* valid AVL trees again, and if their heights differ by more than one the node
+* is used to join them, which costs rotations proportional to the difference.
+* Can be called at any time, including while still relaxed.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::settle()
+{
+    if (getRoot() == nullptr || !getRoot()->isDirty()) {
+        return;
+    }
+
+    //Iterative post-order over the dirty nodes. childHeight carries the
+    //height of the subtree that was just finished back to its parent frame.
+    struct Frame { AVLNode<Key, Value>* node; int stage; int leftHeight; };
+    std::vector<Frame> stack;
+    Frame top = { getRoot(), 0, 0 };
+    stack.push_back(top);
+    int childHeight = 0;
+
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        AVLNode<Key, Value>* node = frame.node;
+        if (frame.stage == 0) {
+            frame.stage = 1;
+            AVLNode<Key, Value>* left = node->getLeft();
+            if (left != nullptr && left->isDirty()) {
+                Frame next = { left, 0, 0 };
+                stack.push_back(next);
+                continue;
+            }
+            childHeight = heightOf(left);
+        }
+        if (frame.stage == 1) {
+            frame.leftHeight = childHeight;
+            frame.stage = 2;
+            AVLNode<Key, Value>* right = node->getRight();
+            if (right != nullptr && right->isDirty()) {
+                Frame next = { right, 0, 0 };
+                stack.push_back(next);
+                continue;
+            }
+            childHeight = heightOf(right);
+        }
+
+        int leftHeight = frame.leftHeight;
+        int rightHeight = childHeight;
+        stack.pop_back();
+        node->setDirty(false);
+        if (std::abs(rightHeight - leftHeight) <= 1) {
+            node->setBalance((int8_t)(rightHeight - leftHeight));
+            childHeight = 1 + std::max(leftHeight, rightHeight);
+        } else {
+            childHeight = joinAt(node, leftHeight, rightHeight);
+        }
+    }
+}
+
+//Helper that marks node and its ancestors dirty, stopping at the first one already marked
+template<class Key, class Value>
+void AVLTree<Key, Value>::markDirty(AVLNode<Key, Value>* node)
+{
+    while (node != nullptr && !node->isDirty()) {
+        node->setDirty(true);
+        node = node->getParent();
+    }
+}
+
+//Height of a subtree whose balance factors are valid: follow the taller side
+template<class Key, class Value>
+int AVLTree<Key, Value>::heightOf(AVLNode<Key, Value>* node)
+{
+    int height = 0;
+    while (node != nullptr) {
+        height++;
+        node = (node->getBalance() < 0) ? node->getLeft() : node->getRight();
+    }
+    return height;
+}
+
+/*
+ * Helper for settle(): node's two subtrees are AVL trees whose heights differ
+ * by 2 or more. The taller subtree takes node's place, node is hung on its
+ * inner spine at the point where the heights match up, and the growth is
+ * retraced upward as after an insert. Returns the new subtree height.
+ */
+template<class Key, class Value>
+int AVLTree<Key, Value>::joinAt(AVLNode<Key, Value>* node, int leftHeight, int rightHeight)
+{
+    AVLNode<Key, Value>* above = node->getParent();
+    bool rightTaller = rightHeight > leftHeight;
+    AVLNode<Key, Value>* taller = rightTaller ? node->getRight() : node->getLeft();
+    int shortHeight = rightTaller ? leftHeight : rightHeight;
+
+    //The taller subtree takes node's place
+    taller->setParent(above);
+    if (above == nullptr) {
+        this->root_ = taller;
+    } else if (above->getLeft() == node) {
+        above->setLeft(taller);
+    } else {
+        above->setRight(taller);
+    }
+
+    //Walk down its inner spine until the subtree there is no more than one taller
+    AVLNode<Key, Value>* spineParent = nullptr;
+    AVLNode<Key, Value>* spine = taller;
+    int spineHeight = rightTaller ? rightHeight : leftHeight;
+    while (spineHeight > shortHeight + 1) {
+        spineParent = spine;
+        if (rightTaller) {
+            spineHeight -= (spine->getBalance() <= 0) ? 1 : 2;
+            spine = spine->getLeft();
+        } else {
+            spineHeight -= (spine->getBalance() >= 0) ? 1 : 2;
+            spine = spine->getRight();
+        }
+    }
+
+    //node takes spine's place, with the short subtree and spine as its children
+    node->setParent(spineParent);
+    if (rightTaller) {
+        spineParent->setLeft(node);
+        node->setRight(spine);
+        node->setBalance((int8_t)(spineHeight - shortHeight));
+    } else {
+        spineParent->setRight(node);
+        node->setLeft(spine);
+        node->setBalance((int8_t)(shortHeight - spineHeight));
+    }
+    if (spine != nullptr) {
+        spine->setParent(node);
+    }
+    pullPath(node, above); //Only the spine below above holds different nodes now
+
+    return std::max(leftHeight, rightHeight) + retraceGrowth(node, above);
+}
+
+/*
+ * Helper that retraces after the subtree at node grew by one level, the same
+ * way insertFix does, but never above stop. Returns 1 if the growth reached
+ * stop (the whole subtree got taller) and 0 if a rotation or balance absorbed it.
+ */
+template<class Key, class Value>
+int AVLTree<Key, Value>::retraceGrowth(AVLNode<Key, Value>* node, AVLNode<Key, Value>* stop)
+{
+    AVLNode<Key, Value>* parent = node->getParent();
+    while (parent != stop) {
+        bool fromLeft = (parent->getLeft() == node);
+        parent->updateBalance(fromLeft ? -1 : 1);
+        int8_t balance = parent->getBalance();
+        if (balance == 0) {
+            return 0;
+        }
+        if (balance == -1 || balance == 1) {
+            node = parent;
+            parent = parent->getParent();
+            continue;
+        }
+
+        int8_t heavy = fromLeft ? -1 : 1; //Sign of the overweight side
+        if (node->getBalance() == heavy) { //Zig-zig
+            if (fromLeft) {
+                rotateRight(parent);
+            } else {
+                rotateLeft(parent);
+            }
+            parent->setBalance(0);
+            node->setBalance(0);
+            return 0;
+        } else if (node->getBalance() == -heavy) { //Zig-zag
+            AVLNode<Key, Value>* grandChild = fromLeft ? node->getRight() : node->getLeft();
+            if (fromLeft) {
+                rotateLeft(node);
+                rotateRight(parent);
+            } else {
+                rotateRight(node);
+                rotateLeft(parent);
+            }
+            if (grandChild->getBalance() == heavy) {
+                node->setBalance(0);
+                parent->setBalance((int8_t)-heavy);
+            } else if (grandChild->getBalance() == 0) {
+                node->setBalance(0);
+                parent->setBalance(0);
+            } else {
+                node->setBalance(heavy);
+                parent->setBalance(0);
+            }
+            grandChild->setBalance(0);
+            return 0;
+        } else { //Even child (only the joined node can be): rotating keeps the extra level
+            if (fromLeft) {
+                rotateRight(parent);
+            } else {
+                rotateLeft(parent);
+            }
+            node->setBalance((int8_t)-heavy);
+            parent->setBalance(heavy);
+            parent = node->getParent();
+        }
+    }
+    return 1;
 }
 
 
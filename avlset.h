@@ -0,0 +1,621 @@
+#ifndef AVLSET_H
+#define AVLSET_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+/**
+* A node for an AVLSet. Unlike AVLNode it has no value, no vtable and no
+* relaxed-mode flag; the balance byte sits right after the key so it shares
+* the key's padding. For an int key that is 32 bytes instead of the 48 of an
+* AVLNode<int, bool>.
+*/
+template <typename Key>
+class AVLSetNode
+{
+public:
+    AVLSetNode(const Key& key, AVLSetNode<Key>* parent);
+
+    const Key& getKey() const;
+    int8_t getBalance() const;
+    void setBalance(int8_t balance);
+    AVLSetNode<Key>* getParent() const;
+    AVLSetNode<Key>* getLeft() const;
+    AVLSetNode<Key>* getRight() const;
+    void setParent(AVLSetNode<Key>* parent);
+    void setLeft(AVLSetNode<Key>* left);
+    void setRight(AVLSetNode<Key>* right);
+
+protected:
+    const Key key_;
+    int8_t balance_;
+    AVLSetNode<Key>* parent_;
+    AVLSetNode<Key>* left_;
+    AVLSetNode<Key>* right_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the AVLSetNode class.
+  -------------------------------------------------
+*/
+
+template<typename Key>
+AVLSetNode<Key>::AVLSetNode(const Key& key, AVLSetNode<Key>* parent) :
+    key_(key), balance_(0), parent_(parent), left_(nullptr), right_(nullptr)
+{
+
+}
+
+template<typename Key>
+const Key& AVLSetNode<Key>::getKey() const
+{
+    return key_;
+}
+
+template<typename Key>
+int8_t AVLSetNode<Key>::getBalance() const
+{
+    return balance_;
+}
+
+template<typename Key>
+void AVLSetNode<Key>::setBalance(int8_t balance)
+{
+    balance_ = balance;
+}
+
+template<typename Key>
+AVLSetNode<Key>* AVLSetNode<Key>::getParent() const
+{
+    return parent_;
+}
+
+template<typename Key>
+AVLSetNode<Key>* AVLSetNode<Key>::getLeft() const
+{
+    return left_;
+}
+
+template<typename Key>
+AVLSetNode<Key>* AVLSetNode<Key>::getRight() const
+{
+    return right_;
+}
+
+template<typename Key>
+void AVLSetNode<Key>::setParent(AVLSetNode<Key>* parent)
+{
+    parent_ = parent;
+}
+
+template<typename Key>
+void AVLSetNode<Key>::setLeft(AVLSetNode<Key>* left)
+{
+    left_ = left;
+}
+
+template<typename Key>
+void AVLSetNode<Key>::setRight(AVLSetNode<Key>* right)
+{
+    right_ = right;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the AVLSetNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An ordered set with the AVLTree interface minus the values: insert,
+* remove, find, lower_bound/upper_bound and in-order iteration over const
+* keys. It is a separate tree rather than AVLTree<Key, Value> with an empty
+* Value because Node always stores a std::pair<const Key, Value> and a vtable
+* pointer, and both cost memory per element.
+*/
+template <class Key>
+class AVLSet
+{
+public:
+    AVLSet();
+    ~AVLSet();
+
+    void insert(const Key& key);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    bool isBalanced() const;
+
+    /**
+    * Forward iterator over the keys in order.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const Key& operator*() const;
+        const Key* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class AVLSet<Key>;
+        iterator(AVLSetNode<Key>* ptr);
+        AVLSetNode<Key>* current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+
+protected:
+    // Helper functions
+    void rotateLeft(AVLSetNode<Key>* node);
+    void rotateRight(AVLSetNode<Key>* node);
+    void replaceChild(AVLSetNode<Key>* parent, AVLSetNode<Key>* oldChild, AVLSetNode<Key>* newChild);
+    void removeFix(AVLSetNode<Key>* parent, bool fromLeft);
+    static int checkHeight(AVLSetNode<Key>* node);
+
+    AVLSetNode<Key>* root_;
+};
+
+/*
+--------------------------------------------------------------
+Begin implementations for the AVLSet::iterator class.
+---------------------------------------------------------------
+*/
+
+template<class Key>
+AVLSet<Key>::iterator::iterator(AVLSetNode<Key>* ptr) :
+    current_(ptr)
+{
+
+}
+
+template<class Key>
+AVLSet<Key>::iterator::iterator() :
+    current_(nullptr)
+{
+
+}
+
+template<class Key>
+const Key& AVLSet<Key>::iterator::operator*() const
+{
+    return current_->getKey();
+}
+
+template<class Key>
+const Key* AVLSet<Key>::iterator::operator->() const
+{
+    return &(current_->getKey());
+}
+
+template<class Key>
+bool AVLSet<Key>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<class Key>
+bool AVLSet<Key>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+//Advance to the in-order successor
+template<class Key>
+typename AVLSet<Key>::iterator& AVLSet<Key>::iterator::operator++()
+{
+    if (current_->getRight() != nullptr) {
+        current_ = current_->getRight();
+        while (current_->getLeft() != nullptr) {
+            current_ = current_->getLeft();
+        }
+    } else {
+        AVLSetNode<Key>* parent = current_->getParent();
+        while (parent != nullptr && parent->getRight() == current_) {
+            current_ = parent;
+            parent = parent->getParent();
+        }
+        current_ = parent;
+    }
+    return *this;
+}
+
+/*
+-------------------------------------------------------------
+End implementations for the AVLSet::iterator class.
+-------------------------------------------------------------
+*/
+
+/*
+-----------------------------------------------------
+Begin implementations for the AVLSet class.
+-----------------------------------------------------
+*/
+
+template<class Key>
+AVLSet<Key>::AVLSet() :
+    root_(nullptr)
+{
+
+}
+
+template<class Key>
+AVLSet<Key>::~AVLSet()
+{
+    clear();
+}
+
+template<class Key>
+bool AVLSet<Key>::empty() const
+{
+    return root_ == nullptr;
+}
+
+/**
+* Removes every key. Left children are rotated up so no recursion is needed.
+*/
+template<class Key>
+void AVLSet<Key>::clear()
+{
+    AVLSetNode<Key>* node = root_;
+    while (node != nullptr) {
+        AVLSetNode<Key>* left = node->getLeft();
+        if (left != nullptr) {
+            node->setLeft(left->getRight());
+            left->setRight(node);
+            node = left;
+        } else {
+            AVLSetNode<Key>* right = node->getRight();
+            delete node;
+            node = right;
+        }
+    }
+    root_ = nullptr;
+}
+
+template<class Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::begin() const
+{
+    AVLSetNode<Key>* node = root_;
+    while (node != nullptr && node->getLeft() != nullptr) {
+        node = node->getLeft();
+    }
+    return iterator(node);
+}
+
+template<class Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::end() const
+{
+    return iterator(nullptr);
+}
+
+template<class Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::find(const Key& key) const
+{
+    AVLSetNode<Key>* node = root_;
+    while (node != nullptr) {
+        if (key < node->getKey()) {
+            node = node->getLeft();
+        } else if (node->getKey() < key) {
+            node = node->getRight();
+        } else {
+            return iterator(node);
+        }
+    }
+    return end();
+}
+
+template<class Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::lower_bound(const Key& key) const
+{
+    AVLSetNode<Key>* node = root_;
+    AVLSetNode<Key>* candidate = nullptr;
+    while (node != nullptr) {
+        if (node->getKey() < key) {
+            node = node->getRight();
+        } else {
+            candidate = node;
+            node = node->getLeft();
+        }
+    }
+    return iterator(candidate);
+}
+
+template<class Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::upper_bound(const Key& key) const
+{
+    AVLSetNode<Key>* node = root_;
+    AVLSetNode<Key>* candidate = nullptr;
+    while (node != nullptr) {
+        if (key < node->getKey()) {
+            candidate = node;
+            node = node->getLeft();
+        } else {
+            node = node->getRight();
+        }
+    }
+    return iterator(candidate);
+}
+
+//Helper that puts newChild where oldChild hung under parent (or at the root)
+template<class Key>
+void AVLSet<Key>::replaceChild(AVLSetNode<Key>* parent, AVLSetNode<Key>* oldChild, AVLSetNode<Key>* newChild)
+{
+    if (newChild != nullptr) {
+        newChild->setParent(parent);
+    }
+    if (parent == nullptr) {
+        root_ = newChild;
+    } else if (parent->getLeft() == oldChild) {
+        parent->setLeft(newChild);
+    } else {
+        parent->setRight(newChild);
+    }
+}
+
+//Rotate left around node; its right child takes its place
+template<class Key>
+void AVLSet<Key>::rotateLeft(AVLSetNode<Key>* node)
+{
+    AVLSetNode<Key>* child = node->getRight();
+    node->setRight(child->getLeft());
+    if (child->getLeft() != nullptr) {
+        child->getLeft()->setParent(node);
+    }
+    replaceChild(node->getParent(), node, child);
+    child->setLeft(node);
+    node->setParent(child);
+}
+
+//Rotate right around node; its left child takes its place
+template<class Key>
+void AVLSet<Key>::rotateRight(AVLSetNode<Key>* node)
+{
+    AVLSetNode<Key>* child = node->getLeft();
+    node->setLeft(child->getRight());
+    if (child->getRight() != nullptr) {
+        child->getRight()->setParent(node);
+    }
+    replaceChild(node->getParent(), node, child);
+    child->setRight(node);
+    node->setParent(child);
+}
+
+/*
+ * Inserts key if it is not already present, then retraces the growth
+ * upward like AVLTree::insertFix, with at most one single or double
+ * rotation.
+ */
+template<class Key>
+void AVLSet<Key>::insert(const Key& key)
+{
+    AVLSetNode<Key>* parent = nullptr;
+    AVLSetNode<Key>* node = root_;
+    while (node != nullptr) {
+        parent = node;
+        if (key < node->getKey()) {
+            node = node->getLeft();
+        } else if (node->getKey() < key) {
+            node = node->getRight();
+        } else {
+            return;
+        }
+    }
+
+    node = new AVLSetNode<Key>(key, parent);
+    if (parent == nullptr) {
+        root_ = node;
+        return;
+    }
+    if (key < parent->getKey()) {
+        parent->setLeft(node);
+    } else {
+        parent->setRight(node);
+    }
+
+    while (parent != nullptr) {
+        parent->setBalance((int8_t)(parent->getBalance() + (parent->getLeft() == node ? -1 : 1)));
+        int8_t balance = parent->getBalance();
+        if (balance == 0) {
+            return;
+        }
+        if (balance == -1 || balance == 1) {
+            node = parent;
+            parent = parent->getParent();
+            continue;
+        }
+
+        int8_t heavy = (balance < 0) ? -1 : 1;
+        if (node->getBalance() == heavy) { //Zig-zig
+            if (heavy < 0) {
+                rotateRight(parent);
+            } else {
+                rotateLeft(parent);
+            }
+            parent->setBalance(0);
+            node->setBalance(0);
+        } else { //Zig-zag
+            AVLSetNode<Key>* grandChild = (heavy < 0) ? node->getRight() : node->getLeft();
+            if (heavy < 0) {
+                rotateLeft(node);
+                rotateRight(parent);
+            } else {
+                rotateRight(node);
+                rotateLeft(parent);
+            }
+            if (grandChild->getBalance() == heavy) {
+                node->setBalance(0);
+                parent->setBalance((int8_t)-heavy);
+            } else if (grandChild->getBalance() == 0) {
+                node->setBalance(0);
+                parent->setBalance(0);
+            } else {
+                node->setBalance(heavy);
+                parent->setBalance(0);
+            }
+            grandChild->setBalance(0);
+        }
+        return;
+    }
+}
+
+/*
+ * A node with two children is replaced by its predecessor, which is
+ * relinked into its place (so iterators to other keys stay valid), and the
+ * shrink is retraced from where the predecessor came from.
+ */
+template<class Key>
+void AVLSet<Key>::remove(const Key& key)
+{
+    AVLSetNode<Key>* node = find(key).current_;
+    if (node == nullptr) {
+        return;
+    }
+
+    AVLSetNode<Key>* parent = node->getParent();
+    bool fromLeft = (parent != nullptr && parent->getLeft() == node);
+
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        AVLSetNode<Key>* pred = node->getLeft();
+        while (pred->getRight() != nullptr) {
+            pred = pred->getRight();
+        }
+        AVLSetNode<Key>* retraceFrom;
+        if (pred == node->getLeft()) { //pred keeps its left subtree and moves up one level
+            retraceFrom = pred;
+            fromLeft = true;
+        } else { //pred's left subtree takes its old place
+            retraceFrom = pred->getParent();
+            fromLeft = false;
+            retraceFrom->setRight(pred->getLeft());
+            if (pred->getLeft() != nullptr) {
+                pred->getLeft()->setParent(retraceFrom);
+            }
+            pred->setLeft(node->getLeft());
+            node->getLeft()->setParent(pred);
+        }
+        pred->setRight(node->getRight());
+        node->getRight()->setParent(pred);
+        pred->setBalance(node->getBalance());
+        replaceChild(parent, node, pred);
+        delete node;
+        removeFix(retraceFrom, fromLeft);
+        return;
+    }
+
+    AVLSetNode<Key>* child = (node->getLeft() != nullptr) ? node->getLeft() : node->getRight();
+    replaceChild(parent, node, child);
+    delete node;
+    removeFix(parent, fromLeft);
+}
+
+/*
+ * Helper that retraces after the subtree on one side of parent (the left
+ * one if fromLeft) got one level shorter, rotating where needed, until the
+ * height stops changing.
+ */
+template<class Key>
+void AVLSet<Key>::removeFix(AVLSetNode<Key>* parent, bool fromLeft)
+{
+    while (parent != nullptr) {
+        parent->setBalance((int8_t)(parent->getBalance() + (fromLeft ? 1 : -1)));
+        int8_t balance = parent->getBalance();
+        if (balance == -1 || balance == 1) { //Was even, so the height did not change
+            return;
+        }
+
+        AVLSetNode<Key>* top = parent;
+        if (balance == 2 || balance == -2) {
+            int8_t heavy = (balance < 0) ? -1 : 1;
+            AVLSetNode<Key>* sibling = (heavy < 0) ? parent->getLeft() : parent->getRight();
+            int8_t siblingBalance = sibling->getBalance();
+            if (siblingBalance != -heavy) { //Single rotation
+                if (heavy < 0) {
+                    rotateRight(parent);
+                } else {
+                    rotateLeft(parent);
+                }
+                top = sibling;
+                if (siblingBalance == 0) { //Height unchanged
+                    parent->setBalance(heavy);
+                    sibling->setBalance((int8_t)-heavy);
+                    return;
+                }
+                parent->setBalance(0);
+                sibling->setBalance(0);
+            } else { //Double rotation
+                AVLSetNode<Key>* grandChild = (heavy < 0) ? sibling->getRight() : sibling->getLeft();
+                if (heavy < 0) {
+                    rotateLeft(sibling);
+                    rotateRight(parent);
+                } else {
+                    rotateRight(sibling);
+                    rotateLeft(parent);
+                }
+                if (grandChild->getBalance() == heavy) {
+                    parent->setBalance((int8_t)-heavy);
+                    sibling->setBalance(0);
+                } else if (grandChild->getBalance() == 0) {
+                    parent->setBalance(0);
+                    sibling->setBalance(0);
+                } else {
+                    parent->setBalance(0);
+                    sibling->setBalance(heavy);
+                }
+                grandChild->setBalance(0);
+                top = grandChild;
+            }
+        }
+
+        //The subtree at top is one level shorter; carry that upward
+        AVLSetNode<Key>* above = top->getParent();
+        fromLeft = (above != nullptr && above->getLeft() == top);
+        parent = above;
+    }
+}
+
+//Helper returning the height of a valid AVL subtree, or -1 if any node is off balance
+template<class Key>
+int AVLSet<Key>::checkHeight(AVLSetNode<Key>* node)
+{
+    if (node == nullptr) {
+        return 0;
+    }
+    int leftHeight = checkHeight(node->getLeft());
+    int rightHeight = checkHeight(node->getRight());
+    if (leftHeight < 0 || rightHeight < 0 || std::abs(rightHeight - leftHeight) > 1 ||
+        rightHeight - leftHeight != node->getBalance()) {
+        return -1;
+    }
+    return 1 + std::max(leftHeight, rightHeight);
+}
+
+/**
+* Return true iff the set is height balanced and every balance factor is right.
+*/
+template<class Key>
+bool AVLSet<Key>::isBalanced() const
+{
+    return checkHeight(root_) >= 0;
+}
+
+/*
+---------------------------------------------------
+End implementations for the AVLSet class.
+---------------------------------------------------
+*/
+
+#endif
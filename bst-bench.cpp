@@ -0,0 +1,1663 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <malloc.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "parallelscan.h"
+#include "ingest.h"
+#include "walavl.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "treap.h"
+#include "scapegoat.h"
+#include "augavl.h"
+#include "intervaltree.h"
+#include "avlset.h"
+#include "stringkey.h"
+#include "expiringcache.h"
+#include "bufferedavl.h"
+#include "lazyavl.h"
+#include "persistentavl.h"
+#include "concurrentavl.h"
+#include "skiplist.h"
+#include "shardedtree.h"
+
+using namespace std;
+
+// Benchmarks for the search trees. Run with the name of a benchmark
+// (or "all") and optional benchmark specific arguments, e.g.
+//   ./bst-bench ingest 4096     (ingest a 4 GB generated file)
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Small xorshift generator so runs are reproducible across platforms.
+struct BenchRng
+{
+    explicit BenchRng(uint64_t seed) : state(seed ? seed : 88172645463325252ull) { }
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    uint64_t state;
+};
+
+/**
+* Streaming ingest vs. the getline + insert loop it replaces, on a generated
+* text file of "key value" lines. Argument: file size in MB (default 256).
+*/
+static void benchIngest(int argc, char* argv[])
+{
+    size_t megabytes = (argc > 0) ? strtoul(argv[0], NULL, 10) : 256;
+    const char* path = "bst-bench-ingest.txt";
+
+    {
+        ofstream out(path);
+        BenchRng rng(1);
+        size_t written = 0;
+        char line[64];
+        while (written < megabytes * 1048576) {
+            int len = snprintf(line, sizeof(line), "%lld %lld\n",
+                               (long long)(rng.next() % 100000000), (long long)(rng.next() % 1000000));
+            out.write(line, len);
+            written += len;
+        }
+    }
+
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<long long, long long> tree;
+        ifstream in(path);
+        string line;
+        while (getline(in, line)) {
+            istringstream fields(line);
+            long long key, value;
+            if (fields >> key >> value) {
+                tree.insert(std::make_pair(key, value));
+            }
+        }
+    }
+    double baseline = secondsSince(start);
+
+    IngestStats stats;
+    {
+        AVLTree<long long, long long> tree;
+        stats = ingestTextFile(path, tree);
+    }
+    remove(path);
+
+    cout << "ingest: " << megabytes << " MB, " << stats.records << " records" << endl;
+    cout << "  getline+insert : " << (megabytes / baseline) << " MB/s" << endl;
+    cout << "  ingestTextFile : " << stats.mbPerSec() << " MB/s (target " << stats.targetMBps
+         << " MB/s: " << (stats.metTarget() ? "met" : "missed") << ")" << endl;
+}
+
+/**
+* Insert/remove cost with the write-ahead log on vs. the plain in-memory tree.
+* Argument: number of operations (default 1000000).
+*/
+static void benchWal(int argc, char* argv[])
+{
+    size_t ops = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    const char* logPath = "bst-bench-wal.log";
+
+    double seconds[2];
+    for (int logged = 0; logged < 2; ++logged) {
+        LoggedAVLTree<long long, long long> tree;
+        if (logged) {
+            tree.openLog(logPath);
+        }
+        BenchRng rng(2);
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            long long key = (long long)(rng.next() % 1000000);
+            if (i % 4 == 3) {
+                tree.remove(key);
+            } else {
+                tree.insert(std::make_pair(key, (long long)i));
+            }
+        }
+        tree.commit();
+        seconds[logged] = secondsSince(start);
+    }
+    remove(logPath);
+
+    cout << "wal: " << ops << " mixed insert/remove" << endl;
+    cout << "  in-memory : " << (seconds[0] * 1e9 / ops) << " ns/op" << endl;
+    cout << "  logged    : " << (seconds[1] * 1e9 / ops) << " ns/op ("
+         << (seconds[1] / seconds[0]) << "x)" << endl;
+}
+
+/**
+* Runs the same mixed insert/remove trace (one remove for every insert, keys
+* drawn from a fixed range so the tree size stays stable) against a tree.
+*/
+template <typename Tree>
+static double mixedInsertErase(size_t ops, uint64_t keyRange)
+{
+    Tree tree;
+    BenchRng rng(3);
+    for (uint64_t i = 0; i < keyRange / 2; ++i) {
+        tree.insert(std::make_pair((long long)(rng.next() % keyRange), 0LL));
+    }
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        long long key = (long long)(rng.next() % keyRange);
+        if (i % 2) {
+            tree.remove(key);
+        } else {
+            tree.insert(std::make_pair(key, (long long)i));
+        }
+    }
+    return secondsSince(start);
+}
+
+/**
+* RBTree vs. AVLTree on a remove-heavy mixed workload.
+* Argument: number of operations (default 2000000).
+*/
+static void benchRedBlack(int argc, char* argv[])
+{
+    size_t ops = (argc > 0) ? strtoul(argv[0], NULL, 10) : 2000000;
+    const uint64_t keyRange = 1 << 20;
+    double avl = mixedInsertErase<AVLTree<long long, long long> >(ops, keyRange);
+    double rb = mixedInsertErase<RBTree<long long, long long> >(ops, keyRange);
+
+    cout << "rb: " << ops << " mixed insert/remove over " << keyRange << " keys" << endl;
+    cout << "  AVLTree : " << (avl * 1e9 / ops) << " ns/op" << endl;
+    cout << "  RBTree  : " << (rb * 1e9 / ops) << " ns/op" << endl;
+    cout << "  node size: AVLNode " << sizeof(AVLNode<long long, long long>)
+         << " bytes, RBNode " << sizeof(RBNode<long long, long long>) << " bytes" << endl;
+}
+
+/**
+* Draws ranks from a Zipf(s) distribution over [0, n) by inverting a
+* precomputed CDF.
+*/
+class ZipfTrace
+{
+public:
+    ZipfTrace(size_t n, double s, uint64_t seed) : cdf_(n), rng_(seed)
+    {
+        double total = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            total += 1.0 / pow((double)(i + 1), s);
+            cdf_[i] = total;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            cdf_[i] /= total;
+        }
+    }
+
+    size_t next()
+    {
+        double u = (rng_.next() >> 11) * (1.0 / 9007199254740992.0);
+        return std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+    }
+
+private:
+    std::vector<double> cdf_;
+    BenchRng rng_;
+};
+
+/**
+* SplayTree vs. AVLTree lookups on a Zipfian access trace. The hot ranks are
+* scattered over the key space so the balanced tree gets no help from them.
+* Arguments: number of lookups (default 5000000), Zipf exponent (default 1.1).
+*/
+static void benchSplay(int argc, char* argv[])
+{
+    size_t lookups = (argc > 0) ? strtoul(argv[0], NULL, 10) : 5000000;
+    double exponent = (argc > 1) ? atof(argv[1]) : 1.1;
+    const size_t keys = 1 << 20;
+
+    std::vector<long long> keyOfRank(keys);
+    BenchRng shuffle(4);
+    for (size_t i = 0; i < keys; ++i) {
+        keyOfRank[i] = (long long)i;
+    }
+    for (size_t i = keys - 1; i > 0; --i) {
+        std::swap(keyOfRank[i], keyOfRank[shuffle.next() % (i + 1)]);
+    }
+
+    AVLTree<long long, long long> avl;
+    SplayTree<long long, long long> splay;
+    for (size_t i = 0; i < keys; ++i) {
+        avl.insert(std::make_pair(keyOfRank[i], (long long)i));
+        splay.insert(std::make_pair(keyOfRank[i], (long long)i));
+    }
+
+    //Materialize the trace first so sampling cost is not timed
+    std::vector<long long> trace(lookups);
+    ZipfTrace zipf(keys, exponent, 5);
+    for (size_t i = 0; i < lookups; ++i) {
+        trace[i] = keyOfRank[zipf.next()];
+    }
+
+    long long checksum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < lookups; ++i) {
+        checksum += avl.find(trace[i])->second;
+    }
+    double avlSeconds = secondsSince(start);
+
+    start = Clock::now();
+    for (size_t i = 0; i < lookups; ++i) {
+        checksum -= splay.find(trace[i])->second;
+    }
+    double splaySeconds = secondsSince(start);
+
+    cout << "splay: " << lookups << " Zipf(" << exponent << ") lookups over " << keys << " keys"
+         << (checksum == 0 ? "" : " (MISMATCH)") << endl;
+    cout << "  AVLTree    : " << (avlSeconds * 1e9 / lookups) << " ns/lookup" << endl;
+    cout << "  SplayTree  : " << (splaySeconds * 1e9 / lookups) << " ns/lookup" << endl;
+}
+
+/**
+* Partition rebalancing: the key space [0, keys) is cut into contiguous
+* partitions, and each round moves a boundary between two neighbours by a
+* random amount. Treaps do this with split + merge; AVLTrees have to move
+* the keys one insert/remove at a time.
+* Arguments: number of rounds (default 500), number of keys (default 1000000).
+*/
+static void benchTreap(int argc, char* argv[])
+{
+    size_t rounds = (argc > 0) ? strtoul(argv[0], NULL, 10) : 500;
+    long long keys = (argc > 1) ? atoll(argv[1]) : 1000000;
+    const size_t parts = 16;
+
+    //Both variants replay the same boundary moves
+    std::vector<long long> initialBounds(parts + 1);
+    for (size_t p = 0; p <= parts; ++p) {
+        initialBounds[p] = keys * (long long)p / (long long)parts;
+    }
+    std::vector<std::pair<size_t, long long> > moves; //(left partition, new boundary)
+    {
+        std::vector<long long> bounds = initialBounds;
+        BenchRng rng(6);
+        for (size_t r = 0; r < rounds; ++r) {
+            size_t i = rng.next() % (parts - 1);
+            long long lo = bounds[i] + 1;
+            long long hi = bounds[i + 2] - 1;
+            long long nb = lo + (long long)(rng.next() % (uint64_t)(hi - lo + 1));
+            bounds[i + 1] = nb;
+            moves.push_back(std::make_pair(i, nb));
+        }
+    }
+
+    double seconds[2];
+    long long sizes[2] = { 0, 0 };
+    {
+        std::vector<Treap<long long, long long> > part(parts);
+        for (size_t p = 0; p < parts; ++p) {
+            for (long long k = initialBounds[p]; k < initialBounds[p + 1]; ++k) {
+                part[p].insert(std::make_pair(k, k));
+            }
+        }
+        std::vector<long long> bounds = initialBounds;
+        Clock::time_point start = Clock::now();
+        for (size_t r = 0; r < moves.size(); ++r) {
+            size_t i = moves[r].first;
+            long long nb = moves[r].second;
+            Treap<long long, long long> moved;
+            if (nb < bounds[i + 1]) { //Left partition gives its top to the right one
+                part[i].split(nb, moved);
+                moved.merge(part[i + 1]);
+                part[i + 1].merge(moved);
+            } else { //Right partition gives its bottom to the left one
+                part[i + 1].split(nb, moved);
+                part[i].merge(part[i + 1]);
+                part[i + 1].merge(moved);
+            }
+            bounds[i + 1] = nb;
+        }
+        seconds[0] = secondsSince(start);
+        for (size_t p = 0; p < parts; ++p) {
+            for (Treap<long long, long long>::iterator it = part[p].begin(); it != part[p].end(); ++it) {
+                sizes[0]++;
+            }
+        }
+    }
+    {
+        std::vector<AVLTree<long long, long long> > part(parts);
+        for (size_t p = 0; p < parts; ++p) {
+            for (long long k = initialBounds[p]; k < initialBounds[p + 1]; ++k) {
+                part[p].insert(std::make_pair(k, k));
+            }
+        }
+        std::vector<long long> bounds = initialBounds;
+        Clock::time_point start = Clock::now();
+        for (size_t r = 0; r < moves.size(); ++r) {
+            size_t i = moves[r].first;
+            long long nb = moves[r].second;
+            long long lo = std::min(nb, bounds[i + 1]);
+            long long hi = std::max(nb, bounds[i + 1]);
+            AVLTree<long long, long long>& from = (nb < bounds[i + 1]) ? part[i] : part[i + 1];
+            AVLTree<long long, long long>& to = (nb < bounds[i + 1]) ? part[i + 1] : part[i];
+            for (long long k = lo; k < hi; ++k) {
+                to.insert(std::make_pair(k, from[k]));
+                from.remove(k);
+            }
+            bounds[i + 1] = nb;
+        }
+        seconds[1] = secondsSince(start);
+        for (size_t p = 0; p < parts; ++p) {
+            for (AVLTree<long long, long long>::iterator it = part[p].begin(); it != part[p].end(); ++it) {
+                sizes[1]++;
+            }
+        }
+    }
+
+    cout << "treap: " << rounds << " boundary moves over " << parts << " partitions of " << keys << " keys"
+         << (sizes[0] == keys && sizes[1] == keys ? "" : " (MISMATCH)") << endl;
+    cout << "  Treap split/merge  : " << (seconds[0] * 1e6 / rounds) << " us/move" << endl;
+    cout << "  AVLTree key moves  : " << (seconds[1] * 1e6 / rounds) << " us/move" << endl;
+}
+
+/**
+* Burst ingest into an existing tree with and without relaxed balancing; the
+* relaxed time includes the settle() that restores the AVL shape afterwards.
+* Arguments: burst size (default 1000000), "sorted" for an ascending burst.
+*/
+static void benchRelaxed(int argc, char* argv[])
+{
+    size_t burst = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    bool sorted = (argc > 1) && string(argv[1]) == "sorted";
+    const size_t existing = 1 << 20;
+
+    double seconds[2];
+    double settleSeconds = 0.0;
+    for (int relaxed = 0; relaxed < 2; ++relaxed) {
+        AVLTree<long long, long long> tree;
+        BenchRng rng(7);
+        for (size_t i = 0; i < existing; ++i) {
+            tree.insert(std::make_pair((long long)(rng.next() % (1ull << 40)), 0LL));
+        }
+        Clock::time_point start = Clock::now();
+        tree.setRelaxed(relaxed != 0);
+        for (size_t i = 0; i < burst; ++i) {
+            long long key = sorted ? (long long)((1ull << 40) + i) : (long long)(rng.next() % (1ull << 40));
+            tree.insert(std::make_pair(key, (long long)i));
+        }
+        Clock::time_point settleStart = Clock::now();
+        tree.setRelaxed(false);
+        seconds[relaxed] = secondsSince(start);
+        if (relaxed) {
+            settleSeconds = secondsSince(settleStart);
+        }
+        if (!tree.isBalanced()) {
+            cout << "relaxed: tree NOT balanced after settle" << endl;
+        }
+    }
+
+    cout << "relaxed: " << burst << (sorted ? " sorted" : " random") << " inserts into " << existing << " keys" << endl;
+    cout << "  insertFix per insert : " << (seconds[0] * 1e9 / burst) << " ns/insert" << endl;
+    cout << "  relaxed + settle     : " << (seconds[1] * 1e9 / burst) << " ns/insert (settle "
+         << (settleSeconds * 1e3) << " ms)" << endl;
+}
+
+/**
+* Bytes a node really takes on the heap: malloc rounds each request up, so
+* AVLNode's extra balance byte can cost a whole allocation size class.
+*/
+template<class NodeType>
+static size_t heapBytesPerNode()
+{
+    NodeType* node = new NodeType(0, 0, nullptr);
+    size_t bytes = malloc_usable_size(node);
+    delete node;
+    return bytes;
+}
+
+/**
+* ScapegoatTree vs. AVLTree on an append-mostly table: mostly ascending keys
+* with some random ones mixed in, followed by random lookups.
+* Arguments: number of inserts (default 1000000), percent random (default 10).
+*/
+static void benchScapegoat(int argc, char* argv[])
+{
+    size_t inserts = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    size_t randomPercent = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10;
+
+    std::vector<long long> keys(inserts);
+    BenchRng rng(8);
+    for (size_t i = 0; i < inserts; ++i) {
+        keys[i] = (rng.next() % 100 < randomPercent) ? (long long)(rng.next() % (inserts * 4)) : (long long)(i * 4 + 1);
+    }
+    std::vector<long long> probes(inserts);
+    for (size_t i = 0; i < inserts; ++i) {
+        probes[i] = keys[rng.next() % inserts];
+    }
+
+    double insertSeconds[2];
+    double lookupSeconds[2];
+    long long checksum = 0;
+    {
+        AVLTree<long long, long long> avl;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < inserts; ++i) {
+            avl.insert(std::make_pair(keys[i], (long long)i));
+        }
+        insertSeconds[0] = secondsSince(start);
+        start = Clock::now();
+        for (size_t i = 0; i < inserts; ++i) {
+            checksum += avl.find(probes[i])->second;
+        }
+        lookupSeconds[0] = secondsSince(start);
+    }
+    {
+        ScapegoatTree<long long, long long> goat;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < inserts; ++i) {
+            goat.insert(std::make_pair(keys[i], (long long)i));
+        }
+        insertSeconds[1] = secondsSince(start);
+        start = Clock::now();
+        for (size_t i = 0; i < inserts; ++i) {
+            checksum -= goat.find(probes[i])->second;
+        }
+        lookupSeconds[1] = secondsSince(start);
+    }
+
+    cout << "scapegoat: " << inserts << " inserts (" << randomPercent << "% random), "
+         << inserts << " lookups" << (checksum == 0 ? "" : " (MISMATCH)") << endl;
+    cout << "  AVLTree       : " << sizeof(AVLNode<long long, long long>) << " B/node ("
+         << heapBytesPerNode<AVLNode<long long, long long> >() << " on heap), "
+         << (insertSeconds[0] * 1e9 / inserts) << " ns/insert, "
+         << (lookupSeconds[0] * 1e9 / inserts) << " ns/lookup" << endl;
+    cout << "  ScapegoatTree : " << sizeof(Node<long long, long long>) << " B/node ("
+         << heapBytesPerNode<Node<long long, long long> >() << " on heap), "
+         << (insertSeconds[1] * 1e9 / inserts) << " ns/insert, "
+         << (lookupSeconds[1] * 1e9 / inserts) << " ns/lookup" << endl;
+}
+
+/**
+* A BinarySearchTree fed sorted keys degenerates into a list; rebalance()
+* folds it back in O(n). Reports the fold time and lookups before and after.
+* Argument: number of keys (default 20000; building the list is quadratic).
+*/
+static void benchRebalance(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 20000;
+    const size_t lookups = 200000;
+
+    BinarySearchTree<long long, long long> tree;
+    for (size_t i = 0; i < keys; ++i) {
+        tree.insert(std::make_pair((long long)i, (long long)i));
+    }
+    std::vector<long long> probes(lookups);
+    BenchRng rng(9);
+    for (size_t i = 0; i < lookups; ++i) {
+        probes[i] = (long long)(rng.next() % keys);
+    }
+
+    long long checksum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < lookups; ++i) {
+        checksum += tree.find(probes[i])->second;
+    }
+    double listSeconds = secondsSince(start);
+
+    start = Clock::now();
+    tree.rebalance();
+    double foldSeconds = secondsSince(start);
+
+    start = Clock::now();
+    for (size_t i = 0; i < lookups; ++i) {
+        checksum -= tree.find(probes[i])->second;
+    }
+    double balancedSeconds = secondsSince(start);
+
+    cout << "rebalance: " << keys << " sorted keys" << (checksum == 0 ? "" : " (MISMATCH)") << endl;
+    cout << "  degenerate lookups : " << (listSeconds * 1e9 / lookups) << " ns/lookup" << endl;
+    cout << "  rebalance()        : " << (foldSeconds * 1e3) << " ms ("
+         << (tree.isBalanced() ? "balanced" : "NOT balanced") << ")" << endl;
+    cout << "  balanced lookups   : " << (balancedSeconds * 1e9 / lookups) << " ns/lookup" << endl;
+}
+
+/**
+* Range sums over large windows: iterating an AVLTree over each window vs.
+* AugmentedAVLTree::reduce. Also shows what keeping the sums costs on insert.
+* Arguments: number of keys (default 1000000), window size (default 100000).
+*/
+static void benchReduce(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    long long window = (argc > 1) ? atoll(argv[1]) : 100000;
+    const size_t queries = 1000;
+
+    std::vector<long long> order(keys);
+    for (size_t i = 0; i < keys; ++i) {
+        order[i] = (long long)i;
+    }
+    BenchRng rng(10);
+    for (size_t i = keys - 1; i > 0; --i) {
+        std::swap(order[i], order[rng.next() % (i + 1)]);
+    }
+
+    AVLTree<long long, long long> plain;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < keys; ++i) {
+        plain.insert(std::make_pair(order[i], order[i] % 1000));
+    }
+    double plainInsert = secondsSince(start);
+
+    AugmentedAVLTree<long long, long long, SumMonoid<long long> > summed;
+    start = Clock::now();
+    for (size_t i = 0; i < keys; ++i) {
+        summed.insert(std::make_pair(order[i], order[i] % 1000));
+    }
+    double summedInsert = secondsSince(start);
+
+    std::vector<long long> lows(queries);
+    for (size_t q = 0; q < queries; ++q) {
+        lows[q] = (long long)(rng.next() % keys);
+    }
+
+    long long checksum = 0;
+    start = Clock::now();
+    for (size_t q = 0; q < queries; ++q) {
+        long long hi = lows[q] + window;
+        for (AVLTree<long long, long long>::iterator it = plain.lower_bound(lows[q]);
+             it != plain.end() && it->first < hi; ++it) {
+            checksum += it->second;
+        }
+    }
+    double iterateSeconds = secondsSince(start);
+
+    start = Clock::now();
+    for (size_t q = 0; q < queries; ++q) {
+        checksum -= summed.reduce(lows[q], lows[q] + window);
+    }
+    double reduceSeconds = secondsSince(start);
+
+    cout << "reduce: " << queries << " sums over windows of " << window << " in " << keys << " keys"
+         << (checksum == 0 ? "" : " (MISMATCH)") << endl;
+    cout << "  iterator loop : " << (iterateSeconds * 1e6 / queries) << " us/query" << endl;
+    cout << "  reduce()      : " << (reduceSeconds * 1e6 / queries) << " us/query" << endl;
+    cout << "  insert cost   : " << (plainInsert * 1e9 / keys) << " ns plain, "
+         << (summedInsert * 1e9 / keys) << " ns augmented" << endl;
+}
+
+/**
+* Stabbing queries on an IntervalTree vs. scanning every interval, for single
+* points and for one sorted batch. Arguments: number of intervals (default
+* 1000000), number of query points (default 100000).
+*/
+static void benchInterval(int argc, char* argv[])
+{
+    size_t intervals = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    size_t queries = (argc > 1) ? strtoul(argv[1], NULL, 10) : 100000;
+    const long long span = 1000000000LL;
+    const size_t scanQueries = 20; //A full scan per point is too slow to run them all
+
+    IntervalTree<long long, long long> tree;
+    BenchRng rng(11);
+    for (size_t i = 0; i < intervals; ++i) {
+        long long start = (long long)(rng.next() % span);
+        tree.insertInterval(start, start + (long long)(rng.next() % 10000), (long long)i);
+    }
+    std::vector<long long> points(queries);
+    for (size_t q = 0; q < queries; ++q) {
+        points[q] = (long long)(rng.next() % span);
+    }
+
+    long long scanHits = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t q = 0; q < scanQueries; ++q) {
+        for (IntervalTree<long long, long long>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            if (it->first.start <= points[q] && points[q] <= it->first.end) {
+                scanHits++;
+            }
+        }
+    }
+    double scanSeconds = secondsSince(start);
+
+    long long treeHits = 0;
+    long long prefixHits = 0;
+    start = Clock::now();
+    for (size_t q = 0; q < queries; ++q) {
+        size_t found = tree.stab(points[q]).size();
+        treeHits += (long long)found;
+        if (q < scanQueries) {
+            prefixHits += (long long)found;
+        }
+    }
+    double stabSeconds = secondsSince(start);
+
+    long long batchHits = 0;
+    start = Clock::now();
+    tree.stabBatch(points, [&batchHits](size_t, const Interval<long long>&, const long long&) {
+        batchHits++;
+    });
+    double batchSeconds = secondsSince(start);
+
+    cout << "interval: " << queries << " stabbing queries over " << intervals << " intervals, "
+         << treeHits << " hits" << ((scanHits == prefixHits && batchHits == treeHits) ? "" : " (MISMATCH)") << endl;
+    cout << "  linear scan  : " << (scanSeconds * 1e6 / scanQueries) << " us/query" << endl;
+    cout << "  stab()       : " << (stabSeconds * 1e6 / queries) << " us/query" << endl;
+    cout << "  stabBatch()  : " << (batchSeconds * 1e6 / queries) << " us/query" << endl;
+}
+
+// Vector-of-values wrapper; the trees need values they can print
+struct ValueList
+{
+    std::vector<long long> values;
+};
+
+static ostream& operator<<(ostream& out, const ValueList& list)
+{
+    return out << list.values.size() << " values";
+}
+
+/**
+* Several values per key: an AVLTree of vectors (the wrapping multimap mode
+* replaces) vs. an AVLTree in multimap mode, inserting then reading every
+* value back through equal_range. Arguments: number of keys (default
+* 200000), values per key (default 5).
+*/
+static void benchMultimap(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 200000;
+    size_t perKey = (argc > 1) ? strtoul(argv[1], NULL, 10) : 5;
+    size_t total = keys * perKey;
+
+    std::vector<long long> stream(total);
+    BenchRng rng(12);
+    for (size_t i = 0; i < total; ++i) {
+        stream[i] = (long long)(rng.next() % keys);
+    }
+
+    long long checksum = 0;
+    double insertSeconds[2];
+    double readSeconds[2];
+    {
+        AVLTree<long long, ValueList> wrapped;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < total; ++i) {
+            AVLTree<long long, ValueList>::iterator it = wrapped.find(stream[i]);
+            if (it == wrapped.end()) {
+                ValueList list;
+                list.values.push_back((long long)i);
+                wrapped.insert(std::make_pair(stream[i], list));
+            } else {
+                it->second.values.push_back((long long)i);
+            }
+        }
+        insertSeconds[0] = secondsSince(start);
+        start = Clock::now();
+        for (size_t k = 0; k < keys; ++k) {
+            AVLTree<long long, ValueList>::iterator it = wrapped.find((long long)k);
+            if (it != wrapped.end()) {
+                for (size_t j = 0; j < it->second.values.size(); ++j) {
+                    checksum += it->second.values[j];
+                }
+            }
+        }
+        readSeconds[0] = secondsSince(start);
+    }
+    {
+        AVLTree<long long, long long> multi;
+        multi.setMultimap(true);
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < total; ++i) {
+            multi.insert(std::make_pair(stream[i], (long long)i));
+        }
+        insertSeconds[1] = secondsSince(start);
+        start = Clock::now();
+        for (size_t k = 0; k < keys; ++k) {
+            typedef AVLTree<long long, long long>::iterator Iter;
+            std::pair<Iter, Iter> range = multi.equal_range((long long)k);
+            for (Iter it = range.first; it != range.second; ++it) {
+                checksum -= it->second;
+            }
+        }
+        readSeconds[1] = secondsSince(start);
+    }
+
+    cout << "multimap: " << total << " values over " << keys << " keys" << (checksum == 0 ? "" : " (MISMATCH)") << endl;
+    cout << "  vector values : " << (insertSeconds[0] * 1e9 / total) << " ns/insert, "
+         << (readSeconds[0] * 1e9 / total) << " ns/value read" << endl;
+    cout << "  multimap mode : " << (insertSeconds[1] * 1e9 / total) << " ns/insert, "
+         << (readSeconds[1] * 1e9 / total) << " ns/value read" << endl;
+}
+
+/**
+* AVLTree<int, bool> used as a set vs. AVLSet<int>: bytes per element,
+* inserts and membership lookups. Argument: number of keys (default 1000000).
+*/
+static void benchSet(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+
+    std::vector<int> stream(keys);
+    std::vector<int> probes(keys);
+    BenchRng rng(13);
+    for (size_t i = 0; i < keys; ++i) {
+        stream[i] = (int)(rng.next() % (keys * 2));
+        probes[i] = (int)(rng.next() % (keys * 2));
+    }
+
+    size_t hits[2] = { 0, 0 };
+    double insertSeconds[2];
+    double lookupSeconds[2];
+    {
+        AVLTree<int, bool> tree;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < keys; ++i) {
+            tree.insert(std::make_pair(stream[i], true));
+        }
+        insertSeconds[0] = secondsSince(start);
+        start = Clock::now();
+        for (size_t i = 0; i < keys; ++i) {
+            hits[0] += (tree.find(probes[i]) != tree.end());
+        }
+        lookupSeconds[0] = secondsSince(start);
+    }
+    {
+        AVLSet<int> set;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < keys; ++i) {
+            set.insert(stream[i]);
+        }
+        insertSeconds[1] = secondsSince(start);
+        start = Clock::now();
+        for (size_t i = 0; i < keys; ++i) {
+            hits[1] += (set.find(probes[i]) != set.end());
+        }
+        lookupSeconds[1] = secondsSince(start);
+    }
+
+    AVLSetNode<int>* setNode = new AVLSetNode<int>(0, nullptr);
+    size_t setHeapBytes = malloc_usable_size(setNode);
+    delete setNode;
+
+    cout << "set: " << keys << " int keys" << (hits[0] == hits[1] ? "" : " (MISMATCH)") << endl;
+    cout << "  AVLTree<int,bool> : " << sizeof(AVLNode<int, bool>) << " B/node ("
+         << heapBytesPerNode<AVLNode<int, bool> >() << " on heap), "
+         << (insertSeconds[0] * 1e9 / keys) << " ns/insert, "
+         << (lookupSeconds[0] * 1e9 / keys) << " ns/lookup" << endl;
+    cout << "  AVLSet<int>       : " << sizeof(AVLSetNode<int>) << " B/node ("
+         << setHeapBytes << " on heap), "
+         << (insertSeconds[1] * 1e9 / keys) << " ns/insert, "
+         << (lookupSeconds[1] * 1e9 / keys) << " ns/lookup" << endl;
+}
+
+/**
+* Random 16-24 character keys sharing a 4 byte "usr:" prefix, like table
+* keys in practice: std::string keys against arena-backed StringKeys.
+*/
+static void benchStringKey(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 500000;
+
+    std::vector<std::string> stream(keys);
+    std::vector<std::string> probes(keys);
+    BenchRng rng(17);
+    for (size_t i = 0; i < keys; ++i) {
+        for (int which = 0; which < 2; ++which) {
+            std::string& text = (which == 0) ? stream[i] : probes[i];
+            size_t length = 16 + rng.next() % 9;
+            text = "usr:";
+            while (text.size() < length) {
+                text += (char)('a' + rng.next() % 26);
+            }
+        }
+        if (i % 2 == 1) {
+            probes[i] = stream[rng.next() % i]; //Half the probes hit
+        }
+    }
+
+    size_t hits[2] = { 0, 0 };
+    double insertSeconds[2];
+    double lookupSeconds[2];
+    {
+        AVLTree<std::string, int> tree;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < keys; ++i) {
+            tree.insert(std::make_pair(stream[i], (int)i));
+        }
+        insertSeconds[0] = secondsSince(start);
+        start = Clock::now();
+        for (size_t i = 0; i < keys; ++i) {
+            hits[0] += (tree.find(probes[i]) != tree.end());
+        }
+        lookupSeconds[0] = secondsSince(start);
+    }
+    {
+        StringArena arena;
+        StringAVLTree<int> tree;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < keys; ++i) {
+            tree.insert(std::make_pair(arena.key(stream[i]), (int)i));
+        }
+        insertSeconds[1] = secondsSince(start);
+        start = Clock::now();
+        for (size_t i = 0; i < keys; ++i) {
+            hits[1] += (tree.find(StringKey(probes[i])) != tree.end());
+        }
+        lookupSeconds[1] = secondsSince(start);
+    }
+
+    cout << "string: " << keys << " keys of 16-24 bytes" << (hits[0] == hits[1] ? "" : " (MISMATCH)") << endl;
+    cout << "  AVLTree<std::string,int> : " << sizeof(AVLNode<std::string, int>) << " B/node, "
+         << (insertSeconds[0] * 1e9 / keys) << " ns/insert, "
+         << (lookupSeconds[0] * 1e9 / keys) << " ns/lookup" << endl;
+    cout << "  StringAVLTree<int>       : " << sizeof(AVLNode<StringKey, int>) << " B/node, "
+         << (insertSeconds[1] * 1e9 / keys) << " ns/insert, "
+         << (lookupSeconds[1] * 1e9 / keys) << " ns/lookup" << endl;
+}
+
+/**
+* A burst of entries written together all expire at once; afterwards a
+* stream of puts and gets runs over the cache. Evicting every expired entry
+* on the first call after the deadline stalls that one call, while the
+* default batch of 16 per call spreads the work over the stream.
+*/
+static void benchCache(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 500000;
+
+    BenchRng rng(19);
+    std::vector<int> stream(keys);
+    for (size_t i = 0; i < keys; ++i) {
+        stream[i] = (int)(rng.next() % keys);
+    }
+
+    cout << "cache: " << keys << " entries expiring together, then " << keys << " puts/gets" << endl;
+    size_t batches[2] = { (size_t)-1, 16 };
+    for (int run = 0; run < 2; ++run) {
+        ExpiringCache<int, int> cache(keys * 2, 0, batches[run]);
+        for (size_t i = 0; i < keys; ++i) {
+            cache.put((int)(keys + i), (int)i, 0, 100);
+        }
+
+        std::vector<double> latency(keys);
+        Clock::time_point begin = Clock::now();
+        for (size_t i = 0; i < keys; ++i) {
+            Clock::time_point start = Clock::now();
+            if (i % 2 == 0) {
+                cache.put(stream[i], (int)i, 100 + i, 1000000);
+            } else {
+                cache.get(stream[i], 100 + i);
+            }
+            latency[i] = secondsSince(start);
+        }
+        double total = secondsSince(begin);
+        std::sort(latency.begin(), latency.end());
+
+        cout << "  evict " << (run == 0 ? "all expired per call" : "16 expired per call ")
+             << ": " << (total * 1e9 / keys) << " ns/op, p99.9 "
+             << (latency[keys - 1 - keys / 1000] * 1e6) << " us, worst "
+             << (latency[keys - 1] * 1e6) << " us, " << cache.size() << " left" << endl;
+    }
+}
+
+/**
+* The scheduler queue pattern: hold n timers, repeatedly take the earliest
+* and schedule a new one later. Compares begin() + remove(key), which
+* searches for the key it already holds, with pop_min().
+*/
+static void benchQueue(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 200000;
+    size_t ops = keys * 5;
+
+    BenchRng rng(23);
+    std::vector<long long> delays(ops);
+    for (size_t i = 0; i < ops; ++i) {
+        delays[i] = (long long)(rng.next() % (keys * 4));
+    }
+
+    double seconds[2];
+    long long checksum[2] = { 0, 0 };
+    for (int run = 0; run < 2; ++run) {
+        AVLTree<long long, int> queue;
+        queue.setMultimap(true);
+        for (size_t i = 0; i < keys; ++i) {
+            queue.insert(std::make_pair(delays[i], (int)i));
+        }
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            long long now;
+            if (run == 0) {
+                now = queue.begin()->first;
+                queue.remove(now);
+            } else {
+                now = queue.pop_min().first;
+            }
+            checksum[run] += now;
+            queue.insert(std::make_pair(now + delays[i], (int)i));
+        }
+        seconds[run] = secondsSince(start);
+    }
+
+    cout << "queue: " << keys << " timers, " << ops << " pop+push" << (checksum[0] == checksum[1] ? "" : " (MISMATCH)") << endl;
+    cout << "  begin() + remove(key): " << (seconds[0] * 1e9 / ops) << " ns/op" << endl;
+    cout << "  pop_min()            : " << (seconds[1] * 1e9 / ops) << " ns/op" << endl;
+}
+
+/**
+* Deletes runs of consecutive keys from a large AVL tree, either one
+* remove(key) per key or with one erase(first, last) per run.
+*/
+static void benchErase(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    size_t run = 100;
+    size_t runs = keys / run / 4;
+
+    std::vector<std::pair<int, int> > items(keys);
+    for (size_t i = 0; i < keys; ++i) {
+        items[i] = std::make_pair((int)i, (int)i);
+    }
+    std::vector<int> starts(runs);
+    BenchRng rng(29);
+    for (size_t i = 0; i < runs; ++i) {
+        starts[i] = (int)(rng.next() % keys);
+    }
+
+    double seconds[2];
+    size_t left[2];
+    for (int mode = 0; mode < 2; ++mode) {
+        AVLTree<int, int> tree;
+        tree.insertSorted(items.begin(), items.end());
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < runs; ++i) {
+            int lo = starts[i];
+            int hi = lo + (int)run;
+            if (mode == 0) {
+                for (int key = lo; key < hi; ++key) {
+                    tree.remove(key);
+                }
+            } else {
+                tree.erase(tree.lower_bound(lo), tree.lower_bound(hi));
+            }
+        }
+        seconds[mode] = secondsSince(start);
+        left[mode] = 0;
+        for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            left[mode]++;
+        }
+    }
+
+    cout << "erase: " << runs << " runs of " << run << " keys from " << keys
+         << (left[0] == left[1] ? "" : " (MISMATCH)") << endl;
+    cout << "  remove(key) per key : " << (seconds[0] * 1e6 / runs) << " us/run" << endl;
+    cout << "  erase(first, last)  : " << (seconds[1] * 1e6 / runs) << " us/run" << endl;
+}
+
+/**
+* Applies a batch of upserts and removes (3:1) to a large tree. The batch
+* arrives in random order; it is applied one insert()/remove() per update
+* as it comes, the same after sorting it, and by sorting it and calling
+* apply_batch with one and with several threads. Sorting is timed.
+*/
+static void benchBatch(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    size_t batchSize = (argc > 1) ? strtoul(argv[1], NULL, 10) : 100000;
+    unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+
+    std::vector<std::pair<int, int> > items(keys);
+    for (size_t i = 0; i < keys; ++i) {
+        items[i] = std::make_pair((int)(i * 2), (int)i);
+    }
+    BenchRng rng(31);
+    std::vector<BatchUpdate<int, int> > arrivals;
+    for (size_t i = 0; i < batchSize; ++i) {
+        int key = (int)(rng.next() % (keys * 2));
+        if (rng.next() % 4 == 0) {
+            arrivals.push_back(BatchUpdate<int, int>(key));
+        } else {
+            arrivals.push_back(BatchUpdate<int, int>(key, (int)i));
+        }
+    }
+
+    const char* names[4] = { "insert/remove as they come", "insert/remove after sorting",
+                             "sort + apply_batch, 1 thread", "sort + apply_batch, threads" };
+    double seconds[4];
+    long long checksum[4];
+    for (int mode = 0; mode < 4; ++mode) {
+        AVLTree<int, int> tree;
+        tree.insertSorted(items.begin(), items.end());
+        std::vector<BatchUpdate<int, int> > batch(arrivals);
+        Clock::time_point start = Clock::now();
+        if (mode > 0) {
+            std::stable_sort(batch.begin(), batch.end(),
+                             [](const BatchUpdate<int, int>& a, const BatchUpdate<int, int>& b) { return a.key < b.key; });
+        }
+        if (mode < 2) {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (batch[i].remove) {
+                    tree.remove(batch[i].key);
+                } else {
+                    tree.insert(std::make_pair(batch[i].key, batch[i].value));
+                }
+            }
+        } else {
+            tree.apply_batch(batch, mode == 2 ? 1 : threads);
+        }
+        seconds[mode] = secondsSince(start);
+        checksum[mode] = 0;
+        for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            checksum[mode] += it->first ^ it->second;
+        }
+    }
+
+    bool same = (checksum[0] == checksum[1] && checksum[0] == checksum[2] && checksum[0] == checksum[3]);
+    cout << "batch: " << batchSize << " updates into " << keys << " keys, " << threads << " threads"
+         << (same ? "" : " (MISMATCH)") << endl;
+    for (int mode = 0; mode < 4; ++mode) {
+        cout << "  " << names[mode] << ": " << (seconds[mode] * 1e9 / batchSize) << " ns/update" << endl;
+    }
+}
+
+/**
+* Sustained random inserts into a large tree, straight into an AVLTree and
+* through BufferedAVLTrees of a few buffer sizes, then random lookups
+* against each (with whatever the buffer still holds) to show the read cost.
+*/
+static void benchBuffered(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    size_t writes = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    std::vector<std::pair<int, int> > items(keys);
+    for (size_t i = 0; i < keys; ++i) {
+        items[i] = std::make_pair((int)(i * 2), (int)i);
+    }
+    BenchRng rng(37);
+    std::vector<int> writeKeys(writes);
+    std::vector<int> readKeys(writes);
+    for (size_t i = 0; i < writes; ++i) {
+        writeKeys[i] = (int)(rng.next() % (keys * 4));
+        readKeys[i] = (int)(rng.next() % (keys * 4));
+    }
+
+    const size_t limits[4] = { 0, 1024, 16384, 131072 };
+    cout << "buffered: " << writes << " random inserts into " << keys << " keys" << endl;
+    for (int mode = 0; mode < 4; ++mode) {
+        double insertSeconds;
+        double lookupSeconds;
+        long long checksum = 0;
+        if (mode == 0) {
+            AVLTree<int, int> tree;
+            tree.insertSorted(items.begin(), items.end());
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < writes; ++i) {
+                tree.insert(std::make_pair(writeKeys[i], (int)i));
+            }
+            insertSeconds = secondsSince(start);
+            start = Clock::now();
+            for (size_t i = 0; i < writes; ++i) {
+                AVLTree<int, int>::iterator it = tree.find(readKeys[i]);
+                checksum += (it == tree.end()) ? 0 : it->second;
+            }
+            lookupSeconds = secondsSince(start);
+        } else {
+            BufferedAVLTree<int, int> tree(limits[mode]);
+            for (size_t i = 0; i < keys; ++i) {
+                tree.insert(items[i]);
+            }
+            tree.flush();
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < writes; ++i) {
+                tree.insert(std::make_pair(writeKeys[i], (int)i));
+            }
+            insertSeconds = secondsSince(start);
+            start = Clock::now();
+            for (size_t i = 0; i < writes; ++i) {
+                BufferedAVLTree<int, int>::iterator it = tree.find(readKeys[i]);
+                checksum += (it == tree.end()) ? 0 : it->second;
+            }
+            lookupSeconds = secondsSince(start);
+        }
+        cout << "  " << (mode == 0 ? string("AVLTree") : "buffer " + std::to_string(limits[mode]))
+             << ": insert " << (insertSeconds * 1e9 / writes) << " ns, find "
+             << (lookupSeconds * 1e9 / writes) << " ns (checksum " << checksum << ")" << endl;
+    }
+}
+
+/**
+* Removes half the keys of a large tree in random order, eagerly through
+* AVLTree::remove and lazily through LazyAVLTree (compacting at its default
+* threshold, and never), with per-remove latency, then times random finds
+* against what is left.
+*/
+static void benchLazy(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    size_t removes = keys / 2;
+
+    std::vector<std::pair<int, int> > items(keys);
+    std::vector<int> order(keys);
+    for (size_t i = 0; i < keys; ++i) {
+        items[i] = std::make_pair((int)i, (int)i);
+        order[i] = (int)i;
+    }
+    BenchRng rng(41);
+    for (size_t i = keys - 1; i > 0; --i) {
+        std::swap(order[i], order[rng.next() % (i + 1)]);
+    }
+
+    const char* names[3] = { "AVLTree::remove", "LazyAVLTree, compact at 0.25", "LazyAVLTree, never compact" };
+    cout << "lazy: " << removes << " random removes from " << keys << " keys, then " << removes << " finds" << endl;
+    for (int mode = 0; mode < 3; ++mode) {
+        AVLTree<int, int> eager;
+        LazyAVLTree<int, int> lazy(mode == 1 ? 0.25 : 2.0);
+        if (mode == 0) {
+            eager.insertSorted(items.begin(), items.end());
+        } else {
+            for (size_t i = 0; i < keys; ++i) {
+                lazy.insert(items[i]);
+            }
+        }
+
+        std::vector<double> latency(removes);
+        Clock::time_point begin = Clock::now();
+        for (size_t i = 0; i < removes; ++i) {
+            Clock::time_point start = Clock::now();
+            if (mode == 0) {
+                eager.remove(order[i]);
+            } else {
+                lazy.remove(order[i]);
+            }
+            latency[i] = secondsSince(start);
+        }
+        double total = secondsSince(begin);
+        std::sort(latency.begin(), latency.end());
+
+        long long checksum = 0;
+        begin = Clock::now();
+        for (size_t i = 0; i < removes; ++i) {
+            int key = (int)(rng.next() % keys);
+            if (mode == 0) {
+                checksum += (eager.find(key) == eager.end()) ? 0 : key;
+            } else {
+                checksum += (lazy.find(key) == lazy.end()) ? 0 : key;
+            }
+        }
+        double findTotal = secondsSince(begin);
+
+        cout << "  " << names[mode] << ": remove " << (total * 1e9 / removes) << " ns, p99.9 "
+             << (latency[removes - 1 - removes / 1000] * 1e6) << " us, worst "
+             << (latency[removes - 1] * 1e6) << " us; find " << (findTotal * 1e9 / removes) << " ns";
+        if (mode == 2) {
+            begin = Clock::now();
+            lazy.compact();
+            cout << "; compact() " << (secondsSince(begin) * 1e3) << " ms";
+        }
+        cout << endl;
+    }
+}
+
+/**
+* Random writes with a point-in-time view taken every so often: copying an
+* AVLTree into a fresh one (what callers do today) against
+* PersistentAVLTree::snapshot(), plus what path copying costs per write.
+*/
+static void benchPersistent(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 500000;
+    size_t writes = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200000;
+    size_t every = (argc > 2) ? strtoul(argv[2], NULL, 10) : 10000;
+
+    std::vector<std::pair<int, int> > items(keys);
+    for (size_t i = 0; i < keys; ++i) {
+        items[i] = std::make_pair((int)(i * 2), (int)i);
+    }
+    BenchRng rng(43);
+    std::vector<int> writeKeys(writes);
+    for (size_t i = 0; i < writes; ++i) {
+        writeKeys[i] = (int)(rng.next() % (keys * 2));
+    }
+    size_t snapshots = writes / every;
+
+    cout << "persistent: " << writes << " random writes into " << keys << " keys, a snapshot every "
+         << every << " writes" << endl;
+
+    AVLTree<int, int> tree;
+    tree.insertSorted(items.begin(), items.end());
+    double writeSeconds = 0;
+    double copySeconds = 0;
+    long long checksum = 0;
+    for (size_t i = 0; i < writes; ++i) {
+        Clock::time_point start = Clock::now();
+        if (i % 2 == 0) {
+            tree.insert(std::make_pair(writeKeys[i], (int)i));
+        } else {
+            tree.remove(writeKeys[i]);
+        }
+        writeSeconds += secondsSince(start);
+        if ((i + 1) % every == 0) {
+            start = Clock::now();
+            std::vector<std::pair<int, int> > copy;
+            for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+                copy.push_back(*it);
+            }
+            AVLTree<int, int> view;
+            view.insertSorted(copy.begin(), copy.end());
+            copySeconds += secondsSince(start);
+            checksum += view.begin()->first;
+        }
+    }
+    cout << "  AVLTree + full copy: write " << (writeSeconds * 1e9 / writes) << " ns, copy "
+         << (copySeconds * 1e3 / snapshots) << " ms each (checksum " << checksum << ")" << endl;
+
+    PersistentAVLTree<int, int> persistent;
+    for (size_t i = 0; i < keys; ++i) {
+        persistent.insert(items[i]);
+    }
+    std::vector<PersistentAVLTree<int, int> > views;
+    writeSeconds = 0;
+    copySeconds = 0;
+    checksum = 0;
+    for (size_t i = 0; i < writes; ++i) {
+        Clock::time_point start = Clock::now();
+        if (i % 2 == 0) {
+            persistent.insert(std::make_pair(writeKeys[i], (int)i));
+        } else {
+            persistent.remove(writeKeys[i]);
+        }
+        writeSeconds += secondsSince(start);
+        if ((i + 1) % every == 0) {
+            start = Clock::now();
+            views.push_back(persistent.snapshot());
+            copySeconds += secondsSince(start);
+            checksum += views.back().begin()->first;
+        }
+    }
+    cout << "  PersistentAVLTree:   write " << (writeSeconds * 1e9 / writes) << " ns, snapshot "
+         << (copySeconds * 1e6 / snapshots) << " us each, " << views.size() << " kept (checksum "
+         << checksum << ")" << endl;
+}
+
+/**
+* Reader threads doing random lookups while one writer keeps inserting and
+* removing, against an AVLTree behind one mutex and a ConcurrentAVLTree.
+* Reports total lookups per second for each reader count.
+*/
+static void benchConcurrent(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.5;
+
+    std::vector<std::pair<int, int> > items(keys);
+    for (size_t i = 0; i < keys; ++i) {
+        items[i] = std::make_pair((int)(i * 2), (int)i);
+    }
+    AVLTree<int, int> locked;
+    locked.insertSorted(items.begin(), items.end());
+    std::mutex lock;
+    ConcurrentAVLTree<int, int> concurrent;
+    for (size_t i = 0; i < keys; ++i) {
+        concurrent.insert(items[i]);
+    }
+
+    cout << "concurrent: readers + 1 writer on " << keys << " keys, "
+         << std::thread::hardware_concurrency() << " hardware threads" << endl;
+    const int readerCounts[3] = { 1, 2, 4 };
+    for (int mode = 0; mode < 2; ++mode) {
+        for (int r = 0; r < 3; ++r) {
+            std::atomic<bool> stop(false);
+            std::atomic<long long> reads(0);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < readerCounts[r]; ++t) {
+                threads.push_back(std::thread([&, t]() {
+                    BenchRng rng(100 + t);
+                    long long n = 0;
+                    int value;
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        int key = (int)(rng.next() % (keys * 2));
+                        if (mode == 0) {
+                            std::lock_guard<std::mutex> guard(lock);
+                            locked.find(key);
+                        } else {
+                            concurrent.lookup(key, value);
+                        }
+                        n++;
+                    }
+                    reads += n;
+                }));
+            }
+            threads.push_back(std::thread([&]() {
+                BenchRng rng(7);
+                while (!stop.load(std::memory_order_relaxed)) {
+                    int key = (int)(rng.next() % (keys * 2)) | 1;
+                    bool add = (rng.next() & 1) != 0;
+                    if (mode == 0) {
+                        std::lock_guard<std::mutex> guard(lock);
+                        if (add) {
+                            locked.insert(std::make_pair(key, key));
+                        } else {
+                            locked.remove(key);
+                        }
+                    } else if (add) {
+                        concurrent.insert(std::make_pair(key, key));
+                    } else {
+                        concurrent.remove(key);
+                    }
+                }
+            }));
+            std::this_thread::sleep_for(std::chrono::milliseconds((long)(seconds * 1000)));
+            stop = true;
+            for (size_t t = 0; t < threads.size(); ++t) {
+                threads[t].join();
+            }
+            cout << "  " << (mode == 0 ? "AVLTree + mutex" : "ConcurrentAVLTree") << ", "
+                 << readerCounts[r] << " readers: " << (reads.load() / seconds / 1e6) << " M lookups/s" << endl;
+        }
+    }
+}
+
+/**
+* Write-heavy mix (25% insert, 25% remove, 50% lookup) from 1 to 64
+* threads, against an AVLTree behind one mutex and a LockFreeSkipList.
+* Reports total operations per second.
+*/
+static void benchSkipList(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 100000;
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.3;
+
+    cout << "skiplist: 50% writes on " << keys << " keys, "
+         << std::thread::hardware_concurrency() << " hardware threads" << endl;
+    for (int threadCount = 1; threadCount <= 64; threadCount *= 2) {
+        double rates[2];
+        for (int mode = 0; mode < 2; ++mode) {
+            AVLTree<int, int> locked;
+            std::mutex lock;
+            LockFreeSkipList<int, int> skipList;
+            for (size_t i = 0; i < keys; i += 2) {
+                if (mode == 0) {
+                    locked.insert(std::make_pair((int)i, (int)i));
+                } else {
+                    skipList.insert(std::make_pair((int)i, (int)i));
+                }
+            }
+
+            std::atomic<bool> stop(false);
+            std::atomic<long long> ops(0);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < threadCount; ++t) {
+                threads.push_back(std::thread([&, t]() {
+                    BenchRng rng(200 + t);
+                    long long n = 0;
+                    int value;
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        uint64_t r = rng.next();
+                        int key = (int)((r >> 2) % keys);
+                        int op = (int)(r & 3);
+                        if (mode == 0) {
+                            std::lock_guard<std::mutex> guard(lock);
+                            if (op == 0) {
+                                locked.insert(std::make_pair(key, key));
+                            } else if (op == 1) {
+                                locked.remove(key);
+                            } else {
+                                locked.find(key);
+                            }
+                        } else if (op == 0) {
+                            skipList.insert(std::make_pair(key, key));
+                        } else if (op == 1) {
+                            skipList.remove(key);
+                        } else {
+                            skipList.lookup(key, value);
+                        }
+                        n++;
+                    }
+                    ops += n;
+                }));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds((long)(seconds * 1000)));
+            stop = true;
+            for (size_t t = 0; t < threads.size(); ++t) {
+                threads[t].join();
+            }
+            rates[mode] = ops.load() / seconds / 1e6;
+        }
+        cout << "  " << threadCount << " threads: AVLTree + mutex " << rates[0]
+             << " M ops/s, LockFreeSkipList " << rates[1] << " M ops/s" << endl;
+    }
+}
+
+/**
+* A 50% write mix (25% insert, 25% remove, 50% lookup) on random keys from
+* 1 to 16 threads, against an AVLTree behind one mutex and a ShardedTree,
+* then the same random inserts one at a time and as sorted batches of 4096.
+* Arguments: number of keys (default 100000), largest shard (default 4096),
+* seconds per run (default 0.3).
+*/
+static void benchSharded(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 100000;
+    size_t shardSize = (argc > 1) ? strtoul(argv[1], NULL, 10) : 4096;
+    double seconds = (argc > 2) ? atof(argv[2]) : 0.3;
+
+    cout << "sharded: 50% writes on " << keys << " keys, shards of up to " << shardSize << ", "
+         << std::thread::hardware_concurrency() << " hardware threads" << endl;
+    for (int threadCount = 1; threadCount <= 16; threadCount *= 2) {
+        double rates[2];
+        size_t shardCount = 0;
+        for (int mode = 0; mode < 2; ++mode) {
+            AVLTree<int, int> locked;
+            std::mutex lock;
+            ShardedTree<int, int> sharded(shardSize);
+            for (size_t i = 0; i < keys; i += 2) {
+                if (mode == 0) {
+                    locked.insert(std::make_pair((int)i, (int)i));
+                } else {
+                    sharded.insert(std::make_pair((int)i, (int)i));
+                }
+            }
+
+            std::atomic<bool> stop(false);
+            std::atomic<long long> ops(0);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < threadCount; ++t) {
+                threads.push_back(std::thread([&, t]() {
+                    BenchRng rng(300 + t);
+                    long long n = 0;
+                    int value;
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        uint64_t r = rng.next();
+                        int key = (int)((r >> 2) % keys);
+                        int op = (int)(r & 3);
+                        if (mode == 0) {
+                            std::lock_guard<std::mutex> guard(lock);
+                            if (op == 0) {
+                                locked.insert(std::make_pair(key, key));
+                            } else if (op == 1) {
+                                locked.remove(key);
+                            } else {
+                                locked.find(key);
+                            }
+                        } else if (op == 0) {
+                            sharded.insert(std::make_pair(key, key));
+                        } else if (op == 1) {
+                            sharded.remove(key);
+                        } else {
+                            sharded.lookup(key, value);
+                        }
+                        n++;
+                    }
+                    ops += n;
+                }));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds((long)(seconds * 1000)));
+            stop = true;
+            for (size_t t = 0; t < threads.size(); ++t) {
+                threads[t].join();
+            }
+            rates[mode] = ops.load() / seconds / 1e6;
+            shardCount = sharded.shards();
+        }
+        cout << "  " << threadCount << " threads: AVLTree + mutex " << rates[0]
+             << " M ops/s, ShardedTree " << rates[1] << " M ops/s (" << shardCount << " shards)" << endl;
+    }
+
+    //The same random writes one at a time and as sorted batches grouped by shard
+    std::vector<BatchUpdate<int, int> > updates;
+    BenchRng rng(399);
+    for (size_t i = 0; i < keys; ++i) {
+        int key = (int)(rng.next() % (keys * 4));
+        updates.push_back(BatchUpdate<int, int>(key, (int)i));
+    }
+    ShardedTree<int, int> single(shardSize);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < updates.size(); ++i) {
+        single.insert(std::make_pair(updates[i].key, updates[i].value));
+    }
+    double singleSeconds = secondsSince(start);
+    ShardedTree<int, int> batched(shardSize);
+    start = Clock::now();
+    for (size_t i = 0; i < updates.size(); i += 4096) {
+        batched.apply_batch(std::vector<BatchUpdate<int, int> >(updates.begin() + i,
+                            updates.begin() + std::min(updates.size(), i + 4096)));
+    }
+    double batchedSeconds = secondsSince(start);
+    cout << "  " << keys << " inserts: one at a time " << singleSeconds * 1e3 << " ms, batches of 4096 "
+         << batchedSeconds * 1e3 << " ms" << endl;
+}
+
+/**
+* Sums the values of a random AVLTree with an iterator loop and with
+* parallel_reduce on 1 to 8 threads, and checks that the sums agree.
+* Argument: number of keys (default 1000000).
+*/
+static void benchScan(int argc, char* argv[])
+{
+    size_t keys = (argc > 0) ? strtoul(argv[0], NULL, 10) : 1000000;
+    const int rounds = 5;
+
+    AVLTree<int, int> tree;
+    BenchRng rng(500);
+    for (size_t i = 0; i < keys; ++i) {
+        int key = (int)(rng.next() % (keys * 4));
+        tree.insert(std::make_pair(key, (int)(i % 1000)));
+    }
+
+    long long expected = 0;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        expected = 0;
+        for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            expected += it->second;
+        }
+    }
+    double iterateSeconds = secondsSince(start) / rounds;
+
+    cout << "scan: sum over " << keys << " keys, " << std::thread::hardware_concurrency()
+         << " hardware threads" << endl;
+    cout << "  iterator loop     : " << iterateSeconds * 1e3 << " ms" << endl;
+    for (unsigned threads = 1; threads <= 8; threads *= 2) {
+        long long sum = 0;
+        start = Clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            sum = parallel_reduce(tree, 0LL,
+                [](long long acc, const std::pair<const int, int>& item) { return acc + item.second; },
+                [](long long a, long long b) { return a + b; }, threads);
+        }
+        double reduceSeconds = secondsSince(start) / rounds;
+        cout << "  parallel_reduce " << threads << " : " << reduceSeconds * 1e3 << " ms"
+             << (sum == expected ? "" : " (MISMATCH)") << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    string which = (argc > 1) ? argv[1] : "all";
+    int restc = (argc > 2) ? argc - 2 : 0;
+    char** restv = argv + 2;
+
+    if (which == "all" || which == "ingest") {
+        benchIngest(which == "ingest" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "wal") {
+        benchWal(which == "wal" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "rb") {
+        benchRedBlack(which == "rb" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "splay") {
+        benchSplay(which == "splay" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "treap") {
+        benchTreap(which == "treap" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "relaxed") {
+        benchRelaxed(which == "relaxed" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "scapegoat") {
+        benchScapegoat(which == "scapegoat" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "rebalance") {
+        benchRebalance(which == "rebalance" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "reduce") {
+        benchReduce(which == "reduce" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "interval") {
+        benchInterval(which == "interval" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "multimap") {
+        benchMultimap(which == "multimap" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "set") {
+        benchSet(which == "set" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "string") {
+        benchStringKey(which == "string" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "cache") {
+        benchCache(which == "cache" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "queue") {
+        benchQueue(which == "queue" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "erase") {
+        benchErase(which == "erase" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "batch") {
+        benchBatch(which == "batch" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "buffered") {
+        benchBuffered(which == "buffered" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "lazy") {
+        benchLazy(which == "lazy" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "persistent") {
+        benchPersistent(which == "persistent" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "concurrent") {
+        benchConcurrent(which == "concurrent" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "skiplist") {
+        benchSkipList(which == "skiplist" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "sharded") {
+        benchSharded(which == "sharded" ? restc : 0, restv);
+    }
+    if (which == "all" || which == "scan") {
+        benchScan(which == "scan" ? restc : 0, restv);
+    }
+    return 0;
+}
@@ -1,7 +1,25 @@
 #include <iostream>
 #include <map>
+#include <vector>
 #include "bst.h"
 #include "avlbst.h"
+#include "parallelscan.h"
+#include "mmapbst.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "treap.h"
+#include "scapegoat.h"
+#include "augavl.h"
+#include "intervaltree.h"
+#include "avlset.h"
+#include "stringkey.h"
+#include "expiringcache.h"
+#include "bufferedavl.h"
+#include "lazyavl.h"
+#include "persistentavl.h"
+#include "concurrentavl.h"
+#include "skiplist.h"
+#include "shardedtree.h"
 
 using namespace std;
 
@@ -44,5 +62,583 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    // lower_bound / upper_bound
+    at.insert(std::make_pair('c',3));
+    at.insert(std::make_pair('e',5));
+    cout << "\nlower_bound('b'): " << at.lower_bound('b')->first << endl;
+    cout << "upper_bound('c'): " << at.upper_bound('c')->first << endl;
+
+    // Memory-mapped tree written from the AVL tree
+    writeMmapTree(at, "bst-test.idx");
+    {
+        MmapTree<char,int> mt("bst-test.idx");
+        cout << "\nMmapTree contents:" << endl;
+        for(MmapTree<char,int>::iterator it = mt.begin(); it != mt.end(); ++it) {
+            cout << it->first << " " << it->second << endl;
+        }
+        cout << "mt['e'] = " << mt['e'] << endl;
+    }
+    std::remove("bst-test.idx");
+
+    // Bulk load of a sorted run
+    std::vector<std::pair<int,int> > run;
+    for(int i = 0; i < 100; i++) {
+        run.push_back(std::make_pair(i, i * i));
+    }
+    AVLTree<int,int> bulk;
+    bulk.insertSorted(run.begin(), run.end());
+    cout << "\nBulk loaded tree is " << (bulk.isBalanced() ? "balanced" : "NOT balanced")
+         << ", bulk[9] = " << bulk[9] << endl;
+
+    // Red-Black Tree tests
+    RBTree<int,int> rt;
+    for(int i = 0; i < 100; i++) {
+        rt.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 100; i += 3) {
+        rt.remove(i);
+    }
+    cout << "\nRBTree after removals: first key " << rt.begin()->first
+         << (rt.find(3) == rt.end() ? ", 3 erased" : ", 3 still present") << endl;
+
+    // Splay Tree tests
+    SplayTree<int,int> st;
+    for(int i = 0; i < 100; i++) {
+        st.insert(std::make_pair(i, i));
+    }
+    st.remove(50);
+    cout << "\nSplayTree find(42): " << st.find(42)->second
+         << (st.find(50) == st.end() ? ", 50 erased" : ", 50 still present") << endl;
+
+    // Treap split/merge tests
+    Treap<int,int> low;
+    Treap<int,int> high;
+    for(int i = 0; i < 100; i++) {
+        low.insert(std::make_pair(i, i));
+    }
+    low.split(60, high);
+    cout << "\nTreap split at 60: high starts at " << high.begin()->first;
+    low.removeRange(10, 50);
+    low.merge(high);
+    cout << ", after removeRange(10,50) and merge 10 is "
+         << (low.find(10) == low.end() ? "gone" : "present") << " and 99 is "
+         << (low.find(99) == low.end() ? "gone" : "present") << endl;
+
+    // Relaxed AVL: fixups deferred until settle()
+    AVLTree<int,int> lazy;
+    lazy.setRelaxed(true);
+    for(int i = 0; i < 50; i++) {
+        lazy.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 50; i += 2) {
+        lazy.remove(i);
+    }
+    lazy.settle();
+    cout << "\nRelaxed AVLTree after settle is " << (lazy.isBalanced() ? "balanced" : "NOT balanced")
+         << ", lazy[7] = " << lazy[7] << endl;
+
+    // Scapegoat Tree tests
+    ScapegoatTree<int,int> goat;
+    for(int i = 0; i < 1000; i++) {
+        goat.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 1000; i += 2) {
+        goat.remove(i);
+    }
+    cout << "\nScapegoatTree size " << goat.size() << " is "
+         << (goat.isBalanced() ? "balanced" : "not height balanced")
+         << ", goat[501] = " << goat[501] << endl;
+    BinarySearchTree<int,int>& goatBase = goat;
+    goatBase.clear();
+    if(goat.size() != 0) {
+        cerr << "ScapegoatTree: clear() through the base left size " << goat.size() << endl;
+        return 1;
+    }
+
+    // DSW rebalance of a degenerate tree
+    BinarySearchTree<int,int> chain;
+    for(int i = 0; i < 1000; i++) {
+        chain.insert(std::make_pair(i, i));
+    }
+    cout << "\nSorted BST is " << (chain.isBalanced() ? "balanced" : "not balanced");
+    chain.rebalance();
+    cout << ", after rebalance() it is " << (chain.isBalanced() ? "balanced" : "NOT balanced")
+         << " and chain[999] = " << chain[999] << endl;
+
+    // Range aggregates
+    AugmentedAVLTree<int,int,SumMonoid<int> > sums;
+    AugmentedAVLTree<int,int,MaxMonoid<int> > maxes;
+    for(int i = 1; i <= 100; i++) {
+        sums.insert(std::make_pair(i, i));
+        maxes.insert(std::make_pair(i, (i * 37) % 101));
+    }
+    sums.remove(50);
+    cout << "\nSum of [1, 101) without 50: " << sums.reduce(1, 101)
+         << ", max over [10, 20): " << maxes.reduce(10, 20) << endl;
+
+    // Interval Tree tests
+    IntervalTree<int,char> meetings;
+    meetings.insertInterval(9, 10, 'a');
+    meetings.insertInterval(11, 13, 'b');
+    meetings.insertInterval(12, 15, 'c');
+    meetings.insertInterval(16, 17, 'd');
+    cout << "\nIntervals at 12:";
+    std::vector<std::pair<Interval<int>, char> > at12 = meetings.stab(12);
+    for(size_t i = 0; i < at12.size(); i++) {
+        cout << " " << at12[i].first << "=" << at12[i].second;
+    }
+    cout << ", overlapping [14, 16]: " << meetings.overlaps(14, 16).size() << endl;
+
+    // Multimap mode
+    AVLTree<char,int> events;
+    events.setMultimap(true);
+    events.insert(std::make_pair('x', 1));
+    events.insert(std::make_pair('y', 2));
+    events.insert(std::make_pair('x', 3));
+    events.insert(std::make_pair('x', 4));
+    cout << "\nMultimap count('x') = " << events.count('x') << ", values:";
+    for(AVLTree<char,int>::iterator it = events.equal_range('x').first; it != events.equal_range('x').second; ++it) {
+        cout << " " << it->second;
+    }
+    events.remove('x');
+    cout << ", after remove('x') first is " << events['x'];
+    cout << ", removeAll('x') dropped " << events.removeAll('x') << endl;
+
+    // AVLSet tests
+    AVLSet<int> primes;
+    for(int i = 2; i < 30; i++) {
+        primes.insert(i);
+    }
+    for(int i = 2; i < 30; i++) {
+        for(int j = i * 2; j < 30; j += i) {
+            primes.remove(j);
+        }
+    }
+    cout << "\nAVLSet primes below 30:";
+    for(AVLSet<int>::iterator it = primes.begin(); it != primes.end(); ++it) {
+        cout << " " << *it;
+    }
+    cout << (primes.isBalanced() ? " (balanced)" : " (NOT balanced)") << endl;
+
+    // StringKey tests
+    StringArena arena;
+    StringAVLTree<int> words;
+    const char* wordList[] = { "interval", "intern", "internationalization", "internal", "in", "" };
+    for(int i = 0; i < 6; i++) {
+        words.insert(std::make_pair(arena.key(wordList[i], strlen(wordList[i])), i));
+    }
+    cout << "\nStringAVLTree in order:";
+    for(StringAVLTree<int>::iterator it = words.begin(); it != words.end(); ++it) {
+        cout << " \"" << it->first << "\"";
+    }
+    cout << ", find(\"internal\") = " << words[StringKey(std::string("internal"))] << endl;
+
+    // ExpiringCache tests
+    ExpiringCache<char,int> cache(2);
+    cache.put('a', 1, 0, 10);
+    cache.put('b', 2, 0, 5);
+    cache.get('a', 3);
+    cache.put('c', 3, 4, 10);
+    cout << "\nCache at t=4 (budget 2): a " << (cache.peek('a', 4) ? "hit" : "miss")
+         << ", b " << (cache.peek('b', 4) ? "hit" : "miss");
+    cout << "; evicted at t=20: " << cache.evictExpired(20, 10) << ", left " << cache.size() << endl;
+
+    // Priority queue operations
+    AVLTree<int,char> jobs;
+    jobs.insert(std::make_pair(30, 'c'));
+    jobs.insert(std::make_pair(10, 'a'));
+    jobs.insert(std::make_pair(40, 'd'));
+    jobs.insert(std::make_pair(20, 'b'));
+    cout << "\nQueue front " << jobs.front().second << ", back " << jobs.back().second << ", pops:";
+    cout << " " << jobs.pop_min().second << " " << jobs.pop_max().second;
+    cout << ", now front " << jobs.front().second << ", back " << jobs.back().second << endl;
+
+    // Erase by iterator
+    RBTree<int,int> evens;
+    for(int i = 0; i < 20; i++) {
+        evens.insert(std::make_pair(i, i));
+    }
+    for(RBTree<int,int>::iterator it = evens.begin(); it != evens.end(); ) {
+        it = (it->first % 2 == 1) ? evens.erase(it) : ++it;
+    }
+    evens.erase(evens.lower_bound(6), evens.lower_bound(14));
+    cout << "\nRBTree after erasing odds and [6, 14):";
+    for(RBTree<int,int>::iterator it = evens.begin(); it != evens.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    // Batched updates
+    AVLTree<int,char> batched;
+    std::vector<BatchUpdate<int,char> > updates;
+    for(int i = 0; i < 10; i++) {
+        updates.push_back(BatchUpdate<int,char>(i, (char)('a' + i)));
+    }
+    batched.apply_batch(updates);
+    updates.clear();
+    updates.push_back(BatchUpdate<int,char>(2));
+    updates.push_back(BatchUpdate<int,char>(4, 'E'));
+    updates.push_back(BatchUpdate<int,char>(7));
+    updates.push_back(BatchUpdate<int,char>(12, 'm'));
+    batched.apply_batch(updates);
+    cout << "\nAVLTree after two batches:";
+    for(AVLTree<int,char>::iterator it = batched.begin(); it != batched.end(); ++it) {
+        cout << " " << it->first << it->second;
+    }
+    cout << (batched.isBalanced() ? " (balanced)" : " (NOT balanced)") << endl;
+
+    // Parallel batch merge against std::map, on a tree whose pull hook keeps
+    // subtree sums; any mismatch fails the run
+    AugmentedAVLTree<int,int,SumMonoid<int> > batchSums;
+    std::map<int,int> batchExpected;
+    for(int i = 0; i < 60000; i += 2) {
+        batchSums.insert(std::make_pair(i, 1));
+        batchExpected[i] = 1;
+    }
+    std::vector<BatchUpdate<int,int> > bigBatch;
+    for(int i = 0; i < 60000; i++) {
+        if(i % 6 == 0) {
+            bigBatch.push_back(BatchUpdate<int,int>(i));
+            batchExpected.erase(i);
+        } else if(i % 3 != 2) {
+            bigBatch.push_back(BatchUpdate<int,int>(i, 2));
+            batchExpected[i] = 2;
+        }
+    }
+    batchSums.apply_batch(bigBatch, 4);
+    std::vector<std::pair<int,int> > batchItems;
+    int batchTotal = 0;
+    for(AugmentedAVLTree<int,int,SumMonoid<int> >::iterator it = batchSums.begin(); it != batchSums.end(); ++it) {
+        batchItems.push_back(*it);
+        batchTotal += it->second;
+    }
+    if(!batchSums.isBalanced() || batchSums.aggregate() != batchTotal ||
+       batchItems != std::vector<std::pair<int,int> >(batchExpected.begin(), batchExpected.end())) {
+        cerr << "apply_batch with 4 threads: mismatch against std::map" << endl;
+        return 1;
+    }
+
+    // Buffered writes
+    BufferedAVLTree<int,char> buffered(5);
+    for(int i = 0; i < 6; i++) {
+        buffered.insert(std::make_pair(i, (char)('a' + i)));
+    }
+    buffered.remove(1);
+    buffered.insert(std::make_pair(3, 'D'));
+    cout << "\nBufferedAVLTree with " << buffered.buffered() << " writes buffered:";
+    for(BufferedAVLTree<int,char>::iterator it = buffered.begin(); it != buffered.end(); ++it) {
+        cout << " " << it->first << it->second;
+    }
+    buffered.flush();
+    cout << ", after flush the tree holds";
+    for(AVLTree<int,char>::iterator it = buffered.tree().begin(); it != buffered.tree().end(); ++it) {
+        cout << " " << it->first << it->second;
+    }
+    cout << endl;
+
+    // Lazy deletion
+    LazyAVLTree<int,int> tomb(0.5);
+    for(int i = 1; i <= 8; i++) {
+        tomb.insert(std::make_pair(i, i * i));
+    }
+    tomb.remove(2);
+    tomb.remove(5);
+    tomb.remove(6);
+    tomb.insert(std::make_pair(5, -5));
+    cout << "\nLazyAVLTree with " << tomb.tombstones() << " tombstones:";
+    for(LazyAVLTree<int,int>::iterator it = tomb.begin(); it != tomb.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    tomb.remove(1);
+    tomb.remove(3);
+    tomb.remove(4);
+    cout << ", after three more removes " << tomb.size() << " live, " << tomb.tombstones() << " tombstones"
+         << (tomb.isBalanced() ? " (balanced)" : " (NOT balanced)") << endl;
+
+    // Persistent snapshots
+    PersistentAVLTree<int,char> current;
+    for(int i = 0; i < 5; i++) {
+        current.insert(std::make_pair(i, (char)('a' + i)));
+    }
+    PersistentAVLTree<int,char> before = current.snapshot();
+    current.remove(1);
+    current.insert(std::make_pair(3, 'D'));
+    current.insert(std::make_pair(7, 'h'));
+    cout << "\nPersistentAVLTree now:";
+    for(PersistentAVLTree<int,char>::iterator it = current.begin(); it != current.end(); ++it) {
+        cout << " " << it->first << it->second;
+    }
+    cout << "; snapshot:";
+    for(PersistentAVLTree<int,char>::iterator it = before.begin(); it != before.end(); ++it) {
+        cout << " " << it->first << it->second;
+    }
+    cout << endl;
+
+    // Concurrent readers
+    ConcurrentAVLTree<int,int> shared;
+    std::thread writer([&shared]() {
+        for(int i = 0; i < 1000; i++) {
+            shared.insert(std::make_pair(i, i * 2));
+        }
+        for(int i = 0; i < 1000; i += 2) {
+            shared.remove(i);
+        }
+    });
+    int misses = 0;
+    for(int i = 0; i < 1000; i++) {
+        int value;
+        if(shared.lookup(i, value) && value != i * 2) {
+            misses++;
+        }
+    }
+    writer.join();
+    cout << "\nConcurrentAVLTree: " << shared.size() << " keys, " << misses << " bad reads, get(7) = "
+         << shared.get(7) << (shared.isBalanced() ? " (balanced)" : " (NOT balanced)") << endl;
+
+    // ConcurrentAVLTree against std::map: a fixed pseudo-random sequence on
+    // one thread, then writers on disjoint keys racing readers; any mismatch
+    // fails the run
+    ConcurrentAVLTree<int,int> checked;
+    std::map<int,int> expected;
+    bool concurrentOk = true;
+    unsigned seed = 12345;
+    for(int i = 0; i < 20000; i++) {
+        seed = seed * 1103515245 + 12345;
+        int key = (seed >> 8) % 2000;
+        if((seed >> 4) % 3 == 0) {
+            bool present = expected.erase(key) > 0;
+            concurrentOk = concurrentOk && checked.remove(key) == present;
+        } else {
+            checked.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+    }
+    std::vector<std::pair<int,int> > items = checked.items();
+    concurrentOk = concurrentOk && items == std::vector<std::pair<int,int> >(expected.begin(), expected.end());
+    checked.clear();
+    expected.clear();
+    std::atomic<int> badReads(0);
+    std::vector<std::thread> checkers;
+    for(int t = 0; t < 4; t++) {
+        checkers.push_back(std::thread([&checked, t]() {
+            for(int i = t; i < 4000; i += 4) {
+                checked.insert(std::make_pair(i, i * 3));
+            }
+            for(int i = t; i < 4000; i += 8) {
+                checked.remove(i);
+            }
+        }));
+    }
+    for(int t = 0; t < 2; t++) {
+        checkers.push_back(std::thread([&checked, &badReads]() {
+            for(int i = 0; i < 4000; i++) {
+                int value;
+                if(checked.lookup(i, value) && value != i * 3) {
+                    badReads++;
+                }
+            }
+        }));
+    }
+    for(size_t t = 0; t < checkers.size(); t++) {
+        checkers[t].join();
+    }
+    for(int i = 0; i < 4000; i++) {
+        if(i % 8 >= 4) {
+            expected[i] = i * 3;
+        }
+    }
+    items = checked.items();
+    concurrentOk = concurrentOk && badReads == 0 && checked.isBalanced() && checked.size() == expected.size() &&
+                   items == std::vector<std::pair<int,int> >(expected.begin(), expected.end());
+    if(!concurrentOk) {
+        cerr << "ConcurrentAVLTree: mismatch against std::map" << endl;
+        return 1;
+    }
+
+    // Lock-free skip list
+    LockFreeSkipList<int,int> skip;
+    std::vector<std::thread> skipWriters;
+    for(int t = 0; t < 4; t++) {
+        skipWriters.push_back(std::thread([&skip, t]() {
+            for(int i = t; i < 40; i += 4) {
+                skip.insert(std::make_pair(i, i * i));
+            }
+            for(int i = t; i < 40; i += 8) {
+                skip.remove(i);
+            }
+        }));
+    }
+    for(size_t t = 0; t < skipWriters.size(); t++) {
+        skipWriters[t].join();
+    }
+    cout << "\nLockFreeSkipList: " << skip.size() << " keys, from 10:";
+    int shown = 0;
+    for(LockFreeSkipList<int,int>::iterator it = skip.lower_bound(10); it != skip.end() && shown < 5; ++it, ++shown) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+
+    // LockFreeSkipList against std::map: a fixed pseudo-random sequence on
+    // one thread, then writers on disjoint keys racing ordered scans; any
+    // mismatch fails the run
+    LockFreeSkipList<int,int> skipChecked;
+    std::map<int,int> skipExpected;
+    bool skipOk = true;
+    unsigned skipSeed = 54321;
+    for(int i = 0; i < 20000; i++) {
+        skipSeed = skipSeed * 1103515245 + 12345;
+        int key = (skipSeed >> 8) % 2000;
+        if((skipSeed >> 4) % 3 == 0) {
+            bool present = skipExpected.erase(key) > 0;
+            skipOk = skipOk && skipChecked.remove(key) == present;
+        } else {
+            skipChecked.insert(std::make_pair(key, i));
+            skipExpected[key] = i;
+        }
+    }
+    std::vector<std::pair<int,int> > skipItems;
+    for(LockFreeSkipList<int,int>::iterator it = skipChecked.begin(); it != skipChecked.end(); ++it) {
+        skipItems.push_back(*it);
+    }
+    skipOk = skipOk && skipItems == std::vector<std::pair<int,int> >(skipExpected.begin(), skipExpected.end());
+
+    LockFreeSkipList<int,int> skipRaced;
+    std::atomic<int> skipBad(0);
+    std::vector<std::thread> skipThreads;
+    for(int t = 0; t < 4; t++) {
+        skipThreads.push_back(std::thread([&skipRaced, t]() {
+            for(int i = t; i < 4000; i += 4) {
+                skipRaced.insert(std::make_pair(i, i * 3));
+            }
+            for(int i = t; i < 4000; i += 8) {
+                skipRaced.remove(i);
+            }
+        }));
+    }
+    for(int t = 0; t < 2; t++) {
+        skipThreads.push_back(std::thread([&skipRaced, &skipBad]() {
+            for(int round = 0; round < 5; round++) {
+                int previous = -1;
+                for(LockFreeSkipList<int,int>::iterator it = skipRaced.begin(); it != skipRaced.end(); ++it) {
+                    if(it->first <= previous || it->second != it->first * 3) {
+                        skipBad++;
+                    }
+                    previous = it->first;
+                }
+            }
+        }));
+    }
+    for(size_t t = 0; t < skipThreads.size(); t++) {
+        skipThreads[t].join();
+    }
+    skipItems.clear();
+    for(LockFreeSkipList<int,int>::iterator it = skipRaced.begin(); it != skipRaced.end(); ++it) {
+        skipItems.push_back(*it);
+    }
+    skipExpected.clear();
+    for(int i = 0; i < 4000; i++) {
+        if(i % 8 >= 4) {
+            skipExpected[i] = i * 3;
+        }
+    }
+    skipOk = skipOk && skipBad == 0 && skipRaced.size() == skipExpected.size() &&
+             skipItems == std::vector<std::pair<int,int> >(skipExpected.begin(), skipExpected.end());
+    if(!skipOk) {
+        cerr << "LockFreeSkipList: mismatch against std::map" << endl;
+        return 1;
+    }
+
+    // Range-sharded map
+    ShardedTree<int,int> sharded(8);
+    std::vector<std::thread> shardWriters;
+    for(int t = 0; t < 4; t++) {
+        shardWriters.push_back(std::thread([&sharded, t]() {
+            for(int i = t; i < 64; i += 4) {
+                sharded.insert(std::make_pair(i, i + 100));
+            }
+        }));
+    }
+    for(size_t t = 0; t < shardWriters.size(); t++) {
+        shardWriters[t].join();
+    }
+    std::vector<BatchUpdate<int,int> > shardBatch;
+    for(int i = 0; i < 64; i += 3) {
+        shardBatch.push_back(BatchUpdate<int,int>(i));
+    }
+    sharded.apply_batch(shardBatch);
+    cout << "\nShardedTree: " << sharded.size() << " keys in " << sharded.shards() << " shards, first:";
+    int listed = 0;
+    for(ShardedTree<int,int>::iterator it = sharded.begin(); it != sharded.end() && listed < 5; ++it, ++listed) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << (sharded.isBalanced() ? " (balanced)" : " (NOT balanced)") << endl;
+
+    // ShardedTree against std::map: writers on disjoint keys force splits
+    // and merges while readers iterate from begin(); any mismatch fails
+    // the run
+    ShardedTree<int,int> shardRaced(16);
+    std::atomic<int> shardBad(0);
+    std::vector<std::thread> shardThreads;
+    for(int t = 0; t < 4; t++) {
+        shardThreads.push_back(std::thread([&shardRaced, t]() {
+            for(int i = t; i < 4000; i += 4) {
+                shardRaced.insert(std::make_pair(i, i * 3));
+            }
+            for(int i = t; i < 4000; i += 8) {
+                shardRaced.remove(i);
+            }
+        }));
+    }
+    for(int t = 0; t < 2; t++) {
+        shardThreads.push_back(std::thread([&shardRaced, &shardBad]() {
+            for(int round = 0; round < 5; round++) {
+                int previous = -1;
+                for(ShardedTree<int,int>::iterator it = shardRaced.begin(); it != shardRaced.end(); ++it) {
+                    if(it->first <= previous || it->second != it->first * 3) {
+                        shardBad++;
+                    }
+                    previous = it->first;
+                }
+            }
+        }));
+    }
+    for(size_t t = 0; t < shardThreads.size(); t++) {
+        shardThreads[t].join();
+    }
+    std::vector<std::pair<int,int> > shardItems;
+    for(ShardedTree<int,int>::iterator it = shardRaced.begin(); it != shardRaced.end(); ++it) {
+        shardItems.push_back(*it);
+    }
+    std::map<int,int> shardExpected;
+    for(int i = 0; i < 4000; i++) {
+        if(i % 8 >= 4) {
+            shardExpected[i] = i * 3;
+        }
+    }
+    if(shardBad != 0 || shardRaced.size() != shardExpected.size() || !shardRaced.isBalanced() ||
+       shardItems != std::vector<std::pair<int,int> >(shardExpected.begin(), shardExpected.end())) {
+        cerr << "ShardedTree: mismatch against std::map" << endl;
+        return 1;
+    }
+
+    // Parallel scans
+    AVLTree<int,int> scanned;
+    for(int i = 1; i <= 20000; i++) {
+        scanned.insert(std::make_pair(i, i % 10));
+    }
+    std::atomic<int> nines(0);
+    parallel_for_each(scanned, [&nines](const std::pair<const int,int>& item) {
+        if(item.second == 9) {
+            nines++;
+        }
+    }, 4);
+    long long total = parallel_reduce(scanned, 0LL,
+        [](long long acc, const std::pair<const int,int>& item) { return acc + item.second; },
+        [](long long a, long long b) { return a + b; }, 4);
+    int lastKey = parallel_reduce(scanned, 0,
+        [](int, const std::pair<const int,int>& item) { return item.first; },
+        [](int a, int b) { return b != 0 ? b : a; }, 4);
+    cout << "\nParallel scan: " << nines << " nines, sum " << total << ", last key " << lastKey << endl;
+
     return 0;
 }
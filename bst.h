@@ -3,8 +3,10 @@
 
 #include <iostream>
 #include <exception>
+#include <stdexcept>
 #include <cstdlib>
 #include <utility>
+#include <algorithm>
 
 /**
  * A templated class for a Node in a search tree.
@@ -197,11 +199,20 @@ public:
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
-    void clear(); //TODO
+    virtual void clear(); //TODO
     bool isBalanced() const; //TODO
+    virtual void rebalance();
+    void setRebalanceDepth(int depth);
+    virtual void setMultimap(bool multimap);
+    bool isMultimap() const;
+    size_t removeAll(const Key& key);
     void print() const;
     bool empty() const;
 
+    // parallel_for_each and parallel_reduce (parallelscan.h) start from root_
+    template<typename PSKey, typename PSValue>
+    friend class ParallelScan;
+
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
 public:
@@ -231,29 +242,41 @@ public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    size_t count(const Key& key) const;
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
-    Node<Key, Value> *getSmallestNode() const;  // TODO
+    virtual Node<Key, Value> *getSmallestNode() const;  // TODO
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
+    static Node<Key, Value>* successor(Node<Key, Value>* current);
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
     // Provided helper functions
     virtual void printRoot (Node<Key, Value> *r) const;
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
+    virtual void eraseNode(Node<Key, Value>* removeNode);
 
     // Add helper functions here
     int height(Node<Key, Value>* r) const;
     bool subtreeBalanced(Node<Key, Value>* node) const;
     void clearHelper(Node<Key, Value>* node);
+    static Node<Key, Value>* treeToVine(Node<Key, Value>* node, size_t& count);
+    static Node<Key, Value>* vineToTree(Node<Key, Value>* head, size_t count);
+    static void compressVine(Node<Key, Value>*& head, size_t count);
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    int rebalanceDepth_;  // insert depth that triggers rebalance(), 0 = never
+    bool multimap_;       // duplicate keys become separate nodes
 };
 
 /*
@@ -376,6 +399,8 @@ BinarySearchTree<Key, Value>::BinarySearchTree()
 {
     // TODO
     root_ = nullptr;
+    rebalanceDepth_ = 0;
+    multimap_ = false;
 }
 
 template<typename Key, typename Value>
@@ -436,6 +461,106 @@ BinarySearchTree<Key, Value>::find(const Key & k) const
     return it;
 }
 
+/**
+* Returns an iterator to the first item whose key is not less than k,
+* or the end iterator if every key is less than k
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::lower_bound(const Key & k) const
+{
+    Node<Key, Value>* currentNode = root_;
+    Node<Key, Value>* candidate = nullptr;
+
+    while (currentNode != nullptr) {
+        if (currentNode->getKey() < k) { //Everything in the left subtree is also too small
+            currentNode = currentNode->getRight();
+        } else { //Possible answer, but a smaller one may exist on the left
+            candidate = currentNode;
+            currentNode = currentNode->getLeft();
+        }
+    }
+    return iterator(candidate);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than k,
+* or the end iterator if no such key exists
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::upper_bound(const Key & k) const
+{
+    Node<Key, Value>* currentNode = root_;
+    Node<Key, Value>* candidate = nullptr;
+
+    while (currentNode != nullptr) {
+        if (k < currentNode->getKey()) {
+            candidate = currentNode;
+            currentNode = currentNode->getLeft();
+        } else {
+            currentNode = currentNode->getRight();
+        }
+    }
+    return iterator(candidate);
+}
+
+/**
+* Returns the range of items whose key equals k: [lower_bound(k), upper_bound(k)).
+* In multimap mode the duplicates come out in insertion order.
+*/
+template<class Key, class Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, typename BinarySearchTree<Key, Value>::iterator>
+BinarySearchTree<Key, Value>::equal_range(const Key & k) const
+{
+    return std::make_pair(lower_bound(k), upper_bound(k));
+}
+
+/**
+* Returns the number of items whose key equals k, in O(log n + count).
+*/
+template<class Key, class Value>
+size_t BinarySearchTree<Key, Value>::count(const Key & k) const
+{
+    size_t total = 0;
+    for (iterator it = internalFind(k); it != end() && !(k < it->first); ++it) {
+        total++;
+    }
+    return total;
+}
+
+/**
+* Removes the item at pos without searching for its key and returns an
+* iterator to the item after it. Other iterators stay valid. Throws
+* std::out_of_range for end().
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator pos)
+{
+    if (pos.current_ == nullptr) {
+        throw std::out_of_range("Invalid iterator");
+    }
+    Node<Key, Value>* next = successor(pos.current_);
+    eraseNode(pos.current_);
+    return iterator(next);
+}
+
+/**
+* Removes the items in [first, last) and returns last. The range is walked
+* with successor links, so the cost is O(k) plus each removal's rebalancing,
+* with no per-key descent.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator first, iterator last)
+{
+    while (first != last) {
+        first = erase(first);
+    }
+    return last;
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
@@ -474,13 +599,15 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
     
     Node<Key, Value>* currentNode = root_;
     Node<Key, Value>* parentNode = nullptr;
+    int depth = 0;
 
     //Iterate through tree until reaching the end
     while (currentNode != nullptr) {
+        depth++;
         if (keyValuePair.first < currentNode->getKey()) { //Move to left subtree
             parentNode = currentNode;
             currentNode = currentNode->getLeft();
-        } else if (keyValuePair.first > currentNode->getKey()) { //Move to right subtree
+        } else if (keyValuePair.first > currentNode->getKey() || multimap_) { //Move to right subtree (duplicates go after their equals)
             parentNode = currentNode;
             currentNode = currentNode->getRight();
         } else { //currentNode->getKey() == keyValuePair.first
@@ -496,7 +623,10 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
         parentNode->setRight(newNode);
     }
 
-
+    //Sorted feeds degrade the tree into a list; restructure once it gets too deep
+    if (rebalanceDepth_ > 0 && depth > rebalanceDepth_) {
+        rebalance();
+    }
 }
 
 
@@ -515,7 +645,17 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
     if (removeNode == nullptr) {
         return;
     }
+    eraseNode(removeNode);
+}
 
+/*
+ * Removes a node that is known to be in the tree, with no search. Each tree
+ * overrides this with its own removal. Every implementation moves nodes
+ * rather than their contents, so pointers to the other nodes stay valid.
+ */
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::eraseNode(Node<Key, Value>* removeNode)
+{
     if (removeNode->getLeft() != nullptr && removeNode->getRight() != nullptr) {
         Node<Key, Value>* predNode = predecessor(removeNode); //Find predecessor
         nodeSwap(predNode, removeNode); //Swap predecessor
@@ -597,6 +737,30 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
     }
 }
 
+//In-order successor, the mirror of predecessor
+template<class Key, class Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+{
+    if (current == nullptr) {
+        return nullptr;
+    }
+
+    if (current->getRight() != nullptr) { //Leftmost child of the right subtree
+        Node<Key, Value>* succ = current->getRight();
+        while (succ->getLeft() != nullptr) {
+            succ = succ->getLeft();
+        }
+        return succ;
+    }
+    Node<Key, Value>* parent = current->getParent();
+    while (parent != nullptr && current == parent->getRight()) {
+        current = parent;
+        parent = parent->getParent();
+    }
+    return parent;
+}
+
 
 /**
 * A method to remove all contents of the tree and
@@ -609,15 +773,182 @@ void BinarySearchTree<Key, Value>::clear()
     root_ = nullptr;
 }
 
+/*
+ * Deletes the subtree without recursion, so a degenerate tree cannot
+ * overflow the stack: left children are rotated up until the top node has
+ * none, and then it is deleted and its right child becomes the top.
+ */
 template<class Key, class Value>
 void BinarySearchTree<Key, Value>::clearHelper(Node<Key, Value>* node)
 {
-    if (node == nullptr) {
-        return;
+    while (node != nullptr) {
+        Node<Key, Value>* left = node->getLeft();
+        if (left != nullptr) {
+            node->setLeft(left->getRight());
+            left->setRight(node);
+            node = left;
+        } else {
+            Node<Key, Value>* right = node->getRight();
+            delete node;
+            node = right;
+        }
+    }
+}
+
+/**
+* Restructures the existing nodes into a perfectly balanced tree (every level
+* full except possibly the last) using the Day-Stout-Warren algorithm: O(n)
+* time, O(1) extra space and no allocations.
+*
+* Trees that keep balance metadata override this so their invariants hold.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebalance()
+{
+    size_t count = 0;
+    Node<Key, Value>* head = treeToVine(root_, count);
+    root_ = vineToTree(head, count);
+    if (root_ != nullptr) {
+        root_->setParent(nullptr);
+    }
+}
+
+/**
+* Switches multimap mode, where inserting an existing key adds another node
+* after the existing ones instead of overwriting the value. find(), operator[]
+* and remove() then work on the oldest item with the key; equal_range(),
+* count() and removeAll() cover all of them. Only allowed while the tree is
+* empty, since turning it off would leave duplicates behind.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setMultimap(bool multimap)
+{
+    if (multimap != multimap_ && root_ != nullptr) {
+        throw std::logic_error("multimap mode can only be changed on an empty tree");
+    }
+    multimap_ = multimap;
+}
+
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::isMultimap() const
+{
+    return multimap_;
+}
+
+/**
+* Removes every item with the given key and returns how many there were.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::removeAll(const Key& key)
+{
+    size_t removed = 0;
+    while (internalFind(key) != nullptr) {
+        remove(key);
+        removed++;
+    }
+    return removed;
+}
+
+/**
+* Makes insert() call rebalance() whenever a new node lands deeper than
+* depth. 0 (the default) turns this off. Only BinarySearchTree::insert
+* checks it; the self-balancing trees never get that deep.
+*
+* Each rebalance is O(n), and a sorted feed reaches the threshold again
+* after about depth - log2(n) inserts, so pick a depth well above log2(n).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setRebalanceDepth(int depth)
+{
+    rebalanceDepth_ = depth;
+}
+
+/*
+ * Helper that turns the subtree at node into a vine (a sorted list linked
+ * through the right pointers) with right rotations, counting its nodes.
+ * Returns the smallest node. Parent links are left stale; vineToTree
+ * rewrites all of them.
+ */
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::treeToVine(Node<Key, Value>* node, size_t& count)
+{
+    Node<Key, Value>* head = nullptr;
+    Node<Key, Value>* tail = nullptr;
+    Node<Key, Value>* rest = node;
+
+    count = 0;
+    while (rest != nullptr) {
+        Node<Key, Value>* left = rest->getLeft();
+        if (left != nullptr) { //Rotate right so left moves up onto the vine
+            rest->setLeft(left->getRight());
+            left->setRight(rest);
+            rest = left;
+            if (tail != nullptr) {
+                tail->setRight(rest);
+            }
+        } else {
+            if (head == nullptr) {
+                head = rest;
+            }
+            tail = rest;
+            rest = rest->getRight();
+            count++;
+        }
+    }
+    return head;
+}
+
+/*
+ * Helper that folds a vine of count nodes into a balanced subtree and
+ * returns its top, whose parent the caller must set. The first pass only
+ * compresses the nodes that do not fit in a perfect tree, so those end up
+ * as the partial bottom level; each following pass halves the spine.
+ */
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::vineToTree(Node<Key, Value>* head, size_t count)
+{
+    Node<Key, Value>* previous = nullptr;
+    for (Node<Key, Value>* node = head; node != nullptr; node = node->getRight()) {
+        node->setParent(previous);
+        previous = node;
+    }
+
+    size_t perfect = 1; //Largest 2^k - 1 <= count
+    while (perfect * 2 + 1 <= count) {
+        perfect = perfect * 2 + 1;
+    }
+    if (count > 0) {
+        compressVine(head, count - perfect);
+    }
+    while (perfect > 1) {
+        perfect /= 2;
+        compressVine(head, perfect);
+    }
+    return head;
+}
+
+//Helper that left rotates every other node of the spine, count times
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::compressVine(Node<Key, Value>*& head, size_t count)
+{
+    Node<Key, Value>* scanner = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+        Node<Key, Value>* child = (scanner == nullptr) ? head : scanner->getRight();
+        Node<Key, Value>* grand = child->getRight();
+        if (scanner == nullptr) {
+            head = grand;
+        } else {
+            scanner->setRight(grand);
+        }
+        grand->setParent(scanner);
+        child->setRight(grand->getLeft());
+        if (grand->getLeft() != nullptr) {
+            grand->getLeft()->setParent(child);
+        }
+        grand->setLeft(child);
+        child->setParent(grand);
+        scanner = grand;
     }
-    clearHelper(node->getLeft());
-    clearHelper(node->getRight());
-    delete node;
 }
 
 
@@ -653,11 +984,15 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
 {
     // TODO
     Node<Key, Value>* currentNode = root_;
-
+    Node<Key, Value>* found = nullptr;
 
     while (currentNode != nullptr) {
         if (key == currentNode->getKey()) {
-            return currentNode;
+            if (!multimap_) {
+                return currentNode;
+            }
+            found = currentNode; //Keep going left for the oldest duplicate
+            currentNode = currentNode->getLeft();
         } else if (key < currentNode->getKey()) { //If key is less then, then it must be in the left subtree
             currentNode = currentNode->getLeft();
         } else if (key > currentNode->getKey()) { //If key greater, then it must be in right subtree
@@ -665,7 +1000,7 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
         }
     }
     //If it gets here, then currentNode is a leaf node and not == to key
-    return nullptr;
+    return found;
 }
 
 //Helper function to get height
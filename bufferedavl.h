@@ -0,0 +1,354 @@
+#ifndef BUFFEREDAVL_H
+#define BUFFEREDAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <vector>
+#include "avlbst.h"
+#include "avlset.h"
+
+/**
+* An AVLTree behind a small write buffer. insert() and remove() only touch
+* the buffer: a tiny AVLTree of pending upserts and an AVLSet of pending
+* removes, which between them hold each key at most once. Once bufferLimit
+* writes have been absorbed, flush() hands them to the main tree as one
+* sorted AVLTree::apply_batch, so the big tree is descended once per batch
+* instead of once per write, and the writes that hit the buffer stay in
+* cache.
+*
+* Reads consult the buffer first, since it holds the newest state of its
+* keys, and fall back to the main tree: a lookup pays for two more small
+* searches. Iteration merges the main tree and the buffer on the fly and
+* skips main tree entries that are removed or overwritten by the buffer, so
+* it sees exactly what an unbuffered tree would. Iterators are invalidated
+* by any write, since a write can trigger a flush.
+*/
+template <class Key, class Value>
+class BufferedAVLTree
+{
+public:
+    explicit BufferedAVLTree(size_t bufferLimit = 16384);
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BufferedAVLTree<Key, Value>;
+        typedef typename AVLTree<Key, Value>::iterator TreeIterator;
+        typedef typename AVLSet<Key>::iterator SetIterator;
+
+        iterator(TreeIterator main, TreeIterator buffered, SetIterator removed);
+        void skipHidden();
+        bool onBuffered() const;
+
+        TreeIterator main_;
+        TreeIterator buffered_;
+        SetIterator removed_;    // first pending remove not before main_
+    };
+
+    void insert(const std::pair<const Key, Value>& new_item);
+    void remove(const Key& key);
+    void flush();
+    void clear();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+    bool empty() const;
+    size_t buffered() const;
+    const AVLTree<Key, Value>& tree() const;
+
+protected:
+    AVLTree<Key, Value> main_;
+    AVLTree<Key, Value> upserts_;
+    AVLSet<Key> removes_;
+    size_t bufferLimit_;
+    size_t pending_;       // writes absorbed since the last flush
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the BufferedAVLTree::iterator class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+BufferedAVLTree<Key, Value>::iterator::iterator() :
+    main_(), buffered_(), removed_()
+{
+
+}
+
+template<class Key, class Value>
+BufferedAVLTree<Key, Value>::iterator::iterator(TreeIterator main, TreeIterator buffered, SetIterator removed) :
+    main_(main), buffered_(buffered), removed_(removed)
+{
+    skipHidden();
+}
+
+/*
+ * Moves main_ past every entry the buffer removes or overwrites. removed_
+ * only moves forward, so a full iteration walks the pending removes once.
+ */
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::iterator::skipHidden()
+{
+    while (main_ != TreeIterator()) {
+        const Key& key = main_->first;
+        while (removed_ != SetIterator() && *removed_ < key) {
+            ++removed_;
+        }
+        //Keys only need operator<; removed_ is not before key by now
+        bool removed = (removed_ != SetIterator() && !(key < *removed_));
+        bool overwritten = (buffered_ != TreeIterator() && !(key < buffered_->first) && !(buffered_->first < key));
+        if (!removed && !overwritten) {
+            return;
+        }
+        ++main_;
+    }
+}
+
+//True when the current entry comes from the buffer rather than the main tree
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::iterator::onBuffered() const
+{
+    if (buffered_ == TreeIterator()) {
+        return false;
+    }
+    return main_ == TreeIterator() || buffered_->first < main_->first;
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>&
+BufferedAVLTree<Key, Value>::iterator::operator*() const
+{
+    return onBuffered() ? *buffered_ : *main_;
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>*
+BufferedAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(this->operator*());
+}
+
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return main_ == rhs.main_ && buffered_ == rhs.buffered_;
+}
+
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator&
+BufferedAVLTree<Key, Value>::iterator::operator++()
+{
+    if (onBuffered()) {
+        ++buffered_;
+    } else {
+        ++main_;
+    }
+    skipHidden();
+    return *this;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the BufferedAVLTree::iterator class.
+  ---------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the BufferedAVLTree class.
+  ---------------------------------------------
+*/
+
+/**
+* bufferLimit is the number of writes absorbed between flushes; 0 flushes
+* after every write.
+*/
+template<class Key, class Value>
+BufferedAVLTree<Key, Value>::BufferedAVLTree(size_t bufferLimit) :
+    bufferLimit_(bufferLimit), pending_(0)
+{
+
+}
+
+/**
+* Inserts or overwrites key in the buffer, cancelling a pending remove of it.
+*/
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+    upserts_.insert(new_item);
+    removes_.remove(new_item.first);
+    if (++pending_ >= bufferLimit_) {
+        flush();
+    }
+}
+
+/**
+* Records a remove of key in the buffer, dropping a pending insert of it.
+* Removing a missing key is allowed and does nothing once flushed.
+*/
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::remove(const Key& key)
+{
+    upserts_.remove(key);
+    removes_.insert(key);
+    if (++pending_ >= bufferLimit_) {
+        flush();
+    }
+}
+
+/**
+* Merges the buffer into the main tree in one sorted batch and empties it.
+*/
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::flush()
+{
+    std::vector<BatchUpdate<Key, Value> > updates;
+    typename AVLTree<Key, Value>::iterator upsert = upserts_.begin();
+    typename AVLSet<Key>::iterator removed = removes_.begin();
+    //The two buffers never share a key, so this is a plain sorted merge
+    while (upsert != upserts_.end() || removed != removes_.end()) {
+        if (removed == removes_.end() || (upsert != upserts_.end() && upsert->first < *removed)) {
+            updates.push_back(BatchUpdate<Key, Value>(upsert->first, upsert->second));
+            ++upsert;
+        } else {
+            updates.push_back(BatchUpdate<Key, Value>(*removed));
+            ++removed;
+        }
+    }
+    main_.apply_batch(updates);
+    upserts_.clear();
+    removes_.clear();
+    pending_ = 0;
+}
+
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::clear()
+{
+    main_.clear();
+    upserts_.clear();
+    removes_.clear();
+    pending_ = 0;
+}
+
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator
+BufferedAVLTree<Key, Value>::begin() const
+{
+    return iterator(main_.begin(), upserts_.begin(), removes_.begin());
+}
+
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator
+BufferedAVLTree<Key, Value>::end() const
+{
+    return iterator();
+}
+
+/**
+* Iterator to the first visible entry with a key not less than key.
+*/
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator
+BufferedAVLTree<Key, Value>::lower_bound(const Key& key) const
+{
+    return iterator(main_.lower_bound(key), upserts_.lower_bound(key), removes_.lower_bound(key));
+}
+
+/**
+* Like operator[], asks the buffer first: a pending remove answers at once,
+* and the main tree is only searched when the buffer does not hold key. The
+* merged iterator is positioned only for a hit.
+*/
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator
+BufferedAVLTree<Key, Value>::find(const Key& key) const
+{
+    if (removes_.find(key) != removes_.end()) {
+        return end();
+    }
+    typename AVLTree<Key, Value>::iterator buffered = upserts_.find(key);
+    if (buffered != upserts_.end()) {
+        return iterator(main_.lower_bound(key), buffered, removes_.lower_bound(key));
+    }
+    typename AVLTree<Key, Value>::iterator found = main_.find(key);
+    if (found == main_.end()) {
+        return end();
+    }
+    return iterator(found, upserts_.lower_bound(key), removes_.lower_bound(key));
+}
+
+/**
+* Point lookup that stops at the buffer when it knows the answer, and only
+* searches the main tree otherwise. Throws std::out_of_range if key is
+* missing or removed.
+*/
+template<class Key, class Value>
+Value const & BufferedAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    typename AVLTree<Key, Value>::iterator it = upserts_.find(key);
+    if (it != upserts_.end()) {
+        return it->second;
+    }
+    if (removes_.find(key) != removes_.end()) {
+        throw std::out_of_range("Invalid key");
+    }
+    return main_[key];
+}
+
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::empty() const
+{
+    return begin() == end();
+}
+
+/**
+* Writes absorbed since the last flush.
+*/
+template<class Key, class Value>
+size_t BufferedAVLTree<Key, Value>::buffered() const
+{
+    return pending_;
+}
+
+/**
+* The main tree, without the writes still in the buffer.
+*/
+template<class Key, class Value>
+const AVLTree<Key, Value>& BufferedAVLTree<Key, Value>::tree() const
+{
+    return main_;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the BufferedAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,728 @@
+#ifndef CONCURRENTAVL_H
+#define CONCURRENTAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <vector>
+#include <algorithm>
+
+/**
+* A node for a ConcurrentAVLTree. The item is immutable: overwriting a value
+* replaces the whole node, so a reader can copy a value without racing a
+* writer. Children are atomics because readers follow them without locks;
+* the parent pointer and the height are only touched by the writer.
+*/
+template <typename Key, typename Value>
+class ConcurrentAVLNode
+{
+public:
+    ConcurrentAVLNode(const Key& key, const Value& value, ConcurrentAVLNode<Key, Value>* parent);
+
+    const std::pair<const Key, Value>& getItem() const;
+    const Key& getKey() const;
+    const Value& getValue() const;
+
+    // Safe from any thread; the stores publish the child to readers.
+    ConcurrentAVLNode<Key, Value>* getLeft() const;
+    ConcurrentAVLNode<Key, Value>* getRight() const;
+    void setLeft(ConcurrentAVLNode<Key, Value>* left);
+    void setRight(ConcurrentAVLNode<Key, Value>* right);
+
+    // Writer only.
+    ConcurrentAVLNode<Key, Value>* getParent() const;
+    void setParent(ConcurrentAVLNode<Key, Value>* parent);
+    int getHeight() const;
+    void setHeight(int height);
+
+protected:
+    const std::pair<const Key, Value> item_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> left_;
+    std::atomic<ConcurrentAVLNode<Key, Value>*> right_;
+    ConcurrentAVLNode<Key, Value>* parent_;
+    int height_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the ConcurrentAVLNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+ConcurrentAVLNode<Key, Value>::ConcurrentAVLNode(const Key& key, const Value& value, ConcurrentAVLNode<Key, Value>* parent) :
+    item_(key, value), left_(nullptr), right_(nullptr), parent_(parent), height_(1)
+{
+
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& ConcurrentAVLNode<Key, Value>::getItem() const
+{
+    return item_;
+}
+
+template<class Key, class Value>
+const Key& ConcurrentAVLNode<Key, Value>::getKey() const
+{
+    return item_.first;
+}
+
+template<class Key, class Value>
+const Value& ConcurrentAVLNode<Key, Value>::getValue() const
+{
+    return item_.second;
+}
+
+template<class Key, class Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getLeft() const
+{
+    return left_.load(std::memory_order_acquire);
+}
+
+template<class Key, class Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getRight() const
+{
+    return right_.load(std::memory_order_acquire);
+}
+
+template<class Key, class Value>
+void ConcurrentAVLNode<Key, Value>::setLeft(ConcurrentAVLNode<Key, Value>* left)
+{
+    left_.store(left, std::memory_order_release);
+}
+
+template<class Key, class Value>
+void ConcurrentAVLNode<Key, Value>::setRight(ConcurrentAVLNode<Key, Value>* right)
+{
+    right_.store(right, std::memory_order_release);
+}
+
+template<class Key, class Value>
+ConcurrentAVLNode<Key, Value>* ConcurrentAVLNode<Key, Value>::getParent() const
+{
+    return parent_;
+}
+
+template<class Key, class Value>
+void ConcurrentAVLNode<Key, Value>::setParent(ConcurrentAVLNode<Key, Value>* parent)
+{
+    parent_ = parent;
+}
+
+template<class Key, class Value>
+int ConcurrentAVLNode<Key, Value>::getHeight() const
+{
+    return height_;
+}
+
+template<class Key, class Value>
+void ConcurrentAVLNode<Key, Value>::setHeight(int height)
+{
+    height_ = height;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the ConcurrentAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVL map that many threads can read while one at a time writes, with
+* no lock on the read path.
+*
+* Readers descend with plain atomic loads, validated by a sequence number
+* (a seqlock): it is odd while a writer is moving nodes around and bumped
+* when it is done, and a reader that saw it change retries. Only rotations
+* and removes move nodes, so most inserts, and every overwrite, never make a
+* reader retry: a new leaf or a replacement node is published with a single
+* store that readers either see or do not.
+*
+* A removed or replaced node may still be under a reader, so it is retired
+* instead of deleted and freed once every reader that could have seen it is
+* done (epoch-based reclamation). Readers announce the epoch they started in
+* through one of a fixed set of slots, so a read costs two stores to a slot
+* nobody else is using, plus the descent.
+*
+* Writers serialize on one mutex, which readers never touch. Results are
+* returned by copy, since a node can be freed once the read finishes.
+*/
+template <class Key, class Value>
+class ConcurrentAVLTree
+{
+public:
+    typedef ConcurrentAVLNode<Key, Value> CNode;
+
+    ConcurrentAVLTree();
+    ~ConcurrentAVLTree();
+
+    // Readers: any thread, no locks
+    bool lookup(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value get(const Key& key) const;
+    size_t size() const;
+    bool empty() const;
+
+    // Writers: serialized with each other only
+    void insert(const std::pair<const Key, Value>& new_item);
+    bool remove(const Key& key);
+    void clear();
+    std::vector<std::pair<Key, Value> > items() const;
+    bool isBalanced() const;
+
+protected:
+    enum { READER_SLOTS = 64, MAX_DEPTH = 128, RETIRE_BATCH = 64 };
+
+    //One announced epoch per reader, padded to a cache line of its own
+    struct Slot
+    {
+        std::atomic<uint64_t> epoch;  // 0 = free
+        char pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    //Holds a reader slot for one read
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const ConcurrentAVLTree<Key, Value>& tree);
+        ~ReadGuard();
+    private:
+        std::atomic<uint64_t>* epoch_;
+    };
+
+    // Helper functions
+    const CNode* search(const Key& key) const;
+    CNode* writerFind(const Key& key) const;
+    void replaceChild(CNode* parent, CNode* oldChild, CNode* newChild);
+    void beginMove();
+    void endMove();
+    static int heightOf(CNode* node);
+    static void updateHeight(CNode* node);
+    CNode* rotateLeft(CNode* node);
+    CNode* rotateRight(CNode* node);
+    void rebalanceFrom(CNode* node);
+    void retire(CNode* node);
+    void reclaim(bool all);
+    static void deleteSubtree(CNode* node);
+    static void collect(CNode* node, std::vector<std::pair<Key, Value> >& out);
+    static int checkBalance(CNode* node);
+
+    std::atomic<CNode*> root_;
+    std::atomic<uint64_t> seq_;       // odd while nodes are being moved
+    std::atomic<size_t> size_;
+    mutable std::mutex writeLock_;
+    bool moving_;                     // writer is inside a beginMove/endMove
+
+    std::atomic<uint64_t> epoch_;
+    mutable Slot slots_[READER_SLOTS];
+    std::vector<std::pair<CNode*, uint64_t> > retired_;  // node, epoch it was retired in
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::ConcurrentAVLTree() :
+    root_(nullptr), seq_(0), size_(0), moving_(false), epoch_(1)
+{
+    for (size_t i = 0; i < READER_SLOTS; ++i) {
+        slots_[i].epoch.store(0);
+    }
+}
+
+/**
+* No reader or writer may still be using the tree.
+*/
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::~ConcurrentAVLTree()
+{
+    deleteSubtree(root_.load());
+    reclaim(true);
+}
+
+/*
+ * Claims a free slot, starting from one picked by thread id so that a
+ * thread usually gets the same slot back, and announces the current epoch.
+ */
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::ReadGuard::ReadGuard(const ConcurrentAVLTree<Key, Value>& tree)
+{
+    size_t i = std::hash<std::thread::id>()(std::this_thread::get_id()) % READER_SLOTS;
+    while (true) {
+        uint64_t free = 0;
+        uint64_t epoch = tree.epoch_.load();
+        if (tree.slots_[i].epoch.compare_exchange_strong(free, epoch)) {
+            epoch_ = &tree.slots_[i].epoch;
+            return;
+        }
+        i = (i + 1) % READER_SLOTS;
+    }
+}
+
+template<class Key, class Value>
+ConcurrentAVLTree<Key, Value>::ReadGuard::~ReadGuard()
+{
+    epoch_->store(0, std::memory_order_release);
+}
+
+/*
+ * Seqlock read of the node holding key. A descent that overlapped a move is
+ * thrown away, including one that wandered off (MAX_DEPTH is far beyond the
+ * height of any AVL tree that fits in memory).
+ */
+template<class Key, class Value>
+const typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::search(const Key& key) const
+{
+    while (true) {
+        uint64_t seq = seq_.load(std::memory_order_acquire);
+        if (seq & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        const CNode* node = root_.load(std::memory_order_acquire);
+        int depth = 0;
+        while (node != nullptr && depth++ < MAX_DEPTH) {
+            if (key < node->getKey()) {
+                node = node->getLeft();
+            } else if (node->getKey() < key) {
+                node = node->getRight();
+            } else {
+                break;
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (depth <= MAX_DEPTH && seq_.load(std::memory_order_relaxed) == seq) {
+            return node;
+        }
+    }
+}
+
+/**
+* Copies the value for key into value and returns true, or returns false if
+* key is missing.
+*/
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::lookup(const Key& key, Value& value) const
+{
+    ReadGuard guard(*this);
+    const CNode* node = search(key);
+    if (node == nullptr) {
+        return false;
+    }
+    value = node->getValue();
+    return true;
+}
+
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::contains(const Key& key) const
+{
+    ReadGuard guard(*this);
+    return search(key) != nullptr;
+}
+
+/**
+* A copy of the value for key. Throws std::out_of_range if key is missing.
+*/
+template<class Key, class Value>
+Value ConcurrentAVLTree<Key, Value>::get(const Key& key) const
+{
+    ReadGuard guard(*this);
+    const CNode* node = search(key);
+    if (node == nullptr) {
+        throw std::out_of_range("Invalid key");
+    }
+    return node->getValue();
+}
+
+template<class Key, class Value>
+size_t ConcurrentAVLTree<Key, Value>::size() const
+{
+    return size_.load(std::memory_order_relaxed);
+}
+
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::empty() const
+{
+    return size() == 0;
+}
+
+//Writer-side search; the writer is the only thread that changes links
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::writerFind(const Key& key) const
+{
+    CNode* node = root_.load(std::memory_order_relaxed);
+    while (node != nullptr) {
+        if (key < node->getKey()) {
+            node = node->getLeft();
+        } else if (node->getKey() < key) {
+            node = node->getRight();
+        } else {
+            return node;
+        }
+    }
+    return nullptr;
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::replaceChild(CNode* parent, CNode* oldChild, CNode* newChild)
+{
+    if (newChild != nullptr) {
+        newChild->setParent(parent);
+    }
+    if (parent == nullptr) {
+        root_.store(newChild, std::memory_order_release);
+    } else if (parent->getLeft() == oldChild) {
+        parent->setLeft(newChild);
+    } else {
+        parent->setRight(newChild);
+    }
+}
+
+//Opens a seqlock write section, once per write however many moves it makes
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::beginMove()
+{
+    if (moving_) {
+        return;
+    }
+    moving_ = true;
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::endMove()
+{
+    if (!moving_) {
+        return;
+    }
+    moving_ = false;
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<class Key, class Value>
+int ConcurrentAVLTree<Key, Value>::heightOf(CNode* node)
+{
+    return (node == nullptr) ? 0 : node->getHeight();
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::updateHeight(CNode* node)
+{
+    node->setHeight(1 + std::max(heightOf(node->getLeft()), heightOf(node->getRight())));
+}
+
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::rotateLeft(CNode* node)
+{
+    beginMove();
+    CNode* right = node->getRight();
+    CNode* middle = right->getLeft();
+    node->setRight(middle);
+    if (middle != nullptr) {
+        middle->setParent(node);
+    }
+    replaceChild(node->getParent(), node, right);
+    right->setLeft(node);
+    node->setParent(right);
+    updateHeight(node);
+    updateHeight(right);
+    return right;
+}
+
+template<class Key, class Value>
+typename ConcurrentAVLTree<Key, Value>::CNode*
+ConcurrentAVLTree<Key, Value>::rotateRight(CNode* node)
+{
+    beginMove();
+    CNode* left = node->getLeft();
+    CNode* middle = left->getRight();
+    node->setLeft(middle);
+    if (middle != nullptr) {
+        middle->setParent(node);
+    }
+    replaceChild(node->getParent(), node, left);
+    left->setRight(node);
+    node->setParent(left);
+    updateHeight(node);
+    updateHeight(left);
+    return left;
+}
+
+/*
+ * Walks up from node fixing heights and rotating where a subtree is off by
+ * two, and stops at the first subtree whose height came out unchanged,
+ * since nothing above it can have changed either.
+ */
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::rebalanceFrom(CNode* node)
+{
+    while (node != nullptr) {
+        int oldHeight = node->getHeight();
+        int balance = heightOf(node->getRight()) - heightOf(node->getLeft());
+        if (balance > 1) {
+            if (heightOf(node->getRight()->getLeft()) > heightOf(node->getRight()->getRight())) {
+                rotateRight(node->getRight());
+            }
+            node = rotateLeft(node);
+        } else if (balance < -1) {
+            if (heightOf(node->getLeft()->getRight()) > heightOf(node->getLeft()->getLeft())) {
+                rotateLeft(node->getLeft());
+            }
+            node = rotateRight(node);
+        } else {
+            updateHeight(node);
+        }
+        if (node->getHeight() == oldHeight) {
+            return;
+        }
+        node = node->getParent();
+    }
+}
+
+/**
+* Inserts key, or replaces its node with one holding the new value.
+*/
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+    std::lock_guard<std::mutex> lock(writeLock_);
+
+    CNode* parent = nullptr;
+    CNode* node = root_.load(std::memory_order_relaxed);
+    while (node != nullptr) {
+        if (new_item.first < node->getKey()) {
+            parent = node;
+            node = node->getLeft();
+        } else if (node->getKey() < new_item.first) {
+            parent = node;
+            node = node->getRight();
+        } else {
+            //The replacement takes over the children before it is published
+            CNode* replacement = new CNode(new_item.first, new_item.second, parent);
+            replacement->setLeft(node->getLeft());
+            replacement->setRight(node->getRight());
+            replacement->setHeight(node->getHeight());
+            if (node->getLeft() != nullptr) {
+                node->getLeft()->setParent(replacement);
+            }
+            if (node->getRight() != nullptr) {
+                node->getRight()->setParent(replacement);
+            }
+            replaceChild(parent, node, replacement);
+            retire(node);
+            return;
+        }
+    }
+
+    CNode* leaf = new CNode(new_item.first, new_item.second, parent);
+    if (parent == nullptr) {
+        root_.store(leaf, std::memory_order_release);
+    } else if (new_item.first < parent->getKey()) {
+        parent->setLeft(leaf);
+    } else {
+        parent->setRight(leaf);
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    rebalanceFrom(parent);
+    endMove();
+}
+
+/**
+* Removes key and returns true, or returns false if it was missing. The
+* node is freed once no reader can still be on it.
+*/
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::remove(const Key& key)
+{
+    std::lock_guard<std::mutex> lock(writeLock_);
+
+    CNode* node = writerFind(key);
+    if (node == nullptr) {
+        return false;
+    }
+
+    beginMove();
+    CNode* start;
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        //Relink the successor into node's place
+        CNode* successor = node->getRight();
+        while (successor->getLeft() != nullptr) {
+            successor = successor->getLeft();
+        }
+        if (successor->getParent() != node) {
+            start = successor->getParent();
+            start->setLeft(successor->getRight());
+            if (successor->getRight() != nullptr) {
+                successor->getRight()->setParent(start);
+            }
+            successor->setRight(node->getRight());
+            node->getRight()->setParent(successor);
+        } else {
+            start = successor;
+        }
+        successor->setLeft(node->getLeft());
+        node->getLeft()->setParent(successor);
+        successor->setHeight(node->getHeight());
+        replaceChild(node->getParent(), node, successor);
+    } else {
+        CNode* child = (node->getLeft() != nullptr) ? node->getLeft() : node->getRight();
+        start = node->getParent();
+        replaceChild(start, node, child);
+    }
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    rebalanceFrom(start);
+    endMove();
+
+    retire(node);
+    return true;
+}
+
+/**
+* Empties the tree; the nodes are retired like removed ones.
+*/
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::clear()
+{
+    std::lock_guard<std::mutex> lock(writeLock_);
+
+    std::vector<CNode*> stack;
+    CNode* root = root_.load(std::memory_order_relaxed);
+    root_.store(nullptr, std::memory_order_release);
+    size_.store(0, std::memory_order_relaxed);
+    if (root != nullptr) {
+        stack.push_back(root);
+    }
+    while (!stack.empty()) {
+        CNode* node = stack.back();
+        stack.pop_back();
+        if (node->getLeft() != nullptr) {
+            stack.push_back(node->getLeft());
+        }
+        if (node->getRight() != nullptr) {
+            stack.push_back(node->getRight());
+        }
+        retire(node);
+    }
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::retire(CNode* node)
+{
+    retired_.push_back(std::make_pair(node, epoch_.load()));
+    if (retired_.size() >= RETIRE_BATCH) {
+        reclaim(false);
+    }
+}
+
+/*
+ * Starts a new epoch and frees every retired node from before the oldest
+ * epoch a reader has announced. A reader that announced a later epoch
+ * started after the node was unlinked and cannot reach it. With all set,
+ * frees everything (only when no reader can be left).
+ */
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::reclaim(bool all)
+{
+    uint64_t oldest = epoch_.fetch_add(1) + 1;
+    for (size_t i = 0; i < READER_SLOTS && !all; ++i) {
+        uint64_t epoch = slots_[i].epoch.load();
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_.size(); ++i) {
+        if (all || retired_[i].second < oldest) {
+            delete retired_[i].first;
+        } else {
+            retired_[kept++] = retired_[i];
+        }
+    }
+    retired_.resize(kept);
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::deleteSubtree(CNode* node)
+{
+    if (node == nullptr) {
+        return;
+    }
+    deleteSubtree(node->getLeft());
+    deleteSubtree(node->getRight());
+    delete node;
+}
+
+template<class Key, class Value>
+void ConcurrentAVLTree<Key, Value>::collect(CNode* node, std::vector<std::pair<Key, Value> >& out)
+{
+    if (node == nullptr) {
+        return;
+    }
+    collect(node->getLeft(), out);
+    out.push_back(std::make_pair(node->getKey(), node->getValue()));
+    collect(node->getRight(), out);
+}
+
+/**
+* A consistent copy of every item in key order. Takes the writer lock, so
+* it holds up writers (not readers) for O(n).
+*/
+template<class Key, class Value>
+std::vector<std::pair<Key, Value> > ConcurrentAVLTree<Key, Value>::items() const
+{
+    std::lock_guard<std::mutex> lock(writeLock_);
+    std::vector<std::pair<Key, Value> > out;
+    out.reserve(size());
+    collect(root_.load(std::memory_order_relaxed), out);
+    return out;
+}
+
+//Height of node's subtree, or -1 if a height, balance or parent link is wrong
+template<class Key, class Value>
+int ConcurrentAVLTree<Key, Value>::checkBalance(CNode* node)
+{
+    if (node == nullptr) {
+        return 0;
+    }
+    CNode* left = node->getLeft();
+    CNode* right = node->getRight();
+    if ((left != nullptr && left->getParent() != node) || (right != nullptr && right->getParent() != node)) {
+        return -1;
+    }
+    int leftHeight = checkBalance(left);
+    int rightHeight = checkBalance(right);
+    if (leftHeight < 0 || rightHeight < 0 || std::abs(leftHeight - rightHeight) > 1 ||
+        node->getHeight() != 1 + std::max(leftHeight, rightHeight)) {
+        return -1;
+    }
+    return node->getHeight();
+}
+
+template<class Key, class Value>
+bool ConcurrentAVLTree<Key, Value>::isBalanced() const
+{
+    std::lock_guard<std::mutex> lock(writeLock_);
+    return checkBalance(root_.load(std::memory_order_relaxed)) >= 0;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef EXPIRINGCACHE_H
+#define EXPIRINGCACHE_H
+
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include "avlbst.h"
+
+/**
+* Key of the expiry index: when an entry expires, plus an insertion sequence
+* number so entries expiring at the same time are still distinct keys and
+* leave in the order they were written.
+*/
+struct CacheDeadline
+{
+    CacheDeadline() : at(0), seq(0) { }
+    CacheDeadline(uint64_t a, uint64_t s) : at(a), seq(s) { }
+
+    uint64_t at;
+    uint64_t seq;
+};
+
+inline bool operator<(const CacheDeadline& a, const CacheDeadline& b)
+{
+    return a.at < b.at || (a.at == b.at && a.seq < b.seq);
+}
+inline bool operator>(const CacheDeadline& a, const CacheDeadline& b) { return b < a; }
+inline bool operator==(const CacheDeadline& a, const CacheDeadline& b) { return a.at == b.at && a.seq == b.seq; }
+inline bool operator!=(const CacheDeadline& a, const CacheDeadline& b) { return !(a == b); }
+
+inline std::ostream& operator<<(std::ostream& out, const CacheDeadline& deadline)
+{
+    return out << deadline.at << '#' << deadline.seq;
+}
+
+/**
+* An AVLTree that hands out its nodes, so the cache can link the two indexes
+* to each other directly and unlink entries without searching for them.
+*/
+template <class Key, class Value>
+class CacheIndex : public AVLTree<Key, Value>
+{
+public:
+    CacheIndex() : created_(nullptr) { }
+
+    //Inserts a key that is not in the index yet and returns its node, in one descent
+    AVLNode<Key, Value>* insertNode(const Key& key, const Value& value)
+    {
+        created_ = nullptr;
+        this->insert(std::make_pair(key, value));
+        return created_;
+    }
+    AVLNode<Key, Value>* node(const Key& key) const
+    {
+        return static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
+    }
+    AVLNode<Key, Value>* first() const
+    {
+        return static_cast<AVLNode<Key, Value>*>(this->getSmallestNode());
+    }
+    void unlink(AVLNode<Key, Value>* node)
+    {
+        this->unlinkNode(node);
+    }
+    static AVLNode<Key, Value>* next(AVLNode<Key, Value>* node)
+    {
+        return static_cast<AVLNode<Key, Value>*>(CacheIndex::successor(node));
+    }
+
+protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+    {
+        created_ = AVLTree<Key, Value>::createNode(key, value, parent);
+        return created_;
+    }
+
+    AVLNode<Key, Value>* created_;  // the node the last insert linked in
+};
+
+/**
+* A key/value cache whose entries expire after a time to live, with an
+* optional entry count and byte budget.
+*
+* Two AVLTrees index the same entries: one by key, and one by deadline. Each
+* entry holds a pointer to its node in the other index, so an eviction
+* unlinks both nodes directly instead of searching for them. Expired entries
+* sit at the front of the deadline index and leave in a batch of k for
+* O(log n + k) search work; the unlinks only pay for their rebalancing.
+*
+* get() slides an entry's deadline to now + its ttl, so among entries with
+* the same ttl the deadline order is the least recently used order, and the
+* budget evicts from the front of it (peek() reads without refreshing).
+*
+* Time is whatever unit the caller passes as now; it must not go backwards.
+* Every put() and get() first evicts at most evictBatch expired entries, so
+* a burst of entries expiring together is cleared a little at a time
+* instead of in one long call. evictExpired() can be called from idle time
+* to clear them sooner.
+*/
+template <class Key, class Value>
+class ExpiringCache
+{
+public:
+    explicit ExpiringCache(size_t maxEntries, size_t maxBytes = 0, size_t evictBatch = 16);
+
+    void put(const Key& key, const Value& value, uint64_t now, uint64_t ttl, size_t bytes = 0);
+    const Value* get(const Key& key, uint64_t now);
+    const Value* peek(const Key& key, uint64_t now) const;
+    bool erase(const Key& key);
+    size_t evictExpired(uint64_t now, size_t limit);
+
+    size_t size() const;
+    size_t bytes() const;
+    bool empty() const;
+
+protected:
+    struct Entry;
+    typedef AVLNode<Key, Entry> KeyNode;
+    typedef AVLNode<CacheDeadline, KeyNode*> ExpiryNode;
+
+    struct Entry
+    {
+        Entry() : value(), ttl(0), bytes(0), expiry(nullptr) { }
+        Entry(const Value& v, uint64_t t, size_t b) : value(v), ttl(t), bytes(b), expiry(nullptr) { }
+
+        friend std::ostream& operator<<(std::ostream& out, const Entry& entry)
+        {
+            return out << entry.value;
+        }
+
+        Value value;
+        uint64_t ttl;
+        size_t bytes;
+        ExpiryNode* expiry;
+    };
+
+    // Helper functions
+    void schedule(KeyNode* keyNode, uint64_t now);
+    void evict(ExpiryNode* expiryNode);
+    bool overBudget() const;
+
+    CacheIndex<Key, Entry> keys_;
+    CacheIndex<CacheDeadline, KeyNode*> expiry_;
+    size_t maxEntries_;
+    size_t maxBytes_;     // 0 = no byte budget
+    size_t evictBatch_;   // expired entries evicted per put/get
+    size_t size_;
+    size_t bytes_;
+    uint64_t seq_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ExpiringCache class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+ExpiringCache<Key, Value>::ExpiringCache(size_t maxEntries, size_t maxBytes, size_t evictBatch) :
+    maxEntries_(maxEntries), maxBytes_(maxBytes), evictBatch_(evictBatch), size_(0), bytes_(0), seq_(0)
+{
+
+}
+
+template<class Key, class Value>
+size_t ExpiringCache<Key, Value>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value>
+size_t ExpiringCache<Key, Value>::bytes() const
+{
+    return bytes_;
+}
+
+template<class Key, class Value>
+bool ExpiringCache<Key, Value>::empty() const
+{
+    return size_ == 0;
+}
+
+template<class Key, class Value>
+bool ExpiringCache<Key, Value>::overBudget() const
+{
+    return size_ > maxEntries_ || (maxBytes_ != 0 && bytes_ > maxBytes_);
+}
+
+//(Re)places the entry in the deadline index at now + its ttl
+template<class Key, class Value>
+void ExpiringCache<Key, Value>::schedule(KeyNode* keyNode, uint64_t now)
+{
+    Entry& entry = keyNode->getValue();
+    if (entry.expiry != nullptr) {
+        expiry_.unlink(entry.expiry);
+    }
+    CacheDeadline deadline(now + entry.ttl, seq_++);
+    entry.expiry = expiry_.insertNode(deadline, keyNode);
+}
+
+template<class Key, class Value>
+void ExpiringCache<Key, Value>::evict(ExpiryNode* expiryNode)
+{
+    KeyNode* keyNode = expiryNode->getValue();
+    bytes_ -= keyNode->getValue().bytes;
+    size_--;
+    expiry_.unlink(expiryNode);
+    keys_.unlink(keyNode);
+}
+
+/**
+* Evicts up to limit entries whose deadline is at or before now, oldest
+* deadline first, and returns how many were evicted.
+*/
+template<class Key, class Value>
+size_t ExpiringCache<Key, Value>::evictExpired(uint64_t now, size_t limit)
+{
+    size_t evicted = 0;
+    ExpiryNode* node = expiry_.first();
+    while (node != nullptr && evicted < limit && node->getKey().at <= now) {
+        //The front node has no left child, so unlinking it moves no other node
+        ExpiryNode* next = CacheIndex<CacheDeadline, KeyNode*>::next(node);
+        evict(node);
+        node = next;
+        evicted++;
+    }
+    return evicted;
+}
+
+/**
+* Inserts or replaces key, expiring at now + ttl. bytes is the entry's
+* weight against the byte budget. If the cache is then over budget, entries
+* are evicted from the front of the deadline index until it is not. An
+* entry heavier than the whole byte budget is never stored: it only drops
+* the old entry for key, and leaves every other entry alone.
+*/
+template<class Key, class Value>
+void ExpiringCache<Key, Value>::put(const Key& key, const Value& value, uint64_t now, uint64_t ttl, size_t bytes)
+{
+    evictExpired(now, evictBatch_);
+    if (maxBytes_ != 0 && bytes > maxBytes_) {
+        erase(key);
+        return;
+    }
+
+    KeyNode* keyNode = keys_.node(key);
+    if (keyNode != nullptr) {
+        Entry& entry = keyNode->getValue();
+        bytes_ = bytes_ - entry.bytes + bytes;
+        entry.value = value;
+        entry.ttl = ttl;
+        entry.bytes = bytes;
+    } else {
+        keyNode = keys_.insertNode(key, Entry(value, ttl, bytes));
+        bytes_ += bytes;
+        size_++;
+    }
+    schedule(keyNode, now);
+
+    while (overBudget()) {
+        evict(expiry_.first());
+    }
+}
+
+/**
+* Returns the live value for key and pushes its deadline to now + ttl, or
+* nullptr if it is missing or expired. The pointer is valid until the entry
+* is replaced, erased or evicted.
+*/
+template<class Key, class Value>
+const Value* ExpiringCache<Key, Value>::get(const Key& key, uint64_t now)
+{
+    evictExpired(now, evictBatch_);
+
+    KeyNode* keyNode = keys_.node(key);
+    if (keyNode == nullptr) {
+        return nullptr;
+    }
+    Entry& entry = keyNode->getValue();
+    if (entry.expiry->getKey().at <= now) {
+        evict(entry.expiry);
+        return nullptr;
+    }
+    schedule(keyNode, now);
+    return &entry.value;
+}
+
+/**
+* Like get(), but leaves the deadline and the cache unchanged.
+*/
+template<class Key, class Value>
+const Value* ExpiringCache<Key, Value>::peek(const Key& key, uint64_t now) const
+{
+    KeyNode* keyNode = keys_.node(key);
+    if (keyNode == nullptr || keyNode->getValue().expiry->getKey().at <= now) {
+        return nullptr;
+    }
+    return &keyNode->getValue().value;
+}
+
+template<class Key, class Value>
+bool ExpiringCache<Key, Value>::erase(const Key& key)
+{
+    KeyNode* keyNode = keys_.node(key);
+    if (keyNode == nullptr) {
+        return false;
+    }
+    evict(keyNode->getValue().expiry);
+    return true;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ExpiringCache class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,528 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <limits>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "avlbst.h"
+
+/**
+* Tuning knobs for the streaming ingest stage.
+*/
+struct IngestOptions
+{
+    IngestOptions() :
+        threads(std::max(1u, std::thread::hardware_concurrency())),
+        chunkBytes(8u << 20),
+        targetMBps(200.0)
+    {
+
+    }
+
+    size_t threads;     // parser threads
+    size_t chunkBytes;  // bytes of input handed to a parser at a time
+    double targetMBps;  // throughput the caller expects; see IngestStats::metTarget
+};
+
+/**
+* What an ingest run did and how fast it went.
+*/
+struct IngestStats
+{
+    IngestStats() : bytes(0), records(0), seconds(0.0), targetMBps(0.0) { }
+
+    double mbPerSec() const { return seconds > 0.0 ? (bytes / 1048576.0) / seconds : 0.0; }
+    bool metTarget() const { return mbPerSec() >= targetMBps; }
+
+    uint64_t bytes;
+    uint64_t records;
+    double seconds;
+    double targetMBps;
+};
+
+/*
+  ---------------------------------------------
+  Field parsers for the "key value\n" text format.
+  Each one reads a field starting at p, stops at
+  whitespace, and advances p past what it consumed.
+  ---------------------------------------------
+*/
+
+inline void skipBlanks(const char*& p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        ++p;
+    }
+}
+
+inline const char* fieldEnd(const char* p, const char* end)
+{
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+        ++p;
+    }
+    return p;
+}
+
+//Rejects values outside the range of long long like any other malformed field
+inline bool parseField(const char*& p, const char* end, long long& out)
+{
+    skipBlanks(p, end);
+    const char* stop = fieldEnd(p, end);
+    if (stop == p) {
+        return false;
+    }
+    bool negative = (*p == '-');
+    const char* digit = (negative || *p == '+') ? p + 1 : p;
+    if (digit == stop) {
+        return false;
+    }
+    const unsigned long long limit = (unsigned long long)std::numeric_limits<long long>::max() + (negative ? 1 : 0);
+    unsigned long long magnitude = 0;
+    for (; digit < stop; ++digit) {
+        if (*digit < '0' || *digit > '9') {
+            return false;
+        }
+        unsigned d = (unsigned)(*digit - '0');
+        if (magnitude > (limit - d) / 10) {
+            return false;
+        }
+        magnitude = magnitude * 10 + d;
+    }
+    //-(magnitude - 1) - 1 reaches the most negative value without overflowing
+    out = (!negative || magnitude == 0) ? (long long)magnitude : -(long long)(magnitude - 1) - 1;
+    p = stop;
+    return true;
+}
+
+inline bool parseField(const char*& p, const char* end, std::string& out)
+{
+    skipBlanks(p, end);
+    const char* stop = fieldEnd(p, end);
+    if (stop == p) {
+        return false;
+    }
+    out.assign(p, stop);
+    p = stop;
+    return true;
+}
+
+inline bool parseField(const char*& p, const char* end, double& out)
+{
+    skipBlanks(p, end);
+    const char* stop = fieldEnd(p, end);
+    if (stop == p) {
+        return false;
+    }
+    std::string text(p, stop); //strtod needs a terminator the mapping does not have
+    char* parsedEnd = nullptr;
+    out = std::strtod(text.c_str(), &parsedEnd);
+    if (parsedEnd != text.c_str() + text.size()) {
+        return false;
+    }
+    p = stop;
+    return true;
+}
+
+/**
+* Integral fields other than long long go through the fast integer parser,
+* and a value that does not fit in T is malformed; anything else falls back
+* to operator>>.
+*/
+template <typename T>
+bool parseFieldAs(const char*& p, const char* end, T& out, std::true_type /* integral */)
+{
+    long long value = 0;
+    if (!parseField(p, end, value)) {
+        return false;
+    }
+    bool fits = (value < 0) ? (std::is_signed<T>::value && value >= (long long)std::numeric_limits<T>::min())
+                            : (unsigned long long)value <= (unsigned long long)std::numeric_limits<T>::max();
+    if (!fits) {
+        return false;
+    }
+    out = (T)value;
+    return true;
+}
+
+template <typename T>
+bool parseFieldAs(const char*& p, const char* end, T& out, std::false_type /* integral */)
+{
+    skipBlanks(p, end);
+    const char* stop = fieldEnd(p, end);
+    std::istringstream in(std::string(p, stop));
+    if (!(in >> out)) {
+        return false;
+    }
+    p = stop;
+    return true;
+}
+
+template <typename T>
+bool parseField(const char*& p, const char* end, T& out)
+{
+    return parseFieldAs(p, end, out, typename std::is_integral<T>::type());
+}
+
+/**
+* The default text record parser: one "key value" pair per line.
+*/
+struct TextRecordParser
+{
+    template <typename Key, typename Value>
+    bool operator()(const char* begin, const char* end, Key& key, Value& value) const
+    {
+        const char* p = begin;
+        return parseField(p, end, key) && parseField(p, end, value);
+    }
+};
+
+/*
+  ---------------------------------------------
+  Implementation details shared by both formats.
+  ---------------------------------------------
+*/
+
+/**
+* A read-only mapping of a whole input file, advised for sequential access
+* so the kernel reads ahead in large blocks.
+*/
+class IngestMapping
+{
+public:
+    explicit IngestMapping(const std::string& path) : data_(nullptr), length_(0)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("ingest: cannot open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("ingest: cannot stat " + path);
+        }
+        length_ = (size_t)st.st_size;
+        if (length_ > 0) {
+            void* mapping = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("ingest: mmap failed for " + path);
+            }
+            madvise(mapping, length_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(mapping);
+        }
+        ::close(fd);
+    }
+
+    ~IngestMapping()
+    {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), length_);
+        }
+    }
+
+    const char* data() const { return data_; }
+    size_t length() const { return length_; }
+
+private:
+    IngestMapping(const IngestMapping&);
+    IngestMapping& operator=(const IngestMapping&);
+
+    const char* data_;
+    size_t length_;
+};
+
+/*
+ * Helper for ingestChunks: joins every joinable thread in threads when it
+ * goes out of scope, so an exception never unwinds past a joinable
+ * std::thread (which would call std::terminate).
+ */
+class IngestJoiner
+{
+public:
+    explicit IngestJoiner(std::vector<std::thread>& threads) : threads_(threads) { }
+
+    ~IngestJoiner()
+    {
+        for (size_t t = 0; t < threads_.size(); ++t) {
+            if (threads_[t].joinable()) {
+                threads_[t].join();
+            }
+        }
+    }
+
+private:
+    IngestJoiner(const IngestJoiner&);
+    IngestJoiner& operator=(const IngestJoiner&);
+
+    std::vector<std::thread>& threads_;
+};
+
+/*
+ * Helper for ingestChunks: merges sorted runs pairwise into runs[0],
+ * keeping neighbouring runs in file order so that a later record of a key
+ * stays after an earlier one.
+ */
+template <typename Key, typename Value>
+void mergeRuns(std::vector<std::vector<std::pair<Key, Value> > >& runs)
+{
+    typedef std::pair<Key, Value> Record;
+    struct ByKey {
+        bool operator()(const Record& a, const Record& b) const { return a.first < b.first; }
+    };
+    for (size_t width = 1; width < runs.size(); width *= 2) {
+        for (size_t i = 0; i + width < runs.size(); i += 2 * width) {
+            std::vector<Record> merged;
+            merged.reserve(runs[i].size() + runs[i + width].size());
+            std::merge(runs[i].begin(), runs[i].end(), runs[i + width].begin(), runs[i + width].end(),
+                       std::back_inserter(merged), ByKey());
+            runs[i].swap(merged);
+            std::vector<Record>().swap(runs[i + width]);
+        }
+    }
+}
+
+/**
+* Runs parseChunk(i, run) for every chunk, numThreads chunks at a time. Each
+* chunk becomes one run sorted by key, and each block of runs is merged and
+* handed to the tree as one sorted AVLTree::apply_batch while the workers
+* parse the next block. Only two blocks are ever held in memory, and a tree
+* that already has data still gets the batched merge instead of one insert
+* per record. Blocks are applied in file order and merging keeps file order
+* for equal keys, so a later record overwrites an earlier one just like a
+* sequence of insert calls would.
+*
+* parseChunk returns false for malformed input. The block holding that chunk
+* and everything after it are never applied, and the call returns false
+* with the earlier blocks already in the tree. Otherwise it returns true and
+* adds the number of records parsed to records. An exception thrown by
+* parseChunk stops the ingest the same way, and it or one thrown by the
+* tree is rethrown once every worker has been joined.
+*/
+template <typename Key, typename Value, typename ChunkParser>
+bool ingestChunks(size_t numChunks, size_t numThreads, AVLTree<Key, Value>& tree, ChunkParser parseChunk,
+                  uint64_t& records)
+{
+    typedef std::pair<Key, Value> Record;
+    typedef std::vector<std::vector<Record> > Block;
+    struct ByKey {
+        bool operator()(const Record& a, const Record& b) const { return a.first < b.first; }
+    };
+    numThreads = std::max<size_t>(1, std::min(numThreads, numChunks));
+
+    //Parses chunks [first, first + block.size()) into block on numThreads
+    //workers. Never throws: the first exception is left in error instead.
+    auto parseBlock = [&](size_t first, Block& block, std::exception_ptr& error) -> bool {
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+        std::mutex errorLock;
+        auto fail = [&]() {
+            std::lock_guard<std::mutex> guard(errorLock);
+            if (!error) {
+                error = std::current_exception();
+            }
+            failed = true;
+        };
+        auto work = [&]() {
+            try {
+                for (size_t i = next++; i < block.size() && !failed; i = next++) {
+                    if (!parseChunk(first + i, block[i])) {
+                        failed = true;
+                        return;
+                    }
+                    std::stable_sort(block[i].begin(), block[i].end(), ByKey());
+                }
+            } catch (...) {
+                fail();
+            }
+        };
+        try {
+            std::vector<std::thread> workers;
+            IngestJoiner joiner(workers);
+            for (size_t t = 0; t < numThreads; ++t) {
+                workers.push_back(std::thread(work));
+            }
+        } catch (...) {
+            fail(); //A worker could not be started; the others are joined
+        }
+        return !failed;
+    };
+
+    //Merges a parsed block and applies it as one batch
+    auto applyBlock = [&](Block& block) {
+        mergeRuns(block);
+        std::vector<BatchUpdate<Key, Value> > updates;
+        updates.reserve(block[0].size());
+        for (size_t i = 0; i < block[0].size(); ++i) {
+            updates.push_back(BatchUpdate<Key, Value>(block[0][i].first, block[0][i].second));
+        }
+        Block().swap(block);
+        tree.apply_batch(updates);
+        records += updates.size();
+    };
+
+    if (numChunks == 0) {
+        return true;
+    }
+    Block current(std::min(numThreads, numChunks));
+    std::exception_ptr error;
+    if (!parseBlock(0, current, error)) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return false;
+    }
+    for (size_t first = current.size(); first < numChunks; first += numThreads) {
+        //Parse the next block while this thread applies the current one; the
+        //joiner waits for the parser even if the apply throws
+        Block upcoming(std::min(numThreads, numChunks - first));
+        bool parsed = true;
+        {
+            std::vector<std::thread> parser;
+            IngestJoiner joiner(parser);
+            parser.push_back(std::thread([&]() { parsed = parseBlock(first, upcoming, error); }));
+            applyBlock(current);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if (!parsed) {
+            return false;
+        }
+        current.swap(upcoming);
+    }
+    applyBlock(current);
+    return true;
+}
+
+/*
+  ---------------------------------------------
+  Public entry points.
+  ---------------------------------------------
+*/
+
+/**
+* Streams a text file of "key value" lines into tree. The file is mapped and
+* cut into chunks on line boundaries; worker threads parse the chunks with
+* parse(lineBegin, lineEnd, key, value) and sort them into runs, which are
+* merged and applied to the tree one block of chunks at a time. Blank lines
+* are skipped. A line parse rejects aborts the ingest with
+* std::runtime_error: no record from the block of chunks holding that line,
+* or from any later block, reaches the tree, but earlier blocks already
+* have.
+*/
+template <typename Key, typename Value, typename Parser>
+IngestStats ingestTextFile(const std::string& path, AVLTree<Key, Value>& tree,
+                           const IngestOptions& options, Parser parse)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    IngestMapping file(path);
+    const char* data = file.data();
+    const size_t length = file.length();
+
+    //Chunk boundaries always fall just after a newline
+    std::vector<size_t> bounds(1, 0);
+    while (bounds.back() < length) {
+        size_t cut = std::min(length, bounds.back() + std::max<size_t>(1, options.chunkBytes));
+        const void* newline = (cut < length) ? std::memchr(data + cut, '\n', length - cut) : nullptr;
+        cut = (newline != nullptr) ? (static_cast<const char*>(newline) - data) + 1 : length;
+        bounds.push_back(cut);
+    }
+
+    IngestStats stats;
+    bool parsed = ingestChunks(bounds.size() - 1, options.threads, tree,
+        [&](size_t i, std::vector<std::pair<Key, Value> >& run) -> bool {
+            const char* p = data + bounds[i];
+            const char* end = data + bounds[i + 1];
+            std::pair<Key, Value> record;
+            while (p < end) {
+                const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                const char* lineEnd = (newline != nullptr) ? newline : end;
+                const char* q = p;
+                skipBlanks(q, lineEnd);
+                if (q < lineEnd) {
+                    if (!parse(q, lineEnd, record.first, record.second)) {
+                        return false;
+                    }
+                    run.push_back(record);
+                }
+                p = lineEnd + 1;
+            }
+            return true;
+        }, stats.records);
+    if (!parsed) {
+        throw std::runtime_error("ingestTextFile: malformed record in " + path);
+    }
+
+    stats.bytes = length;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.targetMBps = options.targetMBps;
+    return stats;
+}
+
+template <typename Key, typename Value>
+IngestStats ingestTextFile(const std::string& path, AVLTree<Key, Value>& tree,
+                           const IngestOptions& options = IngestOptions())
+{
+    return ingestTextFile(path, tree, options, TextRecordParser());
+}
+
+/**
+* Streams a binary file of fixed size records into tree. Each record is the
+* raw bytes of a Key immediately followed by the raw bytes of a Value, so both
+* must be trivially copyable.
+*/
+template <typename Key, typename Value>
+IngestStats ingestBinaryFile(const std::string& path, AVLTree<Key, Value>& tree,
+                             const IngestOptions& options = IngestOptions())
+{
+    static_assert(std::is_trivially_copyable<Key>::value, "binary ingest keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "binary ingest values must be trivially copyable");
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    IngestMapping file(path);
+    const size_t recordSize = sizeof(Key) + sizeof(Value);
+    if (file.length() % recordSize != 0) {
+        throw std::runtime_error("ingestBinaryFile: truncated record in " + path);
+    }
+    const size_t totalRecords = file.length() / recordSize;
+    const size_t perChunk = std::max<size_t>(1, options.chunkBytes / recordSize);
+    const char* data = file.data();
+
+    IngestStats stats;
+    ingestChunks((totalRecords + perChunk - 1) / perChunk, options.threads, tree,
+        [&](size_t i, std::vector<std::pair<Key, Value> >& run) -> bool {
+            size_t first = i * perChunk;
+            size_t last = std::min(totalRecords, first + perChunk);
+            run.resize(last - first);
+            for (size_t r = first; r < last; ++r) {
+                const char* record = data + r * recordSize;
+                std::memcpy(&run[r - first].first, record, sizeof(Key));
+                std::memcpy(&run[r - first].second, record + sizeof(Key), sizeof(Value));
+            }
+            return true;
+        }, stats.records);
+
+    stats.bytes = file.length();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.targetMBps = options.targetMBps;
+    return stats;
+}
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef INTERVALTREE_H
+#define INTERVALTREE_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "augavl.h"
+
+/**
+* A closed interval [start, end], used as the IntervalTree key. Intervals
+* are ordered by start, then end.
+*/
+template <typename T>
+struct Interval
+{
+    Interval() : start(), end() { }
+    Interval(const T& s, const T& e) : start(s), end(e) { }
+
+    T start;
+    T end;
+};
+
+template <typename T>
+bool operator<(const Interval<T>& a, const Interval<T>& b)
+{
+    return a.start < b.start || (!(b.start < a.start) && a.end < b.end);
+}
+
+template <typename T>
+bool operator>(const Interval<T>& a, const Interval<T>& b)
+{
+    return b < a;
+}
+
+template <typename T>
+bool operator==(const Interval<T>& a, const Interval<T>& b)
+{
+    return !(a < b) && !(b < a);
+}
+
+template <typename T>
+bool operator!=(const Interval<T>& a, const Interval<T>& b)
+{
+    return !(a == b);
+}
+
+template <typename T>
+std::ostream& operator<<(std::ostream& out, const Interval<T>& interval)
+{
+    return out << '[' << interval.start << ", " << interval.end << ']';
+}
+
+/**
+* Monoid for IntervalTree: the largest end point of the intervals in a
+* subtree.
+*/
+template <typename T>
+struct IntervalMaxEnd
+{
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    static T combine(const T& a, const T& b) { return (a < b) ? b : a; }
+    template<typename Value>
+    static T lift(const Interval<T>& interval, const Value&) { return interval.end; }
+};
+
+/**
+* An AVLTree keyed by closed intervals [start, end], where
+* each subtree knows its largest end point. A subtree whose largest end is
+* before the query, or whose smallest start is after it, is skipped whole.
+* The intervals that start inside the query window form one key range and
+* cost O(1) each, so a query whose results all start there costs
+* O(log n + k) for k results. Each result that starts before the window
+* can cost a path of its own to find, though, because the largest end only
+* says that a subtree holds a result somewhere, so the worst case is
+* O(log n + k log(n / k)), which is O(min(n, k log n)).
+*
+* Intervals with the same start and end are one key; inserting it again
+* overwrites the value.
+*/
+template <class T, class Value>
+class IntervalTree : public AugmentedAVLTree<Interval<T>, Value, IntervalMaxEnd<T> >
+{
+public:
+    typedef AugAVLNode<Interval<T>, Value, IntervalMaxEnd<T> > IntervalNode;
+
+    void insertInterval(const T& start, const T& end, const Value& value);
+
+    template<typename Fn>
+    void forEachOverlap(const T& lo, const T& hi, Fn fn) const;
+    std::vector<std::pair<Interval<T>, Value> > overlaps(const T& lo, const T& hi) const;
+    std::vector<std::pair<Interval<T>, Value> > stab(const T& point) const;
+    template<typename Fn>
+    void stabBatch(const std::vector<T>& points, Fn fn) const;
+
+protected:
+    // Helper functions
+    template<typename Fn>
+    static void overlapHelper(IntervalNode* node, const T& lo, const T& hi, Fn& fn);
+    template<typename Fn>
+    static void stabHelper(IntervalNode* node, const std::vector<std::pair<T, size_t> >& points,
+                           size_t first, size_t last, Fn& fn);
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the IntervalTree class.
+  ---------------------------------------------
+*/
+
+template<class T, class Value>
+void IntervalTree<T, Value>::insertInterval(const T& start, const T& end, const Value& value)
+{
+    if (end < start) {
+        throw std::invalid_argument("IntervalTree: interval ends before it starts");
+    }
+    this->insert(std::make_pair(Interval<T>(start, end), value));
+}
+
+/*
+ * Helper that visits the overlapping intervals under node in key order.
+ * Every node it enters either overlaps, lies on the path to lo or hi, or
+ * has a largest end of at least lo and so leads to an overlap that starts
+ * before lo; the last kind is what can cost up to a path per result.
+ * Recursion depth is bounded by the tree height.
+ */
+template<class T, class Value>
+template<typename Fn>
+void IntervalTree<T, Value>::overlapHelper(IntervalNode* node, const T& lo, const T& hi, Fn& fn)
+{
+    if (node == nullptr || node->getAggregate() < lo) { //Everything here ends before lo
+        return;
+    }
+    overlapHelper(node->getLeft(), lo, hi, fn);
+    if (hi < node->getKey().start) { //This and everything to the right starts after hi
+        return;
+    }
+    if (!(node->getKey().end < lo)) {
+        fn(node->getKey(), node->getValue());
+    }
+    overlapHelper(node->getRight(), lo, hi, fn);
+}
+
+/**
+* Calls fn(interval, value) for every interval that overlaps [lo, hi], in
+* key order.
+*/
+template<class T, class Value>
+template<typename Fn>
+void IntervalTree<T, Value>::forEachOverlap(const T& lo, const T& hi, Fn fn) const
+{
+    overlapHelper(this->getRoot(), lo, hi, fn);
+}
+
+template<class T, class Value>
+std::vector<std::pair<Interval<T>, Value> >
+IntervalTree<T, Value>::overlaps(const T& lo, const T& hi) const
+{
+    std::vector<std::pair<Interval<T>, Value> > found;
+    forEachOverlap(lo, hi, [&found](const Interval<T>& interval, const Value& value) {
+        found.push_back(std::make_pair(interval, value));
+    });
+    return found;
+}
+
+/**
+* Every interval containing point.
+*/
+template<class T, class Value>
+std::vector<std::pair<Interval<T>, Value> >
+IntervalTree<T, Value>::stab(const T& point) const
+{
+    return overlaps(point, point);
+}
+
+/*
+ * Helper for stabBatch: points[first, last) is sorted, and the subtree is
+ * only entered by the points that can still hit it. Points past the
+ * subtree's largest end are cut from the back, and only points at or after
+ * a node's start follow it into its right subtree (both by binary search).
+ */
+template<class T, class Value>
+template<typename Fn>
+void IntervalTree<T, Value>::stabHelper(IntervalNode* node, const std::vector<std::pair<T, size_t> >& points,
+                                        size_t first, size_t last, Fn& fn)
+{
+    if (node == nullptr) {
+        return;
+    }
+    typedef typename std::vector<std::pair<T, size_t> >::const_iterator PointIter;
+    const T& maxEnd = node->getAggregate();
+    PointIter base = points.begin();
+    last = std::upper_bound(base + first, base + last, maxEnd,
+                            [](const T& value, const std::pair<T, size_t>& point) { return value < point.first; }) - base;
+    if (first == last) {
+        return;
+    }
+
+    stabHelper(node->getLeft(), points, first, last, fn);
+
+    const Interval<T>& interval = node->getKey();
+    first = std::lower_bound(base + first, base + last, interval.start,
+                             [](const std::pair<T, size_t>& point, const T& value) { return point.first < value; }) - base;
+    for (size_t i = first; i < last && !(interval.end < points[i].first); ++i) {
+        fn(points[i].second, interval, node->getValue());
+    }
+    stabHelper(node->getRight(), points, first, last, fn);
+}
+
+/**
+* Stabs the tree with a whole batch of points in one traversal: calls
+* fn(pointIndex, interval, value) for every interval containing
+* points[pointIndex]. Each subtree is visited once for all the points that
+* can reach it, instead of once per point.
+*/
+template<class T, class Value>
+template<typename Fn>
+void IntervalTree<T, Value>::stabBatch(const std::vector<T>& points, Fn fn) const
+{
+    std::vector<std::pair<T, size_t> > sorted(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        sorted[i] = std::make_pair(points[i], i);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    stabHelper(this->getRoot(), sorted, 0, sorted.size(), fn);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the IntervalTree class.
+  ---------------------------------------------
+*/
+
+#endif
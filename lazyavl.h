@@ -0,0 +1,348 @@
+#ifndef LAZYAVL_H
+#define LAZYAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVLTree whose removes are lazy: remove() finds the node and marks it
+* dead, with no nodeSwap, no unlink and no removeFix rotations, so it costs
+* one descent. Lookups and iteration skip dead nodes, and inserting a dead
+* key revives its node in place.
+*
+* Once dead nodes make up more than maxDeadFraction of the tree, the remove
+* that crossed the line compacts it: one in-order sweep frees the dead nodes
+* and relinks the live ones into a perfectly balanced tree, O(n) for the
+* whole batch of tombstones. A caller that cannot take that pause on its
+* latency path can pass a fraction of 1 or more and call compact() from
+* idle time instead.
+*
+* The AVLTree interface is inherited as protected because its iterators and
+* lookups would show the dead nodes.
+*/
+template <class Key, class Value>
+class LazyAVLTree : protected AVLTree<Key, Value>
+{
+public:
+    explicit LazyAVLTree(double maxDeadFraction = 0.25);
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class LazyAVLTree<Key, Value>;
+        explicit iterator(AVLNode<Key, Value>* ptr);
+        void skipDead();
+
+        AVLNode<Key, Value>* current_;
+    };
+
+    void insert(const std::pair<const Key, Value>& new_item);
+    void remove(const Key& key);
+    void compact();
+    void clear();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+    size_t size() const;
+    size_t tombstones() const;
+    bool empty() const;
+    using BinarySearchTree<Key, Value>::isBalanced;
+
+protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+
+    // Helper functions
+    AVLNode<Key, Value>* liveNode(const Key& key) const;
+
+    double maxDeadFraction_;
+    size_t nodes_;   // linked nodes, live and dead
+    size_t dead_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LazyAVLTree::iterator class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::iterator::iterator() :
+    current_(nullptr)
+{
+
+}
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::iterator::iterator(AVLNode<Key, Value>* ptr) :
+    current_(ptr)
+{
+    skipDead();
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::iterator::skipDead()
+{
+    while (current_ != nullptr && current_->isDead()) {
+        current_ = static_cast<AVLNode<Key, Value>*>(LazyAVLTree::successor(current_));
+    }
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& LazyAVLTree<Key, Value>::iterator::operator*() const
+{
+    return current_->getItem();
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>* LazyAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(current_->getItem());
+}
+
+template<class Key, class Value>
+bool LazyAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<class Key, class Value>
+bool LazyAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator&
+LazyAVLTree<Key, Value>::iterator::operator++()
+{
+    current_ = static_cast<AVLNode<Key, Value>*>(LazyAVLTree::successor(current_));
+    skipDead();
+    return *this;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the LazyAVLTree::iterator class.
+  ---------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LazyAVLTree class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+LazyAVLTree<Key, Value>::LazyAVLTree(double maxDeadFraction) :
+    maxDeadFraction_(maxDeadFraction), nodes_(0), dead_(0)
+{
+    if (!(maxDeadFraction > 0.0)) {
+        throw std::invalid_argument("LazyAVLTree maxDeadFraction must be positive");
+    }
+}
+
+//Counts every node the AVLTree links in. Not safe to call concurrently,
+//which is fine because the threaded apply_batch is not reachable here.
+template<class Key, class Value>
+AVLNode<Key, Value>* LazyAVLTree<Key, Value>::createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    nodes_++;
+    return AVLTree<Key, Value>::createNode(key, value, parent);
+}
+
+//The node holding key if it is live, else nullptr
+template<class Key, class Value>
+AVLNode<Key, Value>* LazyAVLTree<Key, Value>::liveNode(const Key& key) const
+{
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
+    return (node == nullptr || node->isDead()) ? nullptr : node;
+}
+
+/**
+* Inserts or overwrites key. A dead node for key is revived with the new
+* value instead of allocating another one. With no tombstones in the tree
+* this is a plain AVLTree insert.
+*/
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+    if (dead_ > 0) {
+        AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->internalFind(new_item.first));
+        if (node != nullptr) {
+            if (node->isDead()) {
+                node->setDead(false);
+                dead_--;
+            }
+            node->setValue(new_item.second);
+            return;
+        }
+    }
+    AVLTree<Key, Value>::insert(new_item);
+}
+
+/**
+* Marks key dead, and compacts the tree if that pushes the dead fraction
+* over the limit. Removing a missing or dead key does nothing.
+*/
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::remove(const Key& key)
+{
+    AVLNode<Key, Value>* node = liveNode(key);
+    if (node == nullptr) {
+        return;
+    }
+    node->setDead(true);
+    dead_++;
+    if ((double)dead_ > maxDeadFraction_ * (double)nodes_) {
+        compact();
+    }
+}
+
+/**
+* Frees every dead node and rebuilds the live ones into a perfectly
+* balanced tree in one linear pass. No live node is copied or moved in
+* memory, but iterators to dead nodes become invalid.
+*/
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::compact()
+{
+    if (dead_ == 0) {
+        return;
+    }
+    std::vector<AVLNode<Key, Value>*> nodes;
+    nodes.reserve(nodes_);
+    this->collectNodes(nodes);
+
+    size_t live = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i]->isDead()) {
+            delete nodes[i];
+        } else {
+            nodes[live++] = nodes[i];
+        }
+    }
+    nodes.resize(live);
+
+    int height = 0;
+    this->root_ = this->buildBalanced(nodes, 0, live, nullptr, height);
+    if (live > 0) {
+        this->min_ = nodes.front();
+        this->max_ = nodes.back();
+    }
+    nodes_ = live;
+    dead_ = 0;
+}
+
+template<class Key, class Value>
+void LazyAVLTree<Key, Value>::clear()
+{
+    BinarySearchTree<Key, Value>::clear();
+    nodes_ = 0;
+    dead_ = 0;
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::begin() const
+{
+    return iterator(static_cast<AVLNode<Key, Value>*>(this->getSmallestNode()));
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::end() const
+{
+    return iterator();
+}
+
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(liveNode(key));
+}
+
+/**
+* Iterator to the first live item whose key is not less than key.
+*/
+template<class Key, class Value>
+typename LazyAVLTree<Key, Value>::iterator
+LazyAVLTree<Key, Value>::lower_bound(const Key& key) const
+{
+    AVLNode<Key, Value>* currentNode = this->getRoot();
+    AVLNode<Key, Value>* candidate = nullptr;
+
+    while (currentNode != nullptr) {
+        if (currentNode->getKey() < key) {
+            currentNode = currentNode->getRight();
+        } else {
+            candidate = currentNode;
+            currentNode = currentNode->getLeft();
+        }
+    }
+    return iterator(candidate);
+}
+
+/**
+* Throws std::out_of_range if key is missing or dead.
+*/
+template<class Key, class Value>
+Value const & LazyAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    AVLNode<Key, Value>* node = liveNode(key);
+    if (node == nullptr) {
+        throw std::out_of_range("Invalid key");
+    }
+    return node->getValue();
+}
+
+/**
+* Live items, in O(1).
+*/
+template<class Key, class Value>
+size_t LazyAVLTree<Key, Value>::size() const
+{
+    return nodes_ - dead_;
+}
+
+/**
+* Dead nodes waiting for the next compaction.
+*/
+template<class Key, class Value>
+size_t LazyAVLTree<Key, Value>::tombstones() const
+{
+    return dead_;
+}
+
+template<class Key, class Value>
+bool LazyAVLTree<Key, Value>::empty() const
+{
+    return nodes_ == dead_;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the LazyAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,482 @@
+#ifndef MMAPBST_H
+#define MMAPBST_H
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bst.h"
+
+/**
+* On-disk layout of a memory-mapped search tree.
+*
+* The file starts with a fixed size header followed by an array of nodes.
+* Nodes refer to each other by their byte offset from the start of the
+* mapping instead of by pointer, so the same file can be mapped at any
+* address, by any number of processes. Offset 0 is the header, so it
+* doubles as the "null" link.
+*/
+struct MmapHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeSize;
+    uint64_t count;
+    uint64_t root;
+    char reserved[32];  // pads the header out to a cache line
+};
+
+template <typename Key, typename Value>
+struct MmapNode
+{
+    Key key;
+    Value value;
+    uint64_t parent;
+    uint64_t left;
+    uint64_t right;
+};
+
+static const char MMAP_MAGIC[8] = { 'B', 'S', 'T', 'M', 'M', 'A', 'P', '\0' };
+static const uint32_t MMAP_VERSION = 1;
+
+/**
+* A read-only search tree that lives in an mmap'd file written by writeMmapTree().
+* Opening only maps the file and checks the header, so it is O(1) and pages are
+* faulted in lazily as lookups touch them. The mapping is shared, so several
+* processes reading the same file share one copy in the page cache.
+*
+* Key and Value must be trivially copyable, since they are stored as raw bytes.
+*/
+template <typename Key, typename Value>
+class MmapTree
+{
+    static_assert(std::is_trivially_copyable<Key>::value, "MmapTree keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "MmapTree values must be trivially copyable");
+    static_assert(alignof(MmapNode<Key, Value>) <= sizeof(MmapHeader), "MmapNode alignment exceeds the header size");
+
+public:
+    MmapTree();
+    explicit MmapTree(const std::string& path);
+    ~MmapTree();
+
+    void open(const std::string& path);
+    void close();
+    bool empty() const;
+    size_t size() const;
+
+public:
+    /**
+    * Read-only iterator over the mapped nodes. Dereferencing yields a pair of
+    * references into the mapping, so it->first and it->second work the same
+    * way as they do for BinarySearchTree::iterator.
+    */
+    class iterator
+    {
+    public:
+        typedef std::pair<const Key&, const Value&> reference;
+
+        iterator();
+
+        reference operator*() const;
+        const reference* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class MmapTree<Key, Value>;
+        iterator(const MmapTree<Key, Value>* tree, uint64_t offset);
+        const MmapTree<Key, Value>* tree_;
+        uint64_t current_;
+        mutable typename std::aligned_storage<sizeof(reference), alignof(reference)>::type item_;  // pair operator-> points at
+    };
+
+public:
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    const MmapNode<Key, Value>* nodeAt(uint64_t offset) const;
+    uint64_t internalFind(const Key& key) const;
+
+private:
+    MmapTree(const MmapTree&);
+    MmapTree& operator=(const MmapTree&);
+
+    const char* base_;
+    size_t length_;
+    uint64_t root_;
+    uint64_t count_;
+};
+
+/*
+--------------------------------------------------
+Begin implementations for the MmapTree::iterator class.
+--------------------------------------------------
+*/
+
+template<class Key, class Value>
+MmapTree<Key, Value>::iterator::iterator() :
+    tree_(nullptr), current_(0)
+{
+
+}
+
+template<class Key, class Value>
+MmapTree<Key, Value>::iterator::iterator(const MmapTree<Key, Value>* tree, uint64_t offset) :
+    tree_(tree), current_(offset)
+{
+
+}
+
+template<class Key, class Value>
+typename MmapTree<Key, Value>::iterator::reference
+MmapTree<Key, Value>::iterator::operator*() const
+{
+    const MmapNode<Key, Value>* node = tree_->nodeAt(current_);
+    return reference(node->key, node->value);
+}
+
+template<class Key, class Value>
+const typename MmapTree<Key, Value>::iterator::reference*
+MmapTree<Key, Value>::iterator::operator->() const
+{
+    //A pair of references is not assignable, so construct it in place
+    return new (&item_) reference(**this);
+}
+
+template<class Key, class Value>
+bool MmapTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<class Key, class Value>
+bool MmapTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+/**
+* Same in-order successor walk as BinarySearchTree::iterator, but following offsets.
+*/
+template<class Key, class Value>
+typename MmapTree<Key, Value>::iterator&
+MmapTree<Key, Value>::iterator::operator++()
+{
+    const MmapNode<Key, Value>* node = tree_->nodeAt(current_);
+    if (node->right != 0) { //Leftmost node of the right subtree
+        current_ = node->right;
+        while (tree_->nodeAt(current_)->left != 0) {
+            current_ = tree_->nodeAt(current_)->left;
+        }
+    } else { //Climb until we come up from a left child
+        uint64_t parent = node->parent;
+        while (parent != 0 && tree_->nodeAt(parent)->right == current_) {
+            current_ = parent;
+            parent = tree_->nodeAt(parent)->parent;
+        }
+        current_ = parent;
+    }
+    return *this;
+}
+
+/*
+--------------------------------------------------
+End implementations for the MmapTree::iterator class.
+--------------------------------------------------
+*/
+
+/*
+-----------------------------------------
+Begin implementations for the MmapTree class.
+-----------------------------------------
+*/
+
+template<class Key, class Value>
+MmapTree<Key, Value>::MmapTree() :
+    base_(nullptr), length_(0), root_(0), count_(0)
+{
+
+}
+
+template<class Key, class Value>
+MmapTree<Key, Value>::MmapTree(const std::string& path) :
+    base_(nullptr), length_(0), root_(0), count_(0)
+{
+    open(path);
+}
+
+template<class Key, class Value>
+MmapTree<Key, Value>::~MmapTree()
+{
+    close();
+}
+
+/**
+* Maps the file and validates its header. Nothing else is read, so the cost
+* does not depend on the number of nodes.
+*/
+template<class Key, class Value>
+void MmapTree<Key, Value>::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("MmapTree: cannot open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MmapHeader)) {
+        ::close(fd);
+        throw std::runtime_error("MmapTree: file too small " + path);
+    }
+
+    void* mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); //The mapping keeps its own reference to the file
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("MmapTree: mmap failed for " + path);
+    }
+
+    const MmapHeader* header = static_cast<const MmapHeader*>(mapping);
+    uint64_t expected = sizeof(MmapHeader) + header->count * sizeof(MmapNode<Key, Value>);
+    if (std::memcmp(header->magic, MMAP_MAGIC, sizeof(MMAP_MAGIC)) != 0 ||
+        header->version != MMAP_VERSION ||
+        header->nodeSize != sizeof(MmapNode<Key, Value>) ||
+        expected != (uint64_t)st.st_size) {
+        munmap(mapping, (size_t)st.st_size);
+        throw std::runtime_error("MmapTree: bad header in " + path);
+    }
+
+    //Lookups jump around the file, so readahead mostly wastes I/O
+    madvise(mapping, (size_t)st.st_size, MADV_RANDOM);
+
+    base_ = static_cast<const char*>(mapping);
+    length_ = (size_t)st.st_size;
+    root_ = header->root;
+    count_ = header->count;
+}
+
+template<class Key, class Value>
+void MmapTree<Key, Value>::close()
+{
+    if (base_ != nullptr) {
+        munmap(const_cast<char*>(base_), length_);
+    }
+    base_ = nullptr;
+    length_ = 0;
+    root_ = 0;
+    count_ = 0;
+}
+
+template<class Key, class Value>
+bool MmapTree<Key, Value>::empty() const
+{
+    return root_ == 0;
+}
+
+template<class Key, class Value>
+size_t MmapTree<Key, Value>::size() const
+{
+    return (size_t)count_;
+}
+
+template<class Key, class Value>
+const MmapNode<Key, Value>* MmapTree<Key, Value>::nodeAt(uint64_t offset) const
+{
+    return reinterpret_cast<const MmapNode<Key, Value>*>(base_ + offset);
+}
+
+template<class Key, class Value>
+typename MmapTree<Key, Value>::iterator
+MmapTree<Key, Value>::begin() const
+{
+    uint64_t current = root_;
+    while (current != 0 && nodeAt(current)->left != 0) {
+        current = nodeAt(current)->left;
+    }
+    return iterator(this, current);
+}
+
+template<class Key, class Value>
+typename MmapTree<Key, Value>::iterator
+MmapTree<Key, Value>::end() const
+{
+    return iterator(this, 0);
+}
+
+template<class Key, class Value>
+uint64_t MmapTree<Key, Value>::internalFind(const Key& key) const
+{
+    uint64_t current = root_;
+    while (current != 0) {
+        const MmapNode<Key, Value>* node = nodeAt(current);
+        if (key < node->key) {
+            current = node->left;
+        } else if (node->key < key) {
+            current = node->right;
+        } else {
+            return current;
+        }
+    }
+    return 0;
+}
+
+template<class Key, class Value>
+typename MmapTree<Key, Value>::iterator
+MmapTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(this, internalFind(key));
+}
+
+template<class Key, class Value>
+typename MmapTree<Key, Value>::iterator
+MmapTree<Key, Value>::lower_bound(const Key& key) const
+{
+    uint64_t current = root_;
+    uint64_t candidate = 0;
+    while (current != 0) {
+        const MmapNode<Key, Value>* node = nodeAt(current);
+        if (node->key < key) {
+            current = node->right;
+        } else {
+            candidate = current;
+            current = node->left;
+        }
+    }
+    return iterator(this, candidate);
+}
+
+template<class Key, class Value>
+typename MmapTree<Key, Value>::iterator
+MmapTree<Key, Value>::upper_bound(const Key& key) const
+{
+    uint64_t current = root_;
+    uint64_t candidate = 0;
+    while (current != 0) {
+        const MmapNode<Key, Value>* node = nodeAt(current);
+        if (key < node->key) {
+            candidate = current;
+            current = node->left;
+        } else {
+            current = node->right;
+        }
+    }
+    return iterator(this, candidate);
+}
+
+template<class Key, class Value>
+Value const & MmapTree<Key, Value>::operator[](const Key& key) const
+{
+    uint64_t offset = internalFind(key);
+    if(offset == 0) throw std::out_of_range("Invalid key");
+    return nodeAt(offset)->value;
+}
+
+/*
+---------------------------------------
+End implementations for the MmapTree class.
+---------------------------------------
+*/
+
+/**
+* Offline writer: emits the contents of an in-memory tree (e.g. an AVLTree) as a
+* file MmapTree can open. The nodes are laid out as a perfectly balanced tree in
+* breadth-first order, so the top levels that every lookup touches share the
+* first few pages. The file is written next to path and renamed into place, so
+* readers that already have the old file mapped are not disturbed.
+*/
+template <typename Key, typename Value>
+void writeMmapTree(const BinarySearchTree<Key, Value>& tree, const std::string& path)
+{
+    static_assert(std::is_trivially_copyable<Key>::value, "MmapTree keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "MmapTree values must be trivially copyable");
+
+    std::vector<const std::pair<const Key, Value>*> items;
+    for (typename BinarySearchTree<Key, Value>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        items.push_back(&(*it));
+    }
+
+    //Breadth-first walk over [lo, hi) ranges of the sorted items; the middle
+    //item of each range becomes the node and the halves become its children.
+    struct Range { size_t lo; size_t hi; uint64_t parent; bool isLeft; };
+    const uint64_t nodeSize = sizeof(MmapNode<Key, Value>);
+    std::vector<MmapNode<Key, Value> > nodes(items.size());
+    std::vector<Range> queue;
+    if (!items.empty()) {
+        Range whole = { 0, items.size(), 0, false };
+        queue.push_back(whole);
+    }
+    for (size_t next = 0; next < queue.size(); ++next) {
+        Range r = queue[next];
+        size_t mid = r.lo + (r.hi - r.lo) / 2;
+        uint64_t offset = sizeof(MmapHeader) + next * nodeSize;
+
+        MmapNode<Key, Value>& node = nodes[next];
+        std::memset(&node, 0, sizeof(node)); //Keep padding bytes deterministic
+        node.key = items[mid]->first;
+        node.value = items[mid]->second;
+        node.parent = r.parent;
+        node.left = 0;
+        node.right = 0;
+        if (r.parent != 0) {
+            MmapNode<Key, Value>& parent = nodes[(r.parent - sizeof(MmapHeader)) / nodeSize];
+            if (r.isLeft) {
+                parent.left = offset;
+            } else {
+                parent.right = offset;
+            }
+        }
+
+        if (r.lo < mid) {
+            Range left = { r.lo, mid, offset, true };
+            queue.push_back(left);
+        }
+        if (mid + 1 < r.hi) {
+            Range right = { mid + 1, r.hi, offset, false };
+            queue.push_back(right);
+        }
+    }
+
+    MmapHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MMAP_MAGIC, sizeof(MMAP_MAGIC));
+    header.version = MMAP_VERSION;
+    header.nodeSize = (uint32_t)nodeSize;
+    header.count = nodes.size();
+    header.root = nodes.empty() ? 0 : sizeof(MmapHeader);
+
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("writeMmapTree: cannot create " + tmpPath);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!nodes.empty()) {
+        out.write(reinterpret_cast<const char*>(&nodes[0]), nodes.size() * nodeSize);
+    }
+    out.close();
+    if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("writeMmapTree: failed writing " + path);
+    }
+}
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef PARALLELSCAN_H
+#define PARALLELSCAN_H
+
+#include <exception>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "bst.h"
+
+/*
+* parallel_for_each and parallel_reduce over a BinarySearchTree (and so
+* any tree built on it), kept out of bst.h so that only the files that run
+* parallel scans pull in the threading headers. Both are free functions
+* declared and defined only here.
+*/
+
+/*
+ * The chunking and the worker pool behind the parallel scans. A friend of
+ * BinarySearchTree so that it can start from root_; not meant to be used
+ * directly.
+ */
+template <typename Key, typename Value>
+class ParallelScan
+{
+public:
+    struct Chunk
+    {
+        Chunk(Node<Key, Value>* n, bool s) : node(n), subtree(s) { }
+
+        Node<Key, Value>* node;
+        bool subtree;   // the whole subtree under node, or node alone
+    };
+
+    static Node<Key, Value>* root(const BinarySearchTree<Key, Value>& tree) { return tree.root_; }
+    static double estimateSize(Node<Key, Value>* node, uint64_t& seed);
+    static void partitionChunks(Node<Key, Value>* root, std::vector<Chunk>& chunks, unsigned threads);
+    template<class Function>
+    static void walkChunk(const Chunk& chunk, Function& fn);
+    template<class Task>
+    static void runChunks(size_t count, unsigned threads, Task& task);
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ParallelScan class.
+  ---------------------------------------------
+*/
+
+/*
+ * Knuth's estimate of the size of the subtree under node. A few random
+ * root-to-leaf probes each multiply up the number of children seen at
+ * every level; for a balanced subtree one probe is exact, and a skewed one
+ * costs only O(depth) per probe.
+ */
+template<typename Key, typename Value>
+double ParallelScan<Key, Value>::estimateSize(Node<Key, Value>* node, uint64_t& seed)
+{
+    const int probes = 4;
+    double total = 0;
+    for (int probe = 0; probe < probes; ++probe) {
+        double weight = 1;
+        double estimate = 1;
+        Node<Key, Value>* current = node;
+        while (current != nullptr) {
+            Node<Key, Value>* left = current->getLeft();
+            Node<Key, Value>* right = current->getRight();
+            if (left == nullptr && right == nullptr) {
+                break;
+            }
+            if (left != nullptr && right != nullptr) {
+                weight *= 2;
+                seed ^= seed << 13; //xorshift
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                current = (seed & 1) ? left : right;
+            } else {
+                current = (left != nullptr) ? left : right;
+            }
+            estimate += weight;
+        }
+        total += estimate;
+    }
+    return total / probes;
+}
+
+/*
+ * Cuts the tree under root into about 8 chunks per thread, listed in key
+ * order, by repeatedly splitting the largest estimated subtree into its
+ * left subtree, its root alone and its right subtree. Leaves chunks empty
+ * when the tree is too small to be worth handing to more than one thread.
+ */
+template<typename Key, typename Value>
+void ParallelScan<Key, Value>::partitionChunks(Node<Key, Value>* root, std::vector<Chunk>& chunks, unsigned threads)
+{
+    const double minChunk = 512;
+    chunks.clear();
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    if (root == nullptr || threads < 2 || estimateSize(root, seed) < 2 * minChunk * threads) {
+        return;
+    }
+
+    std::vector<double> sizes;
+    chunks.push_back(Chunk(root, true));
+    sizes.push_back(estimateSize(root, seed));
+    while (chunks.size() < 8 * (size_t)threads) {
+        size_t largest = 0;
+        for (size_t i = 1; i < chunks.size(); ++i) {
+            if (sizes[i] > sizes[largest]) {
+                largest = i;
+            }
+        }
+        if (sizes[largest] < minChunk) {
+            break;
+        }
+
+        Node<Key, Value>* node = chunks[largest].node;
+        std::vector<Chunk> parts;
+        std::vector<double> partSizes;
+        if (node->getLeft() != nullptr) {
+            parts.push_back(Chunk(node->getLeft(), true));
+            partSizes.push_back(estimateSize(node->getLeft(), seed));
+        }
+        parts.push_back(Chunk(node, false));
+        partSizes.push_back(0); //Never split again
+        if (node->getRight() != nullptr) {
+            parts.push_back(Chunk(node->getRight(), true));
+            partSizes.push_back(estimateSize(node->getRight(), seed));
+        }
+        chunks.erase(chunks.begin() + largest);
+        chunks.insert(chunks.begin() + largest, parts.begin(), parts.end());
+        sizes.erase(sizes.begin() + largest);
+        sizes.insert(sizes.begin() + largest, partSizes.begin(), partSizes.end());
+    }
+}
+
+/*
+ * Calls fn on every item of chunk in key order, always as a const item so
+ * that a scan cannot write into the tree. Uses an explicit stack rather
+ * than parent pointers, so a scan touches each node once and never climbs
+ * back up.
+ */
+template<typename Key, typename Value>
+template<class Function>
+void ParallelScan<Key, Value>::walkChunk(const Chunk& chunk, Function& fn)
+{
+    if (!chunk.subtree) {
+        const std::pair<const Key, Value>& item = chunk.node->getItem();
+        fn(item);
+        return;
+    }
+    std::vector<Node<Key, Value>*> stack;
+    Node<Key, Value>* current = chunk.node;
+    while (current != nullptr || !stack.empty()) {
+        while (current != nullptr) {
+            stack.push_back(current);
+            current = current->getLeft();
+        }
+        current = stack.back();
+        stack.pop_back();
+        const std::pair<const Key, Value>& item = current->getItem();
+        fn(item);
+        current = current->getRight();
+    }
+}
+
+/*
+ * Runs task(0) .. task(count - 1) on threads workers, the calling thread
+ * being one of them. Each worker starts with a contiguous run of chunks and
+ * takes them from the front; a worker that runs dry steals from the back
+ * of another's run, so a skewed estimate costs some stealing rather than
+ * an idle core. The first exception thrown by a task stops the others and
+ * is rethrown here.
+ */
+template<typename Key, typename Value>
+template<class Task>
+void ParallelScan<Key, Value>::runChunks(size_t count, unsigned threads, Task& task)
+{
+    struct Run
+    {
+        std::mutex lock;
+        size_t front;
+        size_t back;
+    };
+    std::vector<Run> runs(threads);
+    for (unsigned w = 0; w < threads; ++w) {
+        runs[w].front = count * w / threads;
+        runs[w].back = count * (w + 1) / threads;
+    }
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex errorLock;
+
+    auto work = [&](unsigned self) {
+        while (!failed.load(std::memory_order_relaxed)) {
+            bool found = false;
+            size_t index = 0;
+            for (unsigned i = 0; i < threads && !found; ++i) {
+                unsigned victim = (self + i) % threads;
+                std::lock_guard<std::mutex> guard(runs[victim].lock);
+                if (runs[victim].front < runs[victim].back) {
+                    index = (victim == self) ? runs[victim].front++ : --runs[victim].back;
+                    found = true;
+                }
+            }
+            if (!found) {
+                return;
+            }
+            try {
+                task(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(errorLock);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned w = 1; w < threads; ++w) {
+        workers.push_back(std::thread(work, w));
+    }
+    work(0);
+    for (size_t w = 0; w < workers.size(); ++w) {
+        workers[w].join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ParallelScan class.
+  ---------------------------------------------
+*/
+
+/**
+* Calls fn(const std::pair<const Key, Value>& item) once for every item of
+* tree, from threads threads at once (0 picks the hardware thread count),
+* in no particular order. fn must be safe to call concurrently, and the
+* tree must not change during the scan. Small trees, and threads == 1, are
+* scanned on the calling thread.
+*/
+template<typename Key, typename Value, class Function>
+void parallel_for_each(const BinarySearchTree<Key, Value>& tree, Function fn, unsigned threads = 0)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    typedef ParallelScan<Key, Value> Scan;
+    std::vector<typename Scan::Chunk> chunks;
+    Scan::partitionChunks(Scan::root(tree), chunks, threads);
+    if (chunks.empty()) {
+        if (Scan::root(tree) != nullptr) {
+            Scan::walkChunk(typename Scan::Chunk(Scan::root(tree), true), fn);
+        }
+        return;
+    }
+    auto task = [&](size_t index) {
+        Scan::walkChunk(chunks[index], fn);
+    };
+    Scan::runChunks(chunks.size(), threads, task);
+}
+
+/**
+* Folds every item of tree into a T in parallel: each chunk starts from
+* identity and folds its items in key order with acc = accumulate(acc,
+* item), then the chunk results are joined left to right with
+* combine(left, right). The result is therefore in key order, the same as
+* a sequential std::accumulate over the tree, as long as combine is
+* associative with identity as its unit; combine need not be commutative.
+* Same threading rules as parallel_for_each.
+*/
+template<typename Key, typename Value, class T, class Accumulate, class Combine>
+T parallel_reduce(const BinarySearchTree<Key, Value>& tree, const T& identity, Accumulate accumulate,
+                  Combine combine, unsigned threads = 0)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    typedef ParallelScan<Key, Value> Scan;
+    std::vector<typename Scan::Chunk> chunks;
+    Scan::partitionChunks(Scan::root(tree), chunks, threads);
+    if (chunks.empty()) {
+        T result = identity;
+        auto fold = [&](const std::pair<const Key, Value>& item) {
+            result = accumulate(result, item);
+        };
+        if (Scan::root(tree) != nullptr) {
+            Scan::walkChunk(typename Scan::Chunk(Scan::root(tree), true), fold);
+        }
+        return result;
+    }
+
+    //A deque so that each chunk writes a separate object, even for T = bool
+    std::deque<T> partial(chunks.size(), identity);
+    auto task = [&](size_t index) {
+        T result = identity;
+        auto fold = [&](const std::pair<const Key, Value>& item) {
+            result = accumulate(result, item);
+        };
+        Scan::walkChunk(chunks[index], fold);
+        partial[index] = result;
+    };
+    Scan::runChunks(chunks.size(), threads, task);
+
+    T result = identity;
+    for (size_t i = 0; i < partial.size(); ++i) {
+        result = combine(result, partial[i]);
+    }
+    return result;
+}
+
+#endif
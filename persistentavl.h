@@ -0,0 +1,524 @@
+#ifndef PERSISTENTAVL_H
+#define PERSISTENTAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+/**
+* An immutable node for a PersistentAVLTree. Children are shared pointers so
+* that every version of the tree can share the subtrees it did not change,
+* and a subtree is freed when the last version using it goes away. There is
+* no parent pointer, since a shared node has one parent per version, and the
+* node stores its height rather than a balance factor so it never needs
+* updating after it is built.
+*/
+template <typename Key, typename Value>
+class PersistentAVLNode
+{
+public:
+    typedef std::shared_ptr<const PersistentAVLNode<Key, Value> > Ptr;
+
+    PersistentAVLNode(const Key& key, const Value& value, const Ptr& left, const Ptr& right);
+
+    const std::pair<const Key, Value>& getItem() const;
+    const Key& getKey() const;
+    const Value& getValue() const;
+    const Ptr& getLeft() const;
+    const Ptr& getRight() const;
+    int getHeight() const;
+
+protected:
+    std::pair<const Key, Value> item_;
+    Ptr left_;
+    Ptr right_;
+    int height_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the PersistentAVLNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+PersistentAVLNode<Key, Value>::PersistentAVLNode(const Key& key, const Value& value, const Ptr& left, const Ptr& right) :
+    item_(key, value), left_(left), right_(right),
+    height_(1 + std::max(left ? left->getHeight() : 0, right ? right->getHeight() : 0))
+{
+
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& PersistentAVLNode<Key, Value>::getItem() const
+{
+    return item_;
+}
+
+template<class Key, class Value>
+const Key& PersistentAVLNode<Key, Value>::getKey() const
+{
+    return item_.first;
+}
+
+template<class Key, class Value>
+const Value& PersistentAVLNode<Key, Value>::getValue() const
+{
+    return item_.second;
+}
+
+template<class Key, class Value>
+const typename PersistentAVLNode<Key, Value>::Ptr& PersistentAVLNode<Key, Value>::getLeft() const
+{
+    return left_;
+}
+
+template<class Key, class Value>
+const typename PersistentAVLNode<Key, Value>::Ptr& PersistentAVLNode<Key, Value>::getRight() const
+{
+    return right_;
+}
+
+template<class Key, class Value>
+int PersistentAVLNode<Key, Value>::getHeight() const
+{
+    return height_;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the PersistentAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A persistent AVL tree: insert() and remove() never modify a node. They copy
+* the O(log n) path from the root to the change (plus the nodes a rotation
+* touches) and point the tree at the new root, so every older root still
+* sees exactly the tree it had. A version is just a root handle and a size,
+* which makes snapshot() O(1); nodes are reference counted and freed once no
+* version reaches them.
+*
+* A snapshot is an ordinary PersistentAVLTree that can be read, iterated or
+* even written to without affecting the tree it came from. Nodes are never
+* written after they are built and the reference counts are atomic, so
+* snapshots can be read on other threads while this tree keeps taking
+* writes. Taking the snapshot itself reads this tree's root, so it has to
+* happen on the writing thread (or under the writer's lock).
+*
+* Iterators point into one version. They stay valid as long as some tree or
+* snapshot still holds that version, and do not keep it alive themselves.
+*/
+template <class Key, class Value>
+class PersistentAVLTree
+{
+public:
+    typedef PersistentAVLNode<Key, Value> PNode;
+    typedef typename PNode::Ptr Ptr;
+
+    PersistentAVLTree();
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class PersistentAVLTree<Key, Value>;
+        void pushLeftSpine(const PNode* node);
+
+        std::vector<const PNode*> path_;  // nodes still to visit, next one on top
+    };
+
+    void insert(const std::pair<const Key, Value>& new_item);
+    void remove(const Key& key);
+    void clear();
+    PersistentAVLTree snapshot() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+    size_t size() const;
+    bool empty() const;
+    int height() const;
+    bool isBalanced() const;
+
+protected:
+    // Helper functions
+    static int heightOf(const Ptr& node);
+    static Ptr makeNode(const Key& key, const Value& value, const Ptr& left, const Ptr& right);
+    static Ptr balance(const Key& key, const Value& value, const Ptr& left, const Ptr& right);
+    Ptr insertAt(const Ptr& node, const std::pair<const Key, Value>& item);
+    Ptr removeAt(const Ptr& node, const Key& key);
+    static Ptr removeMin(const Ptr& node, Ptr& min);
+    static int checkBalance(const PNode* node);
+
+    Ptr root_;
+    size_t size_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the PersistentAVLTree::iterator class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::iterator::iterator()
+{
+
+}
+
+//Pushes node and its chain of left children, so the smallest ends on top
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::iterator::pushLeftSpine(const PNode* node)
+{
+    while (node != nullptr) {
+        path_.push_back(node);
+        node = node->getLeft().get();
+    }
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& PersistentAVLTree<Key, Value>::iterator::operator*() const
+{
+    return path_.back()->getItem();
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>* PersistentAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(path_.back()->getItem());
+}
+
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    if (path_.empty() || rhs.path_.empty()) {
+        return path_.empty() == rhs.path_.empty();
+    }
+    return path_.back() == rhs.path_.back();
+}
+
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Without parent pointers the iterator keeps the ancestors it still has to
+* visit; the successor is the left spine of the right child, or else the
+* nearest ancestor we went left from.
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator&
+PersistentAVLTree<Key, Value>::iterator::operator++()
+{
+    const PNode* node = path_.back();
+    path_.pop_back();
+    pushLeftSpine(node->getRight().get());
+    return *this;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the PersistentAVLTree::iterator class.
+  ---------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+PersistentAVLTree<Key, Value>::PersistentAVLTree() :
+    root_(), size_(0)
+{
+
+}
+
+template<class Key, class Value>
+int PersistentAVLTree<Key, Value>::heightOf(const Ptr& node)
+{
+    return node ? node->getHeight() : 0;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Ptr
+PersistentAVLTree<Key, Value>::makeNode(const Key& key, const Value& value, const Ptr& left, const Ptr& right)
+{
+    return std::make_shared<PNode>(key, value, left, right);
+}
+
+/*
+ * Builds a node over left and right, two valid AVL trees whose heights
+ * differ by at most two, rotating if they differ by two. Rotations build new
+ * nodes too, so the children passed in are never touched.
+ */
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Ptr
+PersistentAVLTree<Key, Value>::balance(const Key& key, const Value& value, const Ptr& left, const Ptr& right)
+{
+    int leftHeight = heightOf(left);
+    int rightHeight = heightOf(right);
+
+    if (leftHeight > rightHeight + 1) {
+        if (heightOf(left->getLeft()) >= heightOf(left->getRight())) { //zig-zig
+            return makeNode(left->getKey(), left->getValue(), left->getLeft(),
+                            makeNode(key, value, left->getRight(), right));
+        }
+        const Ptr& middle = left->getRight(); //zig-zag
+        return makeNode(middle->getKey(), middle->getValue(),
+                        makeNode(left->getKey(), left->getValue(), left->getLeft(), middle->getLeft()),
+                        makeNode(key, value, middle->getRight(), right));
+    }
+    if (rightHeight > leftHeight + 1) {
+        if (heightOf(right->getRight()) >= heightOf(right->getLeft())) {
+            return makeNode(right->getKey(), right->getValue(),
+                            makeNode(key, value, left, right->getLeft()), right->getRight());
+        }
+        const Ptr& middle = right->getLeft();
+        return makeNode(middle->getKey(), middle->getValue(),
+                        makeNode(key, value, left, middle->getLeft()),
+                        makeNode(right->getKey(), right->getValue(), middle->getRight(), right->getRight()));
+    }
+    return makeNode(key, value, left, right);
+}
+
+//Returns the new root of node's subtree with item inserted or overwritten
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Ptr
+PersistentAVLTree<Key, Value>::insertAt(const Ptr& node, const std::pair<const Key, Value>& item)
+{
+    if (!node) {
+        size_++;
+        return makeNode(item.first, item.second, Ptr(), Ptr());
+    }
+    if (item.first < node->getKey()) {
+        return balance(node->getKey(), node->getValue(), insertAt(node->getLeft(), item), node->getRight());
+    }
+    if (node->getKey() < item.first) {
+        return balance(node->getKey(), node->getValue(), node->getLeft(), insertAt(node->getRight(), item));
+    }
+    return makeNode(item.first, item.second, node->getLeft(), node->getRight());
+}
+
+/*
+ * Returns the new root of node's subtree without key. If key is missing the
+ * same subtree comes back and nothing above it is copied.
+ */
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Ptr
+PersistentAVLTree<Key, Value>::removeAt(const Ptr& node, const Key& key)
+{
+    if (!node) {
+        return node;
+    }
+    if (key < node->getKey()) {
+        Ptr left = removeAt(node->getLeft(), key);
+        if (left == node->getLeft()) {
+            return node;
+        }
+        return balance(node->getKey(), node->getValue(), left, node->getRight());
+    }
+    if (node->getKey() < key) {
+        Ptr right = removeAt(node->getRight(), key);
+        if (right == node->getRight()) {
+            return node;
+        }
+        return balance(node->getKey(), node->getValue(), node->getLeft(), right);
+    }
+
+    size_--;
+    if (!node->getLeft()) {
+        return node->getRight();
+    }
+    if (!node->getRight()) {
+        return node->getLeft();
+    }
+    //Two children: the successor takes this node's place
+    Ptr successor;
+    Ptr right = removeMin(node->getRight(), successor);
+    return balance(successor->getKey(), successor->getValue(), node->getLeft(), right);
+}
+
+//Removes the smallest node under node, handing it back in min
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::Ptr
+PersistentAVLTree<Key, Value>::removeMin(const Ptr& node, Ptr& min)
+{
+    if (!node->getLeft()) {
+        min = node;
+        return node->getRight();
+    }
+    return balance(node->getKey(), node->getValue(), removeMin(node->getLeft(), min), node->getRight());
+}
+
+/**
+* Inserts or overwrites key in this version. Snapshots taken earlier are
+* unaffected.
+*/
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+    root_ = insertAt(root_, new_item);
+}
+
+/**
+* Removes key from this version; a missing key copies nothing.
+*/
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::remove(const Key& key)
+{
+    root_ = removeAt(root_, key);
+}
+
+template<class Key, class Value>
+void PersistentAVLTree<Key, Value>::clear()
+{
+    root_.reset();
+    size_ = 0;
+}
+
+/**
+* A point-in-time copy of this tree in O(1): it shares every node, and later
+* writes to either tree only copy the paths they change.
+*/
+template<class Key, class Value>
+PersistentAVLTree<Key, Value> PersistentAVLTree<Key, Value>::snapshot() const
+{
+    return *this;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator
+PersistentAVLTree<Key, Value>::begin() const
+{
+    iterator it;
+    it.pushLeftSpine(root_.get());
+    return it;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator
+PersistentAVLTree<Key, Value>::end() const
+{
+    return iterator();
+}
+
+/**
+* Iterator to the first item whose key is not less than key. The nodes we
+* go left from are exactly the ones the iterator still has to visit.
+*/
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator
+PersistentAVLTree<Key, Value>::lower_bound(const Key& key) const
+{
+    iterator it;
+    const PNode* node = root_.get();
+    while (node != nullptr) {
+        if (node->getKey() < key) {
+            node = node->getRight().get();
+        } else {
+            it.path_.push_back(node);
+            node = node->getLeft().get();
+        }
+    }
+    return it;
+}
+
+template<class Key, class Value>
+typename PersistentAVLTree<Key, Value>::iterator
+PersistentAVLTree<Key, Value>::find(const Key& key) const
+{
+    iterator it = lower_bound(key);
+    if (it == end() || key < it->first) {
+        return end();
+    }
+    return it;
+}
+
+/**
+* Throws std::out_of_range if key is missing.
+*/
+template<class Key, class Value>
+Value const & PersistentAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    const PNode* node = root_.get();
+    while (node != nullptr) {
+        if (key < node->getKey()) {
+            node = node->getLeft().get();
+        } else if (node->getKey() < key) {
+            node = node->getRight().get();
+        } else {
+            return node->getValue();
+        }
+    }
+    throw std::out_of_range("Invalid key");
+}
+
+template<class Key, class Value>
+size_t PersistentAVLTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::empty() const
+{
+    return size_ == 0;
+}
+
+template<class Key, class Value>
+int PersistentAVLTree<Key, Value>::height() const
+{
+    return heightOf(root_);
+}
+
+//Height of node's subtree, or -1 if a stored height or balance is wrong
+template<class Key, class Value>
+int PersistentAVLTree<Key, Value>::checkBalance(const PNode* node)
+{
+    if (node == nullptr) {
+        return 0;
+    }
+    int leftHeight = checkBalance(node->getLeft().get());
+    int rightHeight = checkBalance(node->getRight().get());
+    if (leftHeight < 0 || rightHeight < 0 || std::abs(leftHeight - rightHeight) > 1 ||
+        node->getHeight() != 1 + std::max(leftHeight, rightHeight)) {
+        return -1;
+    }
+    return node->getHeight();
+}
+
+template<class Key, class Value>
+bool PersistentAVLTree<Key, Value>::isBalanced() const
+{
+    return checkBalance(root_.get()) >= 0;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,491 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include "bst.h"
+
+/**
+* A special kind of node for a Red-Black tree. It adds no data members: the
+* colour lives in the low bit of the parent pointer, which is always zero
+* because nodes are pointer aligned. So an RBNode is exactly as big as a Node.
+*
+* Only the RBTree should link these nodes: it goes through the setParent
+* below, which keeps the colour bit, whereas Node::setParent would clear it.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    // Constructor/destructor. New nodes are red.
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+
+    // Getter/setter for the colour bit.
+    bool isRed() const;
+    void setRed(bool red);
+
+    // Getters for parent, left, and right. The parent getter masks off the
+    // colour bit; see the Node class in bst.h for more information.
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+
+    // Hides Node::setParent so relinking a node does not lose its colour.
+    void setParent(Node<Key, Value>* parent);
+
+protected:
+    static const uintptr_t RED_BIT = 1;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent)
+{
+    setRed(true);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const
+{
+    return (reinterpret_cast<uintptr_t>(this->parent_) & RED_BIT) != 0;
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::setRed(bool red)
+{
+    uintptr_t bits = reinterpret_cast<uintptr_t>(this->parent_) & ~RED_BIT;
+    this->parent_ = reinterpret_cast<Node<Key, Value>*>(bits | (red ? RED_BIT : 0));
+}
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getParent() const
+{
+    uintptr_t bits = reinterpret_cast<uintptr_t>(this->parent_) & ~RED_BIT;
+    return reinterpret_cast<RBNode<Key, Value>*>(bits);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::setParent(Node<Key, Value>* parent)
+{
+    uintptr_t colour = reinterpret_cast<uintptr_t>(this->parent_) & RED_BIT;
+    this->parent_ = reinterpret_cast<Node<Key, Value>*>(reinterpret_cast<uintptr_t>(parent) | colour);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A Red-Black tree. Insert does at most two rotations and remove at most
+* three, so unlike AVLTree::removeFix the restructuring never climbs to the
+* root (recolouring may, but that only touches the colour bits).
+*/
+template <class Key, class Value>
+class RBTree : public BinarySearchTree<Key, Value>
+{
+    static_assert(sizeof(RBNode<Key, Value>) == sizeof(Node<Key, Value>), "RBNode must not add data members");
+
+public:
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+    virtual void rebalance();
+protected:
+    virtual void nodeSwap(RBNode<Key, Value>* n1, RBNode<Key, Value>* n2);
+
+    // Helper functions
+    void insertFix(RBNode<Key, Value>* node);
+    void removeNode(RBNode<Key, Value>* node);
+    virtual void eraseNode(Node<Key, Value>* node);
+    void removeFix(RBNode<Key, Value>* node, RBNode<Key, Value>* parent);
+    void rotateLeft(RBNode<Key, Value>* node);
+    void rotateRight(RBNode<Key, Value>* node);
+    RBNode<Key, Value>* getRoot() const;
+    static bool isRed(RBNode<Key, Value>* node);
+};
+
+template<class Key, class Value>
+RBNode<Key, Value> *RBTree<Key, Value>::getRoot() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->root_);
+}
+
+//Null children count as black
+template<class Key, class Value>
+bool RBTree<Key, Value>::isRed(RBNode<Key, Value>* node)
+{
+    return node != nullptr && node->isRed();
+}
+
+//Rotate left around node; its right child takes its place
+template<class Key, class Value>
+void RBTree<Key, Value>::rotateLeft(RBNode<Key, Value>* node)
+{
+    RBNode<Key, Value>* child = node->getRight();
+    RBNode<Key, Value>* parent = node->getParent();
+
+    node->setRight(child->getLeft());
+    if (child->getLeft() != nullptr) {
+        child->getLeft()->setParent(node);
+    }
+
+    child->setParent(parent);
+    if (parent == nullptr) {
+        this->root_ = child;
+    } else if (parent->getLeft() == node) {
+        parent->setLeft(child);
+    } else {
+        parent->setRight(child);
+    }
+
+    child->setLeft(node);
+    node->setParent(child);
+}
+
+//Rotate right around node; its left child takes its place
+template<class Key, class Value>
+void RBTree<Key, Value>::rotateRight(RBNode<Key, Value>* node)
+{
+    RBNode<Key, Value>* child = node->getLeft();
+    RBNode<Key, Value>* parent = node->getParent();
+
+    node->setLeft(child->getRight());
+    if (child->getRight() != nullptr) {
+        child->getRight()->setParent(node);
+    }
+
+    child->setParent(parent);
+    if (parent == nullptr) {
+        this->root_ = child;
+    } else if (parent->getLeft() == node) {
+        parent->setLeft(child);
+    } else {
+        parent->setRight(child);
+    }
+
+    child->setRight(node);
+    node->setParent(child);
+}
+
+/*
+ * Same as the other trees: if the key is already in the tree the value is
+ * overwritten.
+ */
+template<class Key, class Value>
+void RBTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    RBNode<Key, Value>* parent = nullptr;
+    RBNode<Key, Value>* currentNode = getRoot();
+
+    while (currentNode != nullptr) {
+        if (new_item.first < currentNode->getKey()) {
+            parent = currentNode;
+            currentNode = currentNode->getLeft();
+        } else if (new_item.first > currentNode->getKey() || this->multimap_) {
+            parent = currentNode;
+            currentNode = currentNode->getRight();
+        } else {
+            currentNode->setValue(new_item.second);
+            return;
+        }
+    }
+
+    RBNode<Key, Value>* newNode = new RBNode<Key, Value>(new_item.first, new_item.second, parent);
+    if (parent == nullptr) {
+        this->root_ = newNode;
+    } else if (newNode->getKey() < parent->getKey()) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+
+    insertFix(newNode);
+}
+
+//Helper insertFix: repairs a red node with a red parent
+template<class Key, class Value>
+void RBTree<Key, Value>::insertFix(RBNode<Key, Value>* node)
+{
+    while (isRed(node->getParent())) {
+        RBNode<Key, Value>* parent = node->getParent();
+        RBNode<Key, Value>* grandparent = parent->getParent(); //Exists since the root is black
+
+        if (grandparent->getLeft() == parent) {
+            RBNode<Key, Value>* uncle = grandparent->getRight();
+            if (isRed(uncle)) { //Recolour and continue from the grandparent
+                parent->setRed(false);
+                uncle->setRed(false);
+                grandparent->setRed(true);
+                node = grandparent;
+                continue;
+            }
+            if (parent->getRight() == node) { //Zig-zag: turn it into a zig-zig
+                rotateLeft(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            rotateRight(grandparent);
+            parent->setRed(false);
+            grandparent->setRed(true);
+            break;
+        } else {
+            RBNode<Key, Value>* uncle = grandparent->getLeft();
+            if (isRed(uncle)) {
+                parent->setRed(false);
+                uncle->setRed(false);
+                grandparent->setRed(true);
+                node = grandparent;
+                continue;
+            }
+            if (parent->getLeft() == node) {
+                rotateRight(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            rotateLeft(grandparent);
+            parent->setRed(false);
+            grandparent->setRed(true);
+            break;
+        }
+    }
+    getRoot()->setRed(false);
+}
+
+/*
+ * As with the other trees, a node with 2 children is swapped with its
+ * predecessor before it is removed.
+ */
+template<class Key, class Value>
+void RBTree<Key, Value>::remove(const Key& key)
+{
+    RBNode<Key, Value>* removeNode = static_cast<RBNode<Key, Value>*>(BinarySearchTree<Key, Value>::internalFind(key));
+    if (removeNode == nullptr) {
+        return;
+    }
+    this->removeNode(removeNode);
+}
+
+template<class Key, class Value>
+void RBTree<Key, Value>::eraseNode(Node<Key, Value>* node)
+{
+    removeNode(static_cast<RBNode<Key, Value>*>(node));
+}
+
+//Helper that unlinks and deletes a node that is already known to be in the tree
+template<class Key, class Value>
+void RBTree<Key, Value>::removeNode(RBNode<Key, Value>* node)
+{
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        RBNode<Key, Value>* predNode = static_cast<RBNode<Key, Value>*>(BinarySearchTree<Key, Value>::predecessor(node));
+        nodeSwap(predNode, node);
+    }
+
+    //node now has at most one child, which takes its place
+    RBNode<Key, Value>* child = (node->getLeft() != nullptr) ? node->getLeft() : node->getRight();
+    RBNode<Key, Value>* parent = node->getParent();
+
+    if (child != nullptr) {
+        child->setParent(parent);
+    }
+    if (parent == nullptr) {
+        this->root_ = child;
+    } else if (parent->getLeft() == node) {
+        parent->setLeft(child);
+    } else {
+        parent->setRight(child);
+    }
+
+    bool removedBlack = !node->isRed();
+    delete node;
+
+    if (removedBlack) {
+        if (isRed(child)) { //A red child can simply absorb the missing black
+            child->setRed(false);
+        } else {
+            removeFix(child, parent);
+        }
+    }
+}
+
+/*
+ * Helper removeFix: node (possibly null, whose parent is then passed
+ * separately) is one black short compared to its sibling's side.
+ */
+template<class Key, class Value>
+void RBTree<Key, Value>::removeFix(RBNode<Key, Value>* node, RBNode<Key, Value>* parent)
+{
+    while (node != getRoot() && !isRed(node)) {
+        if (parent->getLeft() == node) {
+            RBNode<Key, Value>* sibling = parent->getRight();
+            if (sibling->isRed()) { //Case 1: make the sibling black
+                sibling->setRed(false);
+                parent->setRed(true);
+                rotateLeft(parent);
+                sibling = parent->getRight();
+            }
+            if (!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) { //Case 2: push the problem up
+                sibling->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if (!isRed(sibling->getRight())) { //Case 3: make the far nephew red
+                sibling->getLeft()->setRed(false);
+                sibling->setRed(true);
+                rotateRight(sibling);
+                sibling = parent->getRight();
+            }
+            //Case 4: one rotation finishes the fix
+            sibling->setRed(parent->isRed());
+            parent->setRed(false);
+            sibling->getRight()->setRed(false);
+            rotateLeft(parent);
+            node = getRoot();
+        } else {
+            RBNode<Key, Value>* sibling = parent->getLeft();
+            if (sibling->isRed()) {
+                sibling->setRed(false);
+                parent->setRed(true);
+                rotateRight(parent);
+                sibling = parent->getLeft();
+            }
+            if (!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) {
+                sibling->setRed(true);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if (!isRed(sibling->getLeft())) {
+                sibling->getRight()->setRed(false);
+                sibling->setRed(true);
+                rotateLeft(sibling);
+                sibling = parent->getLeft();
+            }
+            sibling->setRed(parent->isRed());
+            parent->setRed(false);
+            sibling->getLeft()->setRed(false);
+            rotateRight(parent);
+            node = getRoot();
+        }
+    }
+    if (node != nullptr) {
+        node->setRed(false);
+    }
+}
+
+/*
+ * The base nodeSwap relinks through Node::setParent, which clears colour
+ * bits, so remember the colours of every node it touches and put them back.
+ * Like AVLTree::nodeSwap, the two swapped nodes also trade colours so each
+ * tree position keeps its colour.
+ */
+template<class Key, class Value>
+void RBTree<Key, Value>::nodeSwap(RBNode<Key, Value>* n1, RBNode<Key, Value>* n2)
+{
+    RBNode<Key, Value>* touched[4] = { n1->getLeft(), n1->getRight(), n2->getLeft(), n2->getRight() };
+    bool touchedRed[4];
+    for (int i = 0; i < 4; ++i) {
+        touchedRed[i] = isRed(touched[i]);
+    }
+    bool n1Red = n1->isRed();
+    bool n2Red = n2->isRed();
+
+    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+
+    for (int i = 0; i < 4; ++i) {
+        if (touched[i] != nullptr) {
+            touched[i]->setRed(touchedRed[i]);
+        }
+    }
+    n1->setRed(n2Red);
+    n2->setRed(n1Red);
+}
+
+/**
+* Folds the tree into a perfectly balanced shape like the base class does,
+* then recolours it: every level is black except a partial bottom level,
+* which is red so all paths keep the same black height.
+*/
+template<class Key, class Value>
+void RBTree<Key, Value>::rebalance()
+{
+    BinarySearchTree<Key, Value>::rebalance(); //Node::setParent leaves every node black
+    RBNode<Key, Value>* node = getRoot();
+    if (node == nullptr) {
+        return;
+    }
+
+    //The partial bottom level is filled from the left, so the left spine reaches
+    //it and the right spine stops short unless the tree is perfect
+    int bottom = 0;
+    for (RBNode<Key, Value>* leftmost = node; leftmost->getLeft() != nullptr; leftmost = leftmost->getLeft()) {
+        bottom++;
+    }
+    int rightDepth = 0;
+    for (RBNode<Key, Value>* rightmost = node; rightmost->getRight() != nullptr; rightmost = rightmost->getRight()) {
+        rightDepth++;
+    }
+    if (rightDepth == bottom) { //A perfect tree is valid all black
+        return;
+    }
+
+    //In-order walk along parent links, tracking depth, so no stack is needed
+    int depth = 0;
+    while (node->getLeft() != nullptr) {
+        node = node->getLeft();
+        depth++;
+    }
+    while (node != nullptr) {
+        if (depth == bottom) {
+            node->setRed(true);
+        }
+        if (node->getRight() != nullptr) {
+            node = node->getRight();
+            depth++;
+            while (node->getLeft() != nullptr) {
+                node = node->getLeft();
+                depth++;
+            }
+        } else {
+            RBNode<Key, Value>* child = node;
+            node = node->getParent();
+            depth--;
+            while (node != nullptr && node->getRight() == child) {
+                child = node;
+                node = node->getParent();
+                depth--;
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef SCAPEGOAT_H
+#define SCAPEGOAT_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cmath>
+#include "bst.h"
+
+/**
+* A Scapegoat tree built on plain Nodes: there is no balance, colour or size
+* field per node, only two counters for the whole tree. Inserts are ordinary
+* leaf inserts; when one lands deeper than log base 1/alpha of the tree size,
+* the first ancestor whose subtree is more than alpha lopsided (the scapegoat)
+* is rebuilt into a perfectly balanced subtree. Removes are ordinary BST
+* removes, and the whole tree is rebuilt once it has shrunk below alpha of its
+* largest size since the last full rebuild.
+*
+* Lookups never modify the tree and the height stays below log base 1/alpha
+* of n plus one, so this suits append-mostly, read-heavy tables. Rebuilds cost
+* O(subtree) time and O(1) extra space, amortized O(log n) per update.
+*/
+template <class Key, class Value>
+class ScapegoatTree : public BinarySearchTree<Key, Value>
+{
+public:
+    explicit ScapegoatTree(double alpha = 0.7);
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void clear();
+    size_t size() const;
+
+protected:
+    virtual void eraseNode(Node<Key, Value>* node);
+
+    // Helper functions
+    int depthLimit() const;
+    static size_t subtreeSize(Node<Key, Value>* node);
+    void rebuild(Node<Key, Value>* node, size_t n);
+
+    double alpha_;
+    size_t size_;
+    size_t maxSize_;  // largest size since the last full rebuild
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ScapegoatTree class.
+  ---------------------------------------------
+*/
+
+/**
+* alpha must be in [0.5, 1): smaller keeps the tree shallower at the price of
+* more frequent rebuilds.
+*/
+template<class Key, class Value>
+ScapegoatTree<Key, Value>::ScapegoatTree(double alpha) :
+    alpha_(alpha), size_(0), maxSize_(0)
+{
+    if (!(alpha >= 0.5 && alpha < 1.0)) {
+        throw std::invalid_argument("ScapegoatTree alpha must be in [0.5, 1)");
+    }
+}
+
+template<class Key, class Value>
+size_t ScapegoatTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+/**
+* Resets the size counters too, so a clear through a BinarySearchTree&
+* cannot leave the depth limit working from a stale size.
+*/
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::clear()
+{
+    BinarySearchTree<Key, Value>::clear();
+    size_ = 0;
+    maxSize_ = 0;
+}
+
+//Deepest a node may sit (root at depth 0) before a rebuild is needed
+template<class Key, class Value>
+int ScapegoatTree<Key, Value>::depthLimit() const
+{
+    return (int)std::floor(std::log((double)maxSize_) / std::log(1.0 / alpha_));
+}
+
+//Counts the nodes below node with an explicit walk, since nodes keep no sizes
+template<class Key, class Value>
+size_t ScapegoatTree<Key, Value>::subtreeSize(Node<Key, Value>* node)
+{
+    if (node == nullptr) {
+        return 0;
+    }
+    return 1 + subtreeSize(node->getLeft()) + subtreeSize(node->getRight());
+}
+
+/*
+ * Inserts as a leaf. If the new leaf is too deep, walks back up summing
+ * subtree sizes (only the sibling subtrees need counting) until it finds a
+ * node whose child holds more than alpha of its subtree, and rebuilds there.
+ */
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    Node<Key, Value>* parent = nullptr;
+    Node<Key, Value>* currentNode = this->root_;
+    int depth = 0;
+
+    while (currentNode != nullptr) {
+        if (new_item.first < currentNode->getKey()) {
+            parent = currentNode;
+            currentNode = currentNode->getLeft();
+        } else if (new_item.first > currentNode->getKey() || this->multimap_) {
+            parent = currentNode;
+            currentNode = currentNode->getRight();
+        } else {
+            currentNode->setValue(new_item.second);
+            return;
+        }
+        depth++;
+    }
+
+    Node<Key, Value>* newNode = new Node<Key, Value>(new_item.first, new_item.second, parent);
+    if (parent == nullptr) {
+        this->root_ = newNode;
+    } else if (newNode->getKey() < parent->getKey()) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+    size_++;
+    if (size_ > maxSize_) {
+        maxSize_ = size_;
+    }
+
+    if (depth <= depthLimit()) {
+        return;
+    }
+
+    Node<Key, Value>* child = newNode;
+    size_t childSize = 1;
+    for (Node<Key, Value>* node = parent; node != nullptr; node = node->getParent()) {
+        Node<Key, Value>* sibling = (node->getLeft() == child) ? node->getRight() : node->getLeft();
+        size_t nodeSize = 1 + childSize + subtreeSize(sibling);
+        if ((double)childSize > alpha_ * (double)nodeSize) {
+            rebuild(node, nodeSize);
+            return;
+        }
+        child = node;
+        childSize = nodeSize;
+    }
+}
+
+/*
+ * Plain BST removal; once enough removes have accumulated the whole tree is
+ * rebuilt so the depth bound still holds.
+ */
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::eraseNode(Node<Key, Value>* node)
+{
+    BinarySearchTree<Key, Value>::eraseNode(node);
+    size_--;
+
+    if ((double)size_ < alpha_ * (double)maxSize_) {
+        if (size_ > 0) {
+            rebuild(this->root_, size_);
+        }
+        maxSize_ = size_;
+    }
+}
+
+/*
+ * Rebuilds the n node subtree at node in place with the same vine folding
+ * that BinarySearchTree::rebalance uses. No node is allocated or copied.
+ */
+template<class Key, class Value>
+void ScapegoatTree<Key, Value>::rebuild(Node<Key, Value>* node, size_t n)
+{
+    Node<Key, Value>* parent = node->getParent();
+    bool wasLeft = (parent != nullptr && parent->getLeft() == node);
+
+    size_t count = 0;
+    Node<Key, Value>* head = this->treeToVine(node, count);
+    Node<Key, Value>* top = this->vineToTree(head, n);
+    top->setParent(parent);
+
+    if (parent == nullptr) {
+        this->root_ = top;
+    } else if (wasLeft) {
+        parent->setLeft(top);
+    } else {
+        parent->setRight(top);
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ScapegoatTree class.
+  ---------------------------------------------
+*/
+
+#endif
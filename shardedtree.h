@@ -0,0 +1,928 @@
+#ifndef SHARDEDTREE_H
+#define SHARDEDTREE_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include "avlbst.h"
+
+/**
+* One shard of a ShardedTree: an AVLTree that counts its items, and that
+* can hand its nodes to other shards when the ShardedTree splits or merges
+* key ranges, so resharding relinks nodes instead of copying items.
+*
+* The AVLTree interface is inherited as protected because its remove,
+* erase(iterator) and apply_batch would change the tree without updating
+* the count; only the mutators that keep it are public.
+*/
+template <class Key, class Value>
+class AVLShard : protected AVLTree<Key, Value>
+{
+public:
+    AVLShard();
+
+    bool erase(const Key& key);
+    void applyBatch(const std::vector<BatchUpdate<Key, Value> >& updates);
+    void clear();
+    size_t size() const;
+
+    //New keys are counted by createNode, so insert keeps the count as well
+    using AVLTree<Key, Value>::insert;
+    using AVLTree<Key, Value>::find;
+    using AVLTree<Key, Value>::lower_bound;
+    using AVLTree<Key, Value>::begin;
+    using AVLTree<Key, Value>::end;
+    using AVLTree<Key, Value>::front;
+    using AVLTree<Key, Value>::back;
+    using BinarySearchTree<Key, Value>::empty;
+    using BinarySearchTree<Key, Value>::isBalanced;
+
+    // Resharding; both leave this shard empty
+    Key splitInto(AVLShard<Key, Value>& low, AVLShard<Key, Value>& high);
+    void mergeFrom(AVLShard<Key, Value>& low, AVLShard<Key, Value>& high);
+
+protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+
+    // Helper functions
+    void adopt(std::vector<AVLNode<Key, Value>*>& nodes, size_t lo, size_t hi);
+    void release();
+
+    size_t count_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the AVLShard class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+AVLShard<Key, Value>::AVLShard() :
+    count_(0)
+{
+
+}
+
+//Counts every node the AVLTree links in. Not safe to call concurrently,
+//which is fine because the threaded apply_batch is not reachable here.
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLShard<Key, Value>::createNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent)
+{
+    count_++;
+    return AVLTree<Key, Value>::createNode(key, value, parent);
+}
+
+/**
+* Removes key in one descent and reports whether it was there.
+*/
+template<class Key, class Value>
+bool AVLShard<Key, Value>::erase(const Key& key)
+{
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
+    if (node == nullptr) {
+        return false;
+    }
+    this->unlinkNode(node);
+    count_--;
+    return true;
+}
+
+/**
+* AVLTree::apply_batch that keeps the count. New keys are counted as they
+* are created; a key whose last update is a remove is looked up first to
+* see whether the batch will free it.
+*/
+template<class Key, class Value>
+void AVLShard<Key, Value>::applyBatch(const std::vector<BatchUpdate<Key, Value> >& updates)
+{
+    size_t removed = 0;
+    for (size_t i = 0; i < updates.size(); ++i) {
+        bool last = (i + 1 == updates.size() || updates[i].key < updates[i + 1].key);
+        if (last && updates[i].remove && this->internalFind(updates[i].key) != nullptr) {
+            removed++;
+        }
+    }
+    this->apply_batch(updates);
+    count_ -= removed;
+}
+
+template<class Key, class Value>
+void AVLShard<Key, Value>::clear()
+{
+    BinarySearchTree<Key, Value>::clear();
+    count_ = 0;
+}
+
+template<class Key, class Value>
+size_t AVLShard<Key, Value>::size() const
+{
+    return count_;
+}
+
+/**
+* Moves the lower half of the items into low and the rest into high, both
+* of which must be empty, and returns the first key of high.
+*/
+template<class Key, class Value>
+Key AVLShard<Key, Value>::splitInto(AVLShard<Key, Value>& low, AVLShard<Key, Value>& high)
+{
+    if (count_ < 2) {
+        throw std::logic_error("AVLShard: too few items to split");
+    }
+    std::vector<AVLNode<Key, Value>*> nodes;
+    nodes.reserve(count_);
+    this->collectNodes(nodes);
+    size_t middle = nodes.size() / 2;
+    low.adopt(nodes, 0, middle);
+    high.adopt(nodes, middle, nodes.size());
+    release();
+    return nodes[middle]->getKey();
+}
+
+/**
+* Takes over every item of low and high, whose keys must all be less than
+* those of high, into this empty shard.
+*/
+template<class Key, class Value>
+void AVLShard<Key, Value>::mergeFrom(AVLShard<Key, Value>& low, AVLShard<Key, Value>& high)
+{
+    std::vector<AVLNode<Key, Value>*> nodes;
+    nodes.reserve(low.count_ + high.count_);
+    low.collectNodes(nodes);
+    high.collectNodes(nodes);
+    adopt(nodes, 0, nodes.size());
+    low.release();
+    high.release();
+}
+
+//Links nodes[lo, hi), in key order, as this shard's perfectly balanced tree
+template<class Key, class Value>
+void AVLShard<Key, Value>::adopt(std::vector<AVLNode<Key, Value>*>& nodes, size_t lo, size_t hi)
+{
+    int height = 0;
+    this->root_ = this->buildBalanced(nodes, lo, hi, nullptr, height);
+    if (hi > lo) {
+        this->min_ = nodes[lo];
+        this->max_ = nodes[hi - 1];
+    }
+    count_ = hi - lo;
+}
+
+//Forgets the nodes another shard has adopted, without freeing them
+template<class Key, class Value>
+void AVLShard<Key, Value>::release()
+{
+    this->root_ = nullptr;
+    this->min_ = nullptr;
+    this->max_ = nullptr;
+    count_ = 0;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the AVLShard class.
+  ---------------------------------------------
+*/
+
+/**
+* A map whose key space is cut into ranges, each held by its own AVLShard
+* behind its own mutex, so threads writing different ranges never wait on
+* each other.
+*
+* The boundaries live in an immutable directory that operations load with
+* std::atomic_load and never lock. An operation locks the one shard that
+* covers its key; if that shard was retired by a reshard in the meantime it
+* reloads the directory and tries again. An insert that grows a shard past
+* maxShardSize splits it at its median key, and a remove that shrinks one
+* below a quarter of it merges it with its smaller neighbour when the two
+* fit in half of it, so the boundaries follow the keys that are actually
+* used. Shards from the constructor's boundaries only become mergeable once
+* they have held a quarter of maxShardSize, so the caller's ranges survive
+* until they have been used. Resharding relinks the shard's nodes into new
+* trees in O(shard size), publishes a new directory, and is serialized by a
+* structure mutex; a plain operation only takes it when its write crosses
+* one of those thresholds.
+*
+* Iteration is weakly consistent: the iterator copies one shard's worth of
+* items at a time under that shard's lock, so it never blocks writers for
+* longer than one copy and sees each shard as of the moment it got there.
+*/
+template <class Key, class Value>
+class ShardedTree
+{
+public:
+    explicit ShardedTree(size_t maxShardSize = 65536);
+    ShardedTree(const std::vector<Key>& boundaries, size_t maxShardSize = 65536);
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<Key, Value>& operator*() const;
+        const std::pair<Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ShardedTree<Key, Value>;
+        iterator(const ShardedTree<Key, Value>* tree, const Key* from);
+        void load(const Key* from);
+
+        const ShardedTree<Key, Value>* tree_;
+        std::vector<std::pair<Key, Value> > items_;   // copy of the current shard from pos_ on
+        size_t pos_;
+        bool more_;    // shards follow the current one
+        Key next_;     // first key of the next shard
+    };
+
+    void insert(const std::pair<const Key, Value>& new_item);
+    bool remove(const Key& key);
+    bool lookup(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value get(const Key& key) const;
+    void clear();
+
+    // Batches, applied one shard at a time
+    void apply_batch(std::vector<BatchUpdate<Key, Value> > updates);
+    std::vector<std::pair<bool, Value> > lookup_batch(const std::vector<Key>& keys) const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator lower_bound(const Key& key) const;
+
+    size_t size() const;
+    bool empty() const;
+    size_t shards() const;
+    bool isBalanced() const;
+
+protected:
+    struct Shard
+    {
+        explicit Shard(bool reshaped = false) : items(0), settled(reshaped), retired(false) { }
+
+        std::mutex lock;
+        AVLShard<Key, Value> tree;
+        std::atomic<size_t> items;   // tree.size(), readable without the lock
+        std::atomic<bool> settled;   // made by a reshard or once held maxShardSize / 4; may merge
+        bool retired;                // replaced by a reshard; guarded by lock
+    };
+
+    struct Directory
+    {
+        size_t indexFor(const Key& key) const;
+        size_t indexOf(const Shard* shard) const;
+
+        std::vector<Key> bounds;                        // bounds[i] is the first key of shards[i + 1]
+        std::vector<std::shared_ptr<Shard> > shards;
+    };
+
+    // Helper functions
+    std::shared_ptr<const Directory> lockShard(const Key& key, std::unique_lock<std::mutex>& guard, size_t& index) const;
+    std::shared_ptr<const Directory> directory() const;
+    void publish(const std::shared_ptr<const Directory>& next);
+    void reshape(const std::shared_ptr<Shard>& shard, size_t before, size_t after);
+    size_t mergePartner(const Directory& dir, const Shard* shard) const;
+    void split(const std::shared_ptr<Shard>& shard);
+    void merge(const std::shared_ptr<Shard>& shard);
+
+    std::shared_ptr<const Directory> directory_;
+    std::mutex structureLock_;   // serializes splits and merges
+    std::atomic<size_t> size_;
+    size_t maxShardSize_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ShardedTree::iterator class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+ShardedTree<Key, Value>::iterator::iterator() :
+    tree_(nullptr), pos_(0), more_(false), next_()
+{
+
+}
+
+template<class Key, class Value>
+ShardedTree<Key, Value>::iterator::iterator(const ShardedTree<Key, Value>* tree, const Key* from) :
+    tree_(tree), pos_(0), more_(false), next_()
+{
+    load(from);
+}
+
+/*
+ * Copies the items not less than *from (all of them when from is null)
+ * out of the shard that covers it, moving on past empty shards.
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::iterator::load(const Key* from)
+{
+    items_.clear();
+    pos_ = 0;
+    more_ = false;
+    while (true) {
+        //dir is declared first so that it outlives the lock on its shard
+        std::shared_ptr<const Directory> dir;
+        std::unique_lock<std::mutex> guard;
+        size_t index = 0;
+        if (from == nullptr) {
+            dir = tree_->directory();
+            guard = std::unique_lock<std::mutex>(dir->shards[0]->lock);
+            if (dir->shards[0]->retired) {
+                guard.unlock();
+                continue;
+            }
+        } else {
+            dir = tree_->lockShard(*from, guard, index);
+        }
+        const AVLShard<Key, Value>& shard = dir->shards[index]->tree;
+        typename AVLTree<Key, Value>::iterator it = (from == nullptr) ? shard.begin() : shard.lower_bound(*from);
+        for (; it != shard.end(); ++it) {
+            items_.push_back(*it);
+        }
+        more_ = (index + 1 < dir->shards.size());
+        if (more_) {
+            next_ = dir->bounds[index];
+        }
+        if (!items_.empty() || !more_) {
+            return;
+        }
+        from = &next_;
+    }
+}
+
+template<class Key, class Value>
+const std::pair<Key, Value>& ShardedTree<Key, Value>::iterator::operator*() const
+{
+    return items_[pos_];
+}
+
+template<class Key, class Value>
+const std::pair<Key, Value>* ShardedTree<Key, Value>::iterator::operator->() const
+{
+    return &items_[pos_];
+}
+
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    bool atEnd = (pos_ >= items_.size());
+    bool rhsAtEnd = (rhs.pos_ >= rhs.items_.size());
+    if (atEnd || rhsAtEnd) {
+        return atEnd == rhsAtEnd;
+    }
+    return items_[pos_].first == rhs.items_[rhs.pos_].first;
+}
+
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value>
+typename ShardedTree<Key, Value>::iterator&
+ShardedTree<Key, Value>::iterator::operator++()
+{
+    if (++pos_ < items_.size()) {
+        return *this;
+    }
+    if (more_) {
+        Key from = next_;
+        load(&from);
+    } else {
+        items_.clear();
+        pos_ = 0;
+    }
+    return *this;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ShardedTree::iterator class.
+  ---------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ShardedTree::Directory struct.
+  ---------------------------------------------
+*/
+
+//Index of the shard whose range holds key
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::Directory::indexFor(const Key& key) const
+{
+    return std::upper_bound(bounds.begin(), bounds.end(), key) - bounds.begin();
+}
+
+//Index of shard, or shards.size() if it is not in this directory
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::Directory::indexOf(const Shard* shard) const
+{
+    size_t index = 0;
+    while (index < shards.size() && shards[index].get() != shard) {
+        index++;
+    }
+    return index;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ShardedTree::Directory struct.
+  ---------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ShardedTree class.
+  ---------------------------------------------
+*/
+
+/**
+* Starts with a single shard covering every key; shards are split off as
+* it grows.
+*/
+template<class Key, class Value>
+ShardedTree<Key, Value>::ShardedTree(size_t maxShardSize) :
+    size_(0), maxShardSize_(maxShardSize)
+{
+    if (maxShardSize < 4) {
+        throw std::invalid_argument("ShardedTree maxShardSize must be at least 4");
+    }
+    std::shared_ptr<Directory> dir(new Directory());
+    dir->shards.push_back(std::shared_ptr<Shard>(new Shard()));
+    directory_ = dir;
+}
+
+/**
+* Starts with one shard per range between strictly increasing boundaries,
+* for a caller that already knows how its keys spread. The ranges still
+* split and merge as they fill and drain.
+*/
+template<class Key, class Value>
+ShardedTree<Key, Value>::ShardedTree(const std::vector<Key>& boundaries, size_t maxShardSize) :
+    size_(0), maxShardSize_(maxShardSize)
+{
+    if (maxShardSize < 4) {
+        throw std::invalid_argument("ShardedTree maxShardSize must be at least 4");
+    }
+    for (size_t i = 1; i < boundaries.size(); ++i) {
+        if (!(boundaries[i - 1] < boundaries[i])) {
+            throw std::invalid_argument("ShardedTree boundaries must be strictly increasing");
+        }
+    }
+    std::shared_ptr<Directory> dir(new Directory());
+    dir->bounds = boundaries;
+    for (size_t i = 0; i <= boundaries.size(); ++i) {
+        dir->shards.push_back(std::shared_ptr<Shard>(new Shard()));
+    }
+    directory_ = dir;
+}
+
+template<class Key, class Value>
+std::shared_ptr<const typename ShardedTree<Key, Value>::Directory>
+ShardedTree<Key, Value>::directory() const
+{
+    return std::atomic_load(&directory_);
+}
+
+template<class Key, class Value>
+void ShardedTree<Key, Value>::publish(const std::shared_ptr<const Directory>& next)
+{
+    std::atomic_store(&directory_, next);
+}
+
+/*
+ * Locks the live shard that covers key into guard and returns the
+ * directory it was found in, with its position in index.
+ */
+template<class Key, class Value>
+std::shared_ptr<const typename ShardedTree<Key, Value>::Directory>
+ShardedTree<Key, Value>::lockShard(const Key& key, std::unique_lock<std::mutex>& guard, size_t& index) const
+{
+    while (true) {
+        std::shared_ptr<const Directory> dir = directory();
+        index = dir->indexFor(key);
+        guard = std::unique_lock<std::mutex>(dir->shards[index]->lock);
+        if (!dir->shards[index]->retired) {
+            return dir;
+        }
+        //A reshard published a new directory before it let go of this shard
+        guard.unlock();
+    }
+}
+
+/**
+* Inserts or overwrites key, then splits its shard if it has outgrown
+* maxShardSize.
+*/
+template<class Key, class Value>
+void ShardedTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+    std::unique_lock<std::mutex> guard;
+    size_t index = 0;
+    std::shared_ptr<const Directory> dir = lockShard(new_item.first, guard, index);
+    const std::shared_ptr<Shard>& shard = dir->shards[index];
+    size_t before = shard->tree.size();
+    shard->tree.insert(new_item);
+    size_t after = shard->tree.size();
+    shard->items.store(after, std::memory_order_relaxed);
+    if (after >= maxShardSize_ / 4) {
+        shard->settled.store(true, std::memory_order_relaxed);
+    }
+    guard.unlock();
+    if (after != before) {
+        size_.fetch_add(1, std::memory_order_relaxed);
+        reshape(shard, before, after);
+    }
+}
+
+/**
+* Removes key and reports whether it was there. A shard left below a
+* quarter of maxShardSize may be merged into a neighbour.
+*/
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::remove(const Key& key)
+{
+    std::unique_lock<std::mutex> guard;
+    size_t index = 0;
+    std::shared_ptr<const Directory> dir = lockShard(key, guard, index);
+    const std::shared_ptr<Shard>& shard = dir->shards[index];
+    if (!shard->tree.erase(key)) {
+        return false;
+    }
+    size_t after = shard->tree.size();
+    shard->items.store(after, std::memory_order_relaxed);
+    guard.unlock();
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    reshape(shard, after + 1, after);
+    return true;
+}
+
+/**
+* Copies key's value into value and returns true, or returns false if key
+* is missing.
+*/
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::lookup(const Key& key, Value& value) const
+{
+    std::unique_lock<std::mutex> guard;
+    size_t index = 0;
+    std::shared_ptr<const Directory> dir = lockShard(key, guard, index);
+    const AVLShard<Key, Value>& tree = dir->shards[index]->tree;
+    typename AVLTree<Key, Value>::iterator it = tree.find(key);
+    if (it == tree.end()) {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::contains(const Key& key) const
+{
+    std::unique_lock<std::mutex> guard;
+    size_t index = 0;
+    std::shared_ptr<const Directory> dir = lockShard(key, guard, index);
+    const AVLShard<Key, Value>& tree = dir->shards[index]->tree;
+    return tree.find(key) != tree.end();
+}
+
+/**
+* A copy of key's value. Throws std::out_of_range if key is missing.
+*/
+template<class Key, class Value>
+Value ShardedTree<Key, Value>::get(const Key& key) const
+{
+    Value value;
+    if (!lookup(key, value)) {
+        throw std::out_of_range("Invalid key");
+    }
+    return value;
+}
+
+/**
+* Empties every shard in turn and keeps the boundaries. Writes racing a
+* clear may survive it.
+*/
+template<class Key, class Value>
+void ShardedTree<Key, Value>::clear()
+{
+    std::lock_guard<std::mutex> structure(structureLock_);
+    std::shared_ptr<const Directory> dir = directory();
+    for (size_t i = 0; i < dir->shards.size(); ++i) {
+        std::lock_guard<std::mutex> guard(dir->shards[i]->lock);
+        size_.fetch_sub(dir->shards[i]->tree.size(), std::memory_order_relaxed);
+        dir->shards[i]->tree.clear();
+        dir->shards[i]->items.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Sorts the updates by key (a later update of the same key wins), then
+* locks each shard they touch once and hands it its run of updates as a
+* single AVLTree::apply_batch. The batch is atomic per shard, not as a
+* whole.
+*/
+template<class Key, class Value>
+void ShardedTree<Key, Value>::apply_batch(std::vector<BatchUpdate<Key, Value> > updates)
+{
+    struct ByKey
+    {
+        bool operator()(const BatchUpdate<Key, Value>& a, const BatchUpdate<Key, Value>& b) const
+        {
+            return a.key < b.key;
+        }
+    };
+    std::stable_sort(updates.begin(), updates.end(), ByKey());
+
+    size_t first = 0;
+    while (first < updates.size()) {
+        std::unique_lock<std::mutex> guard;
+        size_t index = 0;
+        std::shared_ptr<const Directory> dir = lockShard(updates[first].key, guard, index);
+        bool last = (index + 1 == dir->shards.size());
+        size_t stop = first + 1;
+        while (stop < updates.size() && (last || updates[stop].key < dir->bounds[index])) {
+            stop++;
+        }
+
+        const std::shared_ptr<Shard>& shard = dir->shards[index];
+        size_t before = shard->tree.size();
+        if (first == 0 && stop == updates.size()) {
+            shard->tree.applyBatch(updates);
+        } else {
+            std::vector<BatchUpdate<Key, Value> > run(updates.begin() + first, updates.begin() + stop);
+            shard->tree.applyBatch(run);
+        }
+        size_t after = shard->tree.size();
+        shard->items.store(after, std::memory_order_relaxed);
+        if (after >= maxShardSize_ / 4) {
+            shard->settled.store(true, std::memory_order_relaxed);
+        }
+        guard.unlock();
+
+        if (after >= before) {
+            size_.fetch_add(after - before, std::memory_order_relaxed);
+        } else {
+            size_.fetch_sub(before - after, std::memory_order_relaxed);
+        }
+        reshape(shard, before, after);
+        first = stop;
+    }
+}
+
+/**
+* Looks up every key, locking each shard they touch once, and returns
+* (found, value) pairs in the order of keys.
+*/
+template<class Key, class Value>
+std::vector<std::pair<bool, Value> > ShardedTree<Key, Value>::lookup_batch(const std::vector<Key>& keys) const
+{
+    struct ByKey
+    {
+        explicit ByKey(const std::vector<Key>& k) : keys(k) { }
+        bool operator()(size_t a, size_t b) const
+        {
+            return keys[a] < keys[b];
+        }
+        const std::vector<Key>& keys;
+    };
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), ByKey(keys));
+
+    std::vector<std::pair<bool, Value> > results(keys.size(), std::make_pair(false, Value()));
+    size_t first = 0;
+    while (first < order.size()) {
+        std::unique_lock<std::mutex> guard;
+        size_t index = 0;
+        std::shared_ptr<const Directory> dir = lockShard(keys[order[first]], guard, index);
+        bool last = (index + 1 == dir->shards.size());
+        const AVLShard<Key, Value>& tree = dir->shards[index]->tree;
+        for (; first < order.size() && (last || keys[order[first]] < dir->bounds[index]); ++first) {
+            typename AVLTree<Key, Value>::iterator it = tree.find(keys[order[first]]);
+            if (it != tree.end()) {
+                results[order[first]] = std::make_pair(true, it->second);
+            }
+        }
+    }
+    return results;
+}
+
+/*
+ * Called after a write took shard from before to after items, without its
+ * lock held. Only growth can split and only shrinkage can merge, and the
+ * merge is checked against the directory first, so a write stays off the
+ * structure lock unless a reshard is likely to happen.
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::reshape(const std::shared_ptr<Shard>& shard, size_t before, size_t after)
+{
+    if (after > before && after > maxShardSize_) {
+        split(shard);
+    } else if (after < before && after < maxShardSize_ / 4) {
+        std::shared_ptr<const Directory> dir = directory();
+        if (mergePartner(*dir, shard.get()) != dir->shards.size()) {
+            merge(shard);
+        }
+    }
+}
+
+/*
+ * Index of the lower of shard and the neighbour it should merge with: its
+ * smaller settled neighbour, if shard is settled too and the two fit in
+ * half of maxShardSize. dir.shards.size() if there is none. Reads the
+ * item counts without locks, so the caller rechecks under them.
+ */
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::mergePartner(const Directory& dir, const Shard* shard) const
+{
+    size_t index = dir.indexOf(shard);
+    if (index == dir.shards.size() || !shard->settled.load(std::memory_order_relaxed)) {
+        return dir.shards.size();
+    }
+    size_t partner = dir.shards.size();
+    size_t partnerItems = 0;
+    for (size_t side = 0; side < 2; ++side) {
+        if ((side == 0 && index == 0) || (side == 1 && index + 1 == dir.shards.size())) {
+            continue;
+        }
+        size_t neighbour = (side == 0) ? index - 1 : index + 1;
+        const Shard* candidate = dir.shards[neighbour].get();
+        size_t items = candidate->items.load(std::memory_order_relaxed);
+        if (candidate->settled.load(std::memory_order_relaxed) &&
+            (partner == dir.shards.size() || items < partnerItems)) {
+            partner = neighbour;
+            partnerItems = items;
+        }
+    }
+    if (partner == dir.shards.size() ||
+        shard->items.load(std::memory_order_relaxed) + partnerItems > maxShardSize_ / 2) {
+        return dir.shards.size();
+    }
+    return std::min(index, partner);
+}
+
+/*
+ * Replaces shard with two shards holding its lower and upper halves, if it
+ * is still live and still too big.
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::split(const std::shared_ptr<Shard>& shard)
+{
+    std::lock_guard<std::mutex> structure(structureLock_);
+    std::shared_ptr<const Directory> dir = directory();
+    size_t index = dir->indexOf(shard.get());
+    if (index == dir->shards.size()) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(shard->lock);
+    if (shard->tree.size() <= maxShardSize_) {
+        return;
+    }
+
+    std::shared_ptr<Shard> low(new Shard(true));
+    std::shared_ptr<Shard> high(new Shard(true));
+    Key middle = shard->tree.splitInto(low->tree, high->tree);
+    low->items.store(low->tree.size(), std::memory_order_relaxed);
+    high->items.store(high->tree.size(), std::memory_order_relaxed);
+
+    std::shared_ptr<Directory> next(new Directory(*dir));
+    next->bounds.insert(next->bounds.begin() + index, middle);
+    next->shards[index] = low;
+    next->shards.insert(next->shards.begin() + index + 1, high);
+    shard->retired = true;
+    publish(next);
+}
+
+/*
+ * Folds shard into its mergePartner if both are still live and together
+ * fit in half of maxShardSize, which keeps a merged shard well away from
+ * the next split.
+ */
+template<class Key, class Value>
+void ShardedTree<Key, Value>::merge(const std::shared_ptr<Shard>& shard)
+{
+    std::lock_guard<std::mutex> structure(structureLock_);
+    std::shared_ptr<const Directory> dir = directory();
+    size_t low = mergePartner(*dir, shard.get());
+    if (low == dir->shards.size()) {
+        return;
+    }
+    std::shared_ptr<Shard> lower = dir->shards[low];
+    std::shared_ptr<Shard> upper = dir->shards[low + 1];
+
+    //Shards are always locked in key order
+    std::lock_guard<std::mutex> lowerGuard(lower->lock);
+    std::lock_guard<std::mutex> upperGuard(upper->lock);
+    if (lower->tree.size() + upper->tree.size() > maxShardSize_ / 2) {
+        return;
+    }
+    std::shared_ptr<Shard> merged(new Shard(true));
+    merged->tree.mergeFrom(lower->tree, upper->tree);
+    merged->items.store(merged->tree.size(), std::memory_order_relaxed);
+
+    std::shared_ptr<Directory> next(new Directory(*dir));
+    next->bounds.erase(next->bounds.begin() + low);
+    next->shards[low] = merged;
+    next->shards.erase(next->shards.begin() + low + 1);
+    lower->retired = true;
+    upper->retired = true;
+    publish(next);
+}
+
+template<class Key, class Value>
+typename ShardedTree<Key, Value>::iterator
+ShardedTree<Key, Value>::begin() const
+{
+    return iterator(this, nullptr);
+}
+
+template<class Key, class Value>
+typename ShardedTree<Key, Value>::iterator
+ShardedTree<Key, Value>::end() const
+{
+    return iterator();
+}
+
+/**
+* Iterator to the first item whose key is not less than key.
+*/
+template<class Key, class Value>
+typename ShardedTree<Key, Value>::iterator
+ShardedTree<Key, Value>::lower_bound(const Key& key) const
+{
+    return iterator(this, &key);
+}
+
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::size() const
+{
+    return size_.load(std::memory_order_relaxed);
+}
+
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+* Number of key ranges right now.
+*/
+template<class Key, class Value>
+size_t ShardedTree<Key, Value>::shards() const
+{
+    return directory()->shards.size();
+}
+
+/**
+* True when every shard is a balanced tree and holds only keys inside its
+* range.
+*/
+template<class Key, class Value>
+bool ShardedTree<Key, Value>::isBalanced() const
+{
+    std::shared_ptr<const Directory> dir = directory();
+    for (size_t i = 0; i < dir->shards.size(); ++i) {
+        std::lock_guard<std::mutex> guard(dir->shards[i]->lock);
+        const AVLShard<Key, Value>& tree = dir->shards[i]->tree;
+        if (!tree.isBalanced()) {
+            return false;
+        }
+        if (tree.empty()) {
+            continue;
+        }
+        if (i > 0 && tree.front().first < dir->bounds[i - 1]) {
+            return false;
+        }
+        if (i + 1 < dir->shards.size() && !(tree.back().first < dir->bounds[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the ShardedTree class.
+  ---------------------------------------------
+*/
+
+#endif
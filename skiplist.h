@@ -0,0 +1,729 @@
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+* A node for a LockFreeSkipList. next_ holds one link per level as a
+* pointer with its low bit used as the deletion mark: a node is logically
+* removed once its level 0 link is marked, and a marked link is never
+* changed again. The value lives behind an atomic pointer so an overwrite
+* can swap it in one step. The links are allocated in the same block as
+* the node, right behind it, so following a node costs one cache miss.
+*/
+template <typename Key, typename Value>
+class SkipListNode
+{
+public:
+    static SkipListNode<Key, Value>* create(const Key& key, const Value& value, int height);
+    static void destroy(SkipListNode<Key, Value>* node);
+
+    const Key& getKey() const;
+    int getHeight() const;
+    std::atomic<uintptr_t>* getNext();
+
+    std::atomic<Value*> value;
+    std::atomic<bool> released;   // set by whichever of inserter and remover finishes first
+
+protected:
+    SkipListNode(const Key& key, const Value& value, int height);
+    ~SkipListNode();
+
+    const Key key_;
+    int height_;
+    std::atomic<uintptr_t>* next_;  // points just past the node
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the SkipListNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+SkipListNode<Key, Value>::SkipListNode(const Key& key, const Value& value, int height) :
+    value(new Value(value)), released(false), key_(key), height_(height),
+    next_(reinterpret_cast<std::atomic<uintptr_t>*>(this + 1))
+{
+    for (int i = 0; i < height; ++i) {
+        new (&next_[i]) std::atomic<uintptr_t>(0);
+    }
+}
+
+template<class Key, class Value>
+SkipListNode<Key, Value>::~SkipListNode()
+{
+    delete value.load(std::memory_order_relaxed);
+}
+
+/**
+* Allocates a node with room for height links behind it.
+*/
+template<class Key, class Value>
+SkipListNode<Key, Value>* SkipListNode<Key, Value>::create(const Key& key, const Value& value, int height)
+{
+    void* memory = ::operator new(sizeof(SkipListNode<Key, Value>) + height * sizeof(std::atomic<uintptr_t>));
+    try {
+        return new (memory) SkipListNode<Key, Value>(key, value, height);
+    } catch (...) {
+        ::operator delete(memory);
+        throw;
+    }
+}
+
+template<class Key, class Value>
+void SkipListNode<Key, Value>::destroy(SkipListNode<Key, Value>* node)
+{
+    if (node != nullptr) {
+        node->~SkipListNode<Key, Value>();
+        ::operator delete(node);
+    }
+}
+
+template<class Key, class Value>
+const Key& SkipListNode<Key, Value>::getKey() const
+{
+    return key_;
+}
+
+template<class Key, class Value>
+int SkipListNode<Key, Value>::getHeight() const
+{
+    return height_;
+}
+
+template<class Key, class Value>
+std::atomic<uintptr_t>* SkipListNode<Key, Value>::getNext()
+{
+    return next_;
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the SkipListNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A lock-free ordered map: a skip list in the style of Fraser and of
+* Herlihy and Shavit. insert() links a node bottom-up with one CAS per
+* level, and remove() marks its links top-down, the level 0 mark being the
+* moment of removal; marked nodes are unlinked by whichever thread next
+* walks past them. No operation ever waits for another thread, so writers
+* do not contend on rotations or on a root the way a balanced tree does.
+* Expected cost is O(log n) per operation.
+*
+* The interface follows BinarySearchTree (insert, remove, find,
+* lower_bound, in-order iteration), except that values come back by copy
+* and iterators are weakly consistent: they see every item present for
+* their whole lifetime and may or may not see concurrent changes.
+*
+* Memory is reclaimed with epochs. Every operation claims one of a fixed
+* set of slots and announces the epoch it started in; unlinked nodes and
+* replaced values are retired to that slot and freed once no announced
+* epoch is older. An iterator holds its slot until it is destroyed, so
+* long-lived iterators delay reclamation.
+*/
+template <class Key, class Value>
+class LockFreeSkipList
+{
+public:
+    typedef SkipListNode<Key, Value> SNode;
+
+    LockFreeSkipList();
+    ~LockFreeSkipList();
+
+protected:
+    class Guard;
+
+public:
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<Key, Value>& operator*() const;
+        const std::pair<Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class LockFreeSkipList<Key, Value>;
+        iterator(const std::shared_ptr<Guard>& guard, SNode* node);
+        void load();
+
+        std::shared_ptr<Guard> guard_;
+        SNode* current_;
+        std::pair<Key, Value> item_;   // copy of the current item
+    };
+
+    void insert(const std::pair<const Key, Value>& new_item);
+    bool remove(const Key& key);
+    bool lookup(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value get(const Key& key) const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+
+    size_t size() const;
+    bool empty() const;
+
+protected:
+    enum { MAX_LEVEL = 16, SLOTS = 64, RETIRE_BATCH = 64 };
+
+    struct Retired
+    {
+        SNode* node;
+        Value* value;
+        uint64_t epoch;
+    };
+
+    struct Slot
+    {
+        std::atomic<uint64_t> epoch;   // 0 = free
+        std::vector<Retired> retired;  // only touched by the slot's owner
+        char pad[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::vector<Retired>)];
+    };
+
+    //Claims a slot for the duration of an operation or an iterator
+    class Guard
+    {
+    public:
+        explicit Guard(const LockFreeSkipList<Key, Value>& list);
+        ~Guard();
+        void retire(SNode* node, Value* value);
+    private:
+        Guard(const Guard&);
+        Guard& operator=(const Guard&);
+        const LockFreeSkipList<Key, Value>& list_;
+        Slot* slot_;
+    };
+
+    // Helper functions
+    static bool isMarked(uintptr_t link);
+    static SNode* toNode(uintptr_t link);
+    static int randomHeight();
+    int searchOnce(const Key& key, std::atomic<uintptr_t>** preds, SNode** succs);
+    bool search(const Key& key, std::atomic<uintptr_t>** preds, SNode** succs);
+    SNode* firstAtLeast(const Key& key) const;
+    void reclaim(Slot& slot) const;
+
+    std::atomic<uintptr_t> head_[MAX_LEVEL];
+    std::atomic<size_t> size_;
+    mutable std::atomic<uint64_t> epoch_;
+    mutable Slot slots_[SLOTS];
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LockFreeSkipList::Guard class.
+  ---------------------------------------------
+*/
+
+/*
+ * Starts at a slot picked by thread id, so a thread usually finds the same
+ * free slot again, and announces the current epoch in it.
+ */
+template<class Key, class Value>
+LockFreeSkipList<Key, Value>::Guard::Guard(const LockFreeSkipList<Key, Value>& list) :
+    list_(list)
+{
+    static thread_local size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id()) % SLOTS;
+    size_t i = hint;
+    while (true) {
+        uint64_t free = 0;
+        if (list.slots_[i].epoch.compare_exchange_strong(free, list.epoch_.load())) {
+            slot_ = &list.slots_[i];
+            hint = i;
+            return;
+        }
+        i = (i + 1) % SLOTS;
+    }
+}
+
+template<class Key, class Value>
+LockFreeSkipList<Key, Value>::Guard::~Guard()
+{
+    slot_->epoch.store(0);
+}
+
+/*
+ * Hands an unlinked node, or a replaced value, to the slot. Passing nullptr
+ * for one of them retires only the other.
+ */
+template<class Key, class Value>
+void LockFreeSkipList<Key, Value>::Guard::retire(SNode* node, Value* value)
+{
+    Retired retired = { node, value, list_.epoch_.load() };
+    slot_->retired.push_back(retired);
+    if (slot_->retired.size() >= RETIRE_BATCH) {
+        list_.reclaim(*slot_);
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the LockFreeSkipList::Guard class.
+  ---------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LockFreeSkipList::iterator class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+LockFreeSkipList<Key, Value>::iterator::iterator() :
+    guard_(), current_(nullptr), item_()
+{
+
+}
+
+template<class Key, class Value>
+LockFreeSkipList<Key, Value>::iterator::iterator(const std::shared_ptr<Guard>& guard, SNode* node) :
+    guard_(guard), current_(node), item_()
+{
+    load();
+}
+
+//Copies the current item, and drops the slot once the end is reached
+template<class Key, class Value>
+void LockFreeSkipList<Key, Value>::iterator::load()
+{
+    if (current_ == nullptr) {
+        guard_.reset();
+        return;
+    }
+    item_ = std::make_pair(current_->getKey(), *current_->value.load());
+}
+
+template<class Key, class Value>
+const std::pair<Key, Value>& LockFreeSkipList<Key, Value>::iterator::operator*() const
+{
+    return item_;
+}
+
+template<class Key, class Value>
+const std::pair<Key, Value>* LockFreeSkipList<Key, Value>::iterator::operator->() const
+{
+    return &item_;
+}
+
+template<class Key, class Value>
+bool LockFreeSkipList<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<class Key, class Value>
+bool LockFreeSkipList<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+/**
+* Steps along level 0, skipping nodes that have been removed.
+*/
+template<class Key, class Value>
+typename LockFreeSkipList<Key, Value>::iterator&
+LockFreeSkipList<Key, Value>::iterator::operator++()
+{
+    SNode* node = LockFreeSkipList::toNode(current_->getNext()[0].load());
+    while (node != nullptr && LockFreeSkipList::isMarked(node->getNext()[0].load())) {
+        node = LockFreeSkipList::toNode(node->getNext()[0].load());
+    }
+    current_ = node;
+    load();
+    return *this;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the LockFreeSkipList::iterator class.
+  ---------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LockFreeSkipList class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+LockFreeSkipList<Key, Value>::LockFreeSkipList() :
+    size_(0), epoch_(1)
+{
+    for (int i = 0; i < MAX_LEVEL; ++i) {
+        head_[i].store(0);
+    }
+    for (size_t i = 0; i < SLOTS; ++i) {
+        slots_[i].epoch.store(0);
+    }
+}
+
+/**
+* No other thread may still be using the list.
+*/
+template<class Key, class Value>
+LockFreeSkipList<Key, Value>::~LockFreeSkipList()
+{
+    SNode* node = toNode(head_[0].load());
+    while (node != nullptr) {
+        SNode* next = toNode(node->getNext()[0].load());
+        SNode::destroy(node);
+        node = next;
+    }
+    for (size_t i = 0; i < SLOTS; ++i) {
+        for (size_t j = 0; j < slots_[i].retired.size(); ++j) {
+            SNode::destroy(slots_[i].retired[j].node);
+            delete slots_[i].retired[j].value;
+        }
+    }
+}
+
+template<class Key, class Value>
+bool LockFreeSkipList<Key, Value>::isMarked(uintptr_t link)
+{
+    return (link & 1) != 0;
+}
+
+template<class Key, class Value>
+typename LockFreeSkipList<Key, Value>::SNode* LockFreeSkipList<Key, Value>::toNode(uintptr_t link)
+{
+    return reinterpret_cast<SNode*>(link & ~(uintptr_t)1);
+}
+
+//Geometric with p = 1/4, from a per-thread xorshift generator
+template<class Key, class Value>
+int LockFreeSkipList<Key, Value>::randomHeight()
+{
+    static thread_local uint64_t state =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) * 0x9E3779B97F4A7C15ull | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    int height = 1;
+    uint64_t bits = state;
+    while ((bits & 3) == 0 && height < MAX_LEVEL) {
+        height++;
+        bits >>= 2;
+    }
+    return height;
+}
+
+/*
+ * One pass of search(): fills preds[level] with the link to change and
+ * succs[level] with the first node at or after key on every level,
+ * unlinking marked nodes on the way. Returns 1 if key was found, 0 if not,
+ * and -1 if an unlink lost a race and the pass has to start over.
+ */
+template<class Key, class Value>
+int LockFreeSkipList<Key, Value>::searchOnce(const Key& key, std::atomic<uintptr_t>** preds, SNode** succs)
+{
+    std::atomic<uintptr_t>* pred = head_;
+    for (int level = MAX_LEVEL - 1; level >= 0; --level) {
+        SNode* curr = toNode(pred[level].load());
+        while (curr != nullptr) {
+            uintptr_t succ = curr->getNext()[level].load();
+            if (isMarked(succ)) {
+                uintptr_t expected = reinterpret_cast<uintptr_t>(curr);
+                if (!pred[level].compare_exchange_strong(expected, succ & ~(uintptr_t)1)) {
+                    return -1;
+                }
+                curr = toNode(succ);
+            } else if (curr->getKey() < key) {
+                pred = curr->getNext();
+                curr = toNode(succ);
+            } else {
+                break;
+            }
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return (succs[0] != nullptr && !(key < succs[0]->getKey())) ? 1 : 0;
+}
+
+template<class Key, class Value>
+bool LockFreeSkipList<Key, Value>::search(const Key& key, std::atomic<uintptr_t>** preds, SNode** succs)
+{
+    while (true) {
+        int found = searchOnce(key, preds, succs);
+        if (found >= 0) {
+            return found == 1;
+        }
+    }
+}
+
+/*
+ * Read-only descent for lookups: steps over marked nodes instead of
+ * unlinking them, so readers never write to the list. Returns the first
+ * live node with a key not less than key.
+ */
+template<class Key, class Value>
+typename LockFreeSkipList<Key, Value>::SNode* LockFreeSkipList<Key, Value>::firstAtLeast(const Key& key) const
+{
+    const std::atomic<uintptr_t>* pred = head_;
+    SNode* curr = nullptr;
+    for (int level = MAX_LEVEL - 1; level >= 0; --level) {
+        curr = toNode(pred[level].load());
+        while (curr != nullptr) {
+            uintptr_t succ = curr->getNext()[level].load();
+            if (isMarked(succ)) {
+                curr = toNode(succ);
+            } else if (curr->getKey() < key) {
+                pred = curr->getNext();
+                curr = toNode(succ);
+            } else {
+                break;
+            }
+        }
+    }
+    return curr;
+}
+
+/**
+* Inserts key, or swaps in the new value if it is present.
+*/
+template<class Key, class Value>
+void LockFreeSkipList<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+    Guard guard(*this);
+    std::atomic<uintptr_t>* preds[MAX_LEVEL];
+    SNode* succs[MAX_LEVEL];
+
+    while (true) {
+        if (search(new_item.first, preds, succs)) {
+            Value* old = succs[0]->value.exchange(new Value(new_item.second));
+            guard.retire(nullptr, old);
+            return;
+        }
+
+        int height = randomHeight();
+        SNode* node = SNode::create(new_item.first, new_item.second, height);
+        for (int level = 0; level < height; ++level) {
+            node->getNext()[level].store(reinterpret_cast<uintptr_t>(succs[level]), std::memory_order_relaxed);
+        }
+        uintptr_t expected = reinterpret_cast<uintptr_t>(succs[0]);
+        if (!preds[0][0].compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node))) {
+            SNode::destroy(node);
+            continue;
+        }
+        size_.fetch_add(1);
+
+        //The node is in the map now; the upper levels are only shortcuts
+        bool abandoned = false;
+        for (int level = 1; level < height && !abandoned; ++level) {
+            while (true) {
+                uintptr_t next = node->getNext()[level].load();
+                if (isMarked(next)) { //Removed already, stop linking
+                    abandoned = true;
+                    break;
+                }
+                uintptr_t succ = reinterpret_cast<uintptr_t>(succs[level]);
+                if (next != succ && !node->getNext()[level].compare_exchange_strong(next, succ)) {
+                    continue;
+                }
+                if (preds[level][level].compare_exchange_strong(succ, reinterpret_cast<uintptr_t>(node))) {
+                    break;
+                }
+                search(new_item.first, preds, succs);
+                if (succs[0] != node) {
+                    abandoned = true;
+                    break;
+                }
+            }
+        }
+
+        //A remove that raced the linking may have missed a level; unlink it
+        //here, and let whichever of us finishes last retire the node
+        if (isMarked(node->getNext()[0].load())) {
+            search(new_item.first, preds, succs);
+        }
+        if (node->released.exchange(true)) {
+            guard.retire(node, nullptr);
+        }
+        return;
+    }
+}
+
+/**
+* Removes key and returns true, or returns false if it was missing (or
+* another thread removed it first).
+*/
+template<class Key, class Value>
+bool LockFreeSkipList<Key, Value>::remove(const Key& key)
+{
+    Guard guard(*this);
+    std::atomic<uintptr_t>* preds[MAX_LEVEL];
+    SNode* succs[MAX_LEVEL];
+
+    if (!search(key, preds, succs)) {
+        return false;
+    }
+    SNode* node = succs[0];
+    for (int level = node->getHeight() - 1; level >= 1; --level) {
+        uintptr_t next = node->getNext()[level].load();
+        while (!isMarked(next)) {
+            node->getNext()[level].compare_exchange_weak(next, next | 1);
+        }
+    }
+    uintptr_t next = node->getNext()[0].load();
+    while (true) {
+        if (isMarked(next)) {
+            return false;
+        }
+        if (node->getNext()[0].compare_exchange_strong(next, next | 1)) {
+            break;
+        }
+    }
+    size_.fetch_sub(1);
+
+    search(key, preds, succs);
+    if (node->released.exchange(true)) {
+        guard.retire(node, nullptr);
+    }
+    return true;
+}
+
+/**
+* Copies the value for key into value and returns true, or returns false if
+* key is missing.
+*/
+template<class Key, class Value>
+bool LockFreeSkipList<Key, Value>::lookup(const Key& key, Value& value) const
+{
+    Guard guard(*this);
+    SNode* node = firstAtLeast(key);
+    if (node == nullptr || key < node->getKey()) {
+        return false;
+    }
+    value = *node->value.load();
+    return true;
+}
+
+template<class Key, class Value>
+bool LockFreeSkipList<Key, Value>::contains(const Key& key) const
+{
+    Guard guard(*this);
+    SNode* node = firstAtLeast(key);
+    return node != nullptr && !(key < node->getKey());
+}
+
+/**
+* A copy of the value for key. Throws std::out_of_range if key is missing.
+*/
+template<class Key, class Value>
+Value LockFreeSkipList<Key, Value>::get(const Key& key) const
+{
+    Value value;
+    if (!lookup(key, value)) {
+        throw std::out_of_range("Invalid key");
+    }
+    return value;
+}
+
+template<class Key, class Value>
+typename LockFreeSkipList<Key, Value>::iterator
+LockFreeSkipList<Key, Value>::begin() const
+{
+    std::shared_ptr<Guard> guard(new Guard(*this));
+    SNode* node = toNode(head_[0].load());
+    while (node != nullptr && isMarked(node->getNext()[0].load())) {
+        node = toNode(node->getNext()[0].load());
+    }
+    return iterator(guard, node);
+}
+
+template<class Key, class Value>
+typename LockFreeSkipList<Key, Value>::iterator
+LockFreeSkipList<Key, Value>::end() const
+{
+    return iterator();
+}
+
+template<class Key, class Value>
+typename LockFreeSkipList<Key, Value>::iterator
+LockFreeSkipList<Key, Value>::lower_bound(const Key& key) const
+{
+    std::shared_ptr<Guard> guard(new Guard(*this));
+    return iterator(guard, firstAtLeast(key));
+}
+
+template<class Key, class Value>
+typename LockFreeSkipList<Key, Value>::iterator
+LockFreeSkipList<Key, Value>::find(const Key& key) const
+{
+    std::shared_ptr<Guard> guard(new Guard(*this));
+    SNode* node = firstAtLeast(key);
+    if (node == nullptr || key < node->getKey()) {
+        return end();
+    }
+    return iterator(guard, node);
+}
+
+/**
+* Items present, exact when no write is in flight.
+*/
+template<class Key, class Value>
+size_t LockFreeSkipList<Key, Value>::size() const
+{
+    return size_.load(std::memory_order_relaxed);
+}
+
+template<class Key, class Value>
+bool LockFreeSkipList<Key, Value>::empty() const
+{
+    return size() == 0;
+}
+
+/*
+ * Starts a new epoch and frees the slot's retired entries from before the
+ * oldest epoch any slot has announced. Only the slot's owner calls this.
+ */
+template<class Key, class Value>
+void LockFreeSkipList<Key, Value>::reclaim(Slot& slot) const
+{
+    uint64_t oldest = epoch_.fetch_add(1) + 1;
+    for (size_t i = 0; i < SLOTS; ++i) {
+        uint64_t epoch = slots_[i].epoch.load();
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < slot.retired.size(); ++i) {
+        if (slot.retired[i].epoch < oldest) {
+            SNode::destroy(slot.retired[i].node);
+            delete slot.retired[i].value;
+        } else {
+            slot.retired[kept++] = slot.retired[i];
+        }
+    }
+    slot.retired.resize(kept);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the LockFreeSkipList class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include "bst.h"
+
+/**
+* A self-adjusting Splay tree built on plain Nodes. Every insert, remove and
+* (non-const) lookup splays the key it touched to the root, so frequently
+* used keys gather near the top of the tree. The splay is the top-down
+* variant, which restructures the search path in a single pass down the tree
+* with no recursion and no second pass back up.
+*
+* Lookups through a const tree use the ordinary BinarySearchTree::find and
+* leave the shape alone.
+*/
+template <class Key, class Value>
+class SplayTree : public BinarySearchTree<Key, Value>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+    using BinarySearchTree<Key, Value>::find;
+    using BinarySearchTree<Key, Value>::operator[];
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+    iterator find(const Key& key);
+    Value& operator[](const Key& key);
+    virtual void setMultimap(bool multimap);
+
+protected:
+    virtual void eraseNode(Node<Key, Value>* node);
+
+    // Helper functions
+    void splay(const Key& key);
+};
+
+/*
+ * Top-down splay: walks from the root towards key, peeling the nodes it
+ * passes into a left tree (keys < key) and a right tree (keys > key). Zig-zig
+ * steps rotate first, which is what halves the depth of the path. At the end
+ * the last node reached becomes the root with the two side trees as its
+ * subtrees. Parent links are fixed up as nodes are moved.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::splay(const Key& key)
+{
+    Node<Key, Value>* current = this->root_;
+    if (current == nullptr) {
+        return;
+    }
+
+    Node<Key, Value>* leftRoot = nullptr;  //Tree of nodes smaller than key
+    Node<Key, Value>* leftMax = nullptr;   //...and its largest node, where the next one is hung
+    Node<Key, Value>* rightRoot = nullptr; //Tree of nodes larger than key
+    Node<Key, Value>* rightMin = nullptr;  //...and its smallest node
+
+    while (true) {
+        if (key < current->getKey()) {
+            Node<Key, Value>* child = current->getLeft();
+            if (child == nullptr) {
+                break;
+            }
+            if (key < child->getKey()) { //Zig-zig: rotate right first
+                current->setLeft(child->getRight());
+                if (child->getRight() != nullptr) {
+                    child->getRight()->setParent(current);
+                }
+                child->setRight(current);
+                current->setParent(child);
+                current = child;
+                if (current->getLeft() == nullptr) {
+                    break;
+                }
+            }
+            //Hang current (and its right subtree) on the right tree
+            if (rightMin == nullptr) {
+                rightRoot = current;
+                current->setParent(nullptr);
+            } else {
+                rightMin->setLeft(current);
+                current->setParent(rightMin);
+            }
+            rightMin = current;
+            current = current->getLeft();
+        } else if (current->getKey() < key) {
+            Node<Key, Value>* child = current->getRight();
+            if (child == nullptr) {
+                break;
+            }
+            if (child->getKey() < key) { //Zag-zag: rotate left first
+                current->setRight(child->getLeft());
+                if (child->getLeft() != nullptr) {
+                    child->getLeft()->setParent(current);
+                }
+                child->setLeft(current);
+                current->setParent(child);
+                current = child;
+                if (current->getRight() == nullptr) {
+                    break;
+                }
+            }
+            //Hang current (and its left subtree) on the left tree
+            if (leftMax == nullptr) {
+                leftRoot = current;
+                current->setParent(nullptr);
+            } else {
+                leftMax->setRight(current);
+                current->setParent(leftMax);
+            }
+            leftMax = current;
+            current = current->getRight();
+        } else {
+            break;
+        }
+    }
+
+    //Reassemble: current's subtrees go to the inner edges of the side trees
+    if (leftMax != nullptr) {
+        leftMax->setRight(current->getLeft());
+        if (current->getLeft() != nullptr) {
+            current->getLeft()->setParent(leftMax);
+        }
+        current->setLeft(leftRoot);
+        leftRoot->setParent(current);
+    }
+    if (rightMin != nullptr) {
+        rightMin->setLeft(current->getRight());
+        if (current->getRight() != nullptr) {
+            current->getRight()->setParent(rightMin);
+        }
+        current->setRight(rightRoot);
+        rightRoot->setParent(current);
+    }
+    current->setParent(nullptr);
+    this->root_ = current;
+}
+
+/*
+ * If the key is already in the tree the value is overwritten. Either way the
+ * key ends up at the root.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    if (this->root_ == nullptr) {
+        this->root_ = new Node<Key, Value>(new_item.first, new_item.second, nullptr);
+        return;
+    }
+
+    splay(new_item.first);
+    Node<Key, Value>* root = this->root_;
+    if (!(new_item.first < root->getKey()) && !(root->getKey() < new_item.first)) {
+        root->setValue(new_item.second);
+        return;
+    }
+
+    //The root is now the neighbour of the new key, so the new node splits it off
+    Node<Key, Value>* newNode = new Node<Key, Value>(new_item.first, new_item.second, nullptr);
+    if (new_item.first < root->getKey()) {
+        newNode->setLeft(root->getLeft());
+        newNode->setRight(root);
+        root->setLeft(nullptr);
+    } else {
+        newNode->setRight(root->getRight());
+        newNode->setLeft(root);
+        root->setRight(nullptr);
+    }
+    if (newNode->getLeft() != nullptr) {
+        newNode->getLeft()->setParent(newNode);
+    }
+    if (newNode->getRight() != nullptr) {
+        newNode->getRight()->setParent(newNode);
+    }
+    this->root_ = newNode;
+}
+
+/*
+ * Splays the key to the root, removes it, and joins the two subtrees by
+ * splaying the largest key of the left one to its root.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::remove(const Key& key)
+{
+    splay(key);
+    Node<Key, Value>* root = this->root_;
+    if (root == nullptr || root->getKey() < key || key < root->getKey()) {
+        return;
+    }
+
+    Node<Key, Value>* left = root->getLeft();
+    Node<Key, Value>* right = root->getRight();
+    delete root;
+
+    if (left == nullptr) {
+        this->root_ = right;
+        if (right != nullptr) {
+            right->setParent(nullptr);
+        }
+        return;
+    }
+
+    left->setParent(nullptr);
+    this->root_ = left;
+    splay(key); //Everything on the left is smaller, so its maximum comes up with no right child
+    this->root_->setRight(right);
+    if (right != nullptr) {
+        right->setParent(this->root_);
+    }
+}
+
+//Removal by node is removal of its key; duplicates are never allowed here
+template<class Key, class Value>
+void SplayTree<Key, Value>::eraseNode(Node<Key, Value>* node)
+{
+    Key key = node->getKey(); //remove() frees the node before its second splay
+    remove(key);
+}
+
+/**
+* Looks up key and splays it (or the last node on its search path) to the root.
+*/
+template<class Key, class Value>
+typename SplayTree<Key, Value>::iterator
+SplayTree<Key, Value>::find(const Key& key)
+{
+    splay(key);
+    Node<Key, Value>* root = this->root_;
+    if (root == nullptr || root->getKey() < key || key < root->getKey()) {
+        return this->end();
+    }
+    return BinarySearchTree<Key, Value>::find(key); //Root hit, so this is O(1)
+}
+
+/**
+* Splaying brings an arbitrary one of several equal keys to the root, which
+* would lose the insertion order of duplicates, so multimap mode is refused.
+*/
+template<class Key, class Value>
+void SplayTree<Key, Value>::setMultimap(bool multimap)
+{
+    if (multimap) {
+        throw std::logic_error("SplayTree does not support multimap mode");
+    }
+}
+
+template<class Key, class Value>
+Value& SplayTree<Key, Value>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == this->end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef STRINGKEY_H
+#define STRINGKEY_H
+
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include "avlbst.h"
+
+/**
+* A string key for the search trees that keeps its first 8 bytes inline, in
+* big-endian order so that comparing the prefixes as integers compares the
+* strings. Most comparisons during a descent are decided by the prefix alone
+* and never touch the string bytes; only keys that share their first 8 bytes
+* fall back to memcmp. Keys of 8 bytes or less live entirely in the prefix
+* and keep no pointer at all.
+*
+* A StringKey does not own its bytes. Keys stored in a tree should come from
+* a StringArena that outlives the tree; keys used only for a lookup can view
+* any buffer, e.g. StringKey(query) for a std::string query.
+*/
+class StringKey
+{
+public:
+    StringKey() : prefix_(0), data_(nullptr), length_(0) { }
+    StringKey(const char* data, size_t length) :
+        prefix_(loadPrefix(data, length)), data_((length > 8) ? data : nullptr), length_((uint32_t)length) { }
+    explicit StringKey(const std::string& text) :
+        prefix_(loadPrefix(text.data(), text.size())), data_((text.size() > 8) ? text.data() : nullptr),
+        length_((uint32_t)text.size()) { }
+
+    size_t size() const { return length_; }
+    uint64_t prefix() const { return prefix_; }
+    char at(size_t i) const { return (i < 8) ? (char)(prefix_ >> (56 - 8 * i)) : data_[i]; }
+    std::string str() const;
+
+    int compare(const StringKey& other) const;
+
+protected:
+    static uint64_t loadPrefix(const char* data, size_t length);
+
+    uint64_t prefix_;
+    const char* data_;
+    uint32_t length_;
+};
+
+//Packs up to the first 8 bytes big-endian, zero padded
+inline uint64_t StringKey::loadPrefix(const char* data, size_t length)
+{
+    uint64_t prefix = 0;
+    size_t n = (length < 8) ? length : 8;
+    for (size_t i = 0; i < 8; ++i) {
+        prefix <<= 8;
+        if (i < n) {
+            prefix |= (unsigned char)data[i];
+        }
+    }
+    return prefix;
+}
+
+inline std::string StringKey::str() const
+{
+    if (length_ > 8) {
+        return std::string(data_, length_);
+    }
+    std::string text(length_, '\0');
+    for (size_t i = 0; i < length_; ++i) {
+        text[i] = at(i);
+    }
+    return text;
+}
+
+/**
+* Negative, zero or positive like memcmp. Zero padding makes "ab" and
+* "ab\0" share a prefix, so equal prefixes are settled by the remaining
+* bytes and then the lengths.
+*/
+inline int StringKey::compare(const StringKey& other) const
+{
+    if (prefix_ != other.prefix_) {
+        return (prefix_ < other.prefix_) ? -1 : 1;
+    }
+    if (length_ > 8 && other.length_ > 8) {
+        size_t common = ((length_ < other.length_) ? length_ : other.length_) - 8;
+        int result = std::memcmp(data_ + 8, other.data_ + 8, common);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return (length_ < other.length_) ? -1 : (length_ > other.length_) ? 1 : 0;
+}
+
+inline bool operator<(const StringKey& a, const StringKey& b) { return a.compare(b) < 0; }
+inline bool operator>(const StringKey& a, const StringKey& b) { return a.compare(b) > 0; }
+inline bool operator==(const StringKey& a, const StringKey& b) { return a.compare(b) == 0; }
+inline bool operator!=(const StringKey& a, const StringKey& b) { return a.compare(b) != 0; }
+
+inline std::ostream& operator<<(std::ostream& out, const StringKey& key)
+{
+    return out << key.str();
+}
+
+namespace std
+{
+    template<>
+    struct hash<StringKey>
+    {
+        size_t operator()(const StringKey& key) const
+        {
+            //FNV-1a over the bytes
+            uint64_t h = 14695981039346656037ull;
+            for (size_t i = 0; i < key.size(); ++i) {
+                h ^= (unsigned char)key.at(i);
+                h *= 1099511628211ull;
+            }
+            return (size_t)h;
+        }
+    };
+}
+
+/**
+* Bump allocator for key bytes: strings are copied into large shared chunks
+* instead of one heap allocation per key, and everything is freed together
+* when the arena is destroyed. Keys that fit in the prefix take no space.
+*/
+class StringArena
+{
+public:
+    explicit StringArena(size_t chunkBytes = 1 << 16) : chunkBytes_(chunkBytes), used_(chunkBytes) { }
+    ~StringArena()
+    {
+        for (size_t i = 0; i < chunks_.size(); ++i) {
+            delete[] chunks_[i];
+        }
+    }
+
+    StringKey key(const char* data, size_t length);
+    StringKey key(const std::string& text) { return key(text.data(), text.size()); }
+
+private:
+    StringArena(const StringArena&);
+    StringArena& operator=(const StringArena&);
+
+    size_t chunkBytes_;
+    size_t used_;                // bytes used in chunks_.back()
+    std::vector<char*> chunks_;
+};
+
+/**
+* Returns a key whose bytes are owned by the arena.
+*/
+inline StringKey StringArena::key(const char* data, size_t length)
+{
+    if (length <= 8) { //The prefix holds it all
+        return StringKey(data, length);
+    }
+    if (length > chunkBytes_) { //Oversized keys get a chunk of their own
+        char* chunk = new char[length];
+        std::memcpy(chunk, data, length);
+        chunks_.insert(chunks_.end() - (chunks_.empty() ? 0 : 1), chunk);
+        return StringKey(chunk, length);
+    }
+    if (used_ + length > chunkBytes_) {
+        chunks_.push_back(new char[chunkBytes_]);
+        used_ = 0;
+    }
+    char* copy = chunks_.back() + used_;
+    std::memcpy(copy, data, length);
+    used_ += length;
+    return StringKey(copy, length);
+}
+
+/**
+* An AVLTree keyed by arena-backed strings.
+*/
+template <class Value>
+using StringAVLTree = AVLTree<StringKey, Value>;
+
+#endif
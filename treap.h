@@ -0,0 +1,397 @@
+#ifndef TREAP_H
+#define TREAP_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <functional>
+#include "bst.h"
+
+/**
+* A node for a Treap: a regular Node plus a heap priority.
+*/
+template <typename Key, typename Value>
+class TreapNode : public Node<Key, Value>
+{
+public:
+    // Constructor/destructor.
+    TreapNode(const Key& key, const Value& value, TreapNode<Key, Value>* parent, uint32_t priority);
+    virtual ~TreapNode();
+
+    uint32_t getPriority() const;
+
+    // Getters for parent, left, and right, redefined to return TreapNodes.
+    virtual TreapNode<Key, Value>* getParent() const override;
+    virtual TreapNode<Key, Value>* getLeft() const override;
+    virtual TreapNode<Key, Value>* getRight() const override;
+
+protected:
+    uint32_t priority_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the TreapNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+TreapNode<Key, Value>::TreapNode(const Key& key, const Value& value, TreapNode<Key, Value> *parent, uint32_t priority) :
+    Node<Key, Value>(key, value, parent), priority_(priority)
+{
+
+}
+
+template<class Key, class Value>
+TreapNode<Key, Value>::~TreapNode()
+{
+
+}
+
+template<class Key, class Value>
+uint32_t TreapNode<Key, Value>::getPriority() const
+{
+    return priority_;
+}
+
+template<class Key, class Value>
+TreapNode<Key, Value> *TreapNode<Key, Value>::getParent() const
+{
+    return static_cast<TreapNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+TreapNode<Key, Value> *TreapNode<Key, Value>::getLeft() const
+{
+    return static_cast<TreapNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+TreapNode<Key, Value> *TreapNode<Key, Value>::getRight() const
+{
+    return static_cast<TreapNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the TreapNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A randomized search tree: ordered by key, and a max-heap on priorities.
+* Priorities are a mixed hash of the key and the tree's seed, so the shape
+* (and therefore performance) is reproducible for a given seed and key set.
+*
+* Besides the usual map operations it supports expected O(log n) split and
+* merge, which makes moving or dropping whole key ranges cheap.
+*/
+template <class Key, class Value>
+class Treap : public BinarySearchTree<Key, Value>
+{
+public:
+    explicit Treap(uint64_t seed = 0x9E3779B97F4A7C15ull);
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+
+    void split(const Key& key, Treap<Key, Value>& right);
+    void merge(Treap<Key, Value>& right);
+    void removeRange(const Key& lo, const Key& hi);
+    virtual void rebalance();
+
+protected:
+    virtual void eraseNode(Node<Key, Value>* node);
+
+    // Helper functions
+    uint32_t priorityFor(const Key& key) const;
+    void rotateLeft(TreapNode<Key, Value>* node);
+    void rotateRight(TreapNode<Key, Value>* node);
+    TreapNode<Key, Value>* getRoot() const;
+    static void splitNodes(TreapNode<Key, Value>* node, const Key& key,
+                           TreapNode<Key, Value>*& left, TreapNode<Key, Value>*& right);
+    static TreapNode<Key, Value>* mergeNodes(TreapNode<Key, Value>* left, TreapNode<Key, Value>* right);
+
+    uint64_t seed_;
+};
+
+template<class Key, class Value>
+Treap<Key, Value>::Treap(uint64_t seed) :
+    seed_(seed)
+{
+
+}
+
+template<class Key, class Value>
+TreapNode<Key, Value> *Treap<Key, Value>::getRoot() const
+{
+    return static_cast<TreapNode<Key, Value>*>(this->root_);
+}
+
+//splitmix64 finalizer over the key's hash, so poor std::hash values still spread out
+template<class Key, class Value>
+uint32_t Treap<Key, Value>::priorityFor(const Key& key) const
+{
+    uint64_t z = (uint64_t)std::hash<Key>()(key) + seed_;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+//Rotate left around node; its right child takes its place
+template<class Key, class Value>
+void Treap<Key, Value>::rotateLeft(TreapNode<Key, Value>* node)
+{
+    TreapNode<Key, Value>* child = node->getRight();
+    TreapNode<Key, Value>* parent = node->getParent();
+
+    node->setRight(child->getLeft());
+    if (child->getLeft() != nullptr) {
+        child->getLeft()->setParent(node);
+    }
+    child->setParent(parent);
+    if (parent == nullptr) {
+        this->root_ = child;
+    } else if (parent->getLeft() == node) {
+        parent->setLeft(child);
+    } else {
+        parent->setRight(child);
+    }
+    child->setLeft(node);
+    node->setParent(child);
+}
+
+//Rotate right around node; its left child takes its place
+template<class Key, class Value>
+void Treap<Key, Value>::rotateRight(TreapNode<Key, Value>* node)
+{
+    TreapNode<Key, Value>* child = node->getLeft();
+    TreapNode<Key, Value>* parent = node->getParent();
+
+    node->setLeft(child->getRight());
+    if (child->getRight() != nullptr) {
+        child->getRight()->setParent(node);
+    }
+    child->setParent(parent);
+    if (parent == nullptr) {
+        this->root_ = child;
+    } else if (parent->getLeft() == node) {
+        parent->setLeft(child);
+    } else {
+        parent->setRight(child);
+    }
+    child->setRight(node);
+    node->setParent(child);
+}
+
+/*
+ * Inserts as a leaf and rotates the new node up until its parent has a
+ * higher priority. Existing keys get their value overwritten.
+ */
+template<class Key, class Value>
+void Treap<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    TreapNode<Key, Value>* parent = nullptr;
+    TreapNode<Key, Value>* currentNode = getRoot();
+
+    while (currentNode != nullptr) {
+        if (new_item.first < currentNode->getKey()) {
+            parent = currentNode;
+            currentNode = currentNode->getLeft();
+        } else if (new_item.first > currentNode->getKey() || this->multimap_) {
+            parent = currentNode;
+            currentNode = currentNode->getRight();
+        } else {
+            currentNode->setValue(new_item.second);
+            return;
+        }
+    }
+
+    TreapNode<Key, Value>* newNode =
+        new TreapNode<Key, Value>(new_item.first, new_item.second, parent, priorityFor(new_item.first));
+    if (parent == nullptr) {
+        this->root_ = newNode;
+        return;
+    }
+    if (newNode->getKey() < parent->getKey()) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+
+    while (newNode->getParent() != nullptr && newNode->getParent()->getPriority() < newNode->getPriority()) {
+        if (newNode->getParent()->getLeft() == newNode) {
+            rotateRight(newNode->getParent());
+        } else {
+            rotateLeft(newNode->getParent());
+        }
+    }
+}
+
+/*
+ * Rotates the node down (towards its higher priority child) until it is a
+ * leaf, then unlinks it.
+ */
+template<class Key, class Value>
+void Treap<Key, Value>::eraseNode(Node<Key, Value>* node)
+{
+    TreapNode<Key, Value>* removeNode = static_cast<TreapNode<Key, Value>*>(node);
+    while (removeNode->getLeft() != nullptr && removeNode->getRight() != nullptr) {
+        if (removeNode->getLeft()->getPriority() > removeNode->getRight()->getPriority()) {
+            rotateRight(removeNode);
+        } else {
+            rotateLeft(removeNode);
+        }
+    }
+
+    TreapNode<Key, Value>* child = (removeNode->getLeft() != nullptr) ? removeNode->getLeft() : removeNode->getRight();
+    TreapNode<Key, Value>* parent = removeNode->getParent();
+    if (child != nullptr) {
+        child->setParent(parent);
+    }
+    if (parent == nullptr) {
+        this->root_ = child;
+    } else if (parent->getLeft() == removeNode) {
+        parent->setLeft(child);
+    } else {
+        parent->setRight(child);
+    }
+    delete removeNode;
+}
+
+/*
+ * Helper that splits the subtree at node into keys < key (left) and
+ * keys >= key (right). Only nodes on one root-to-leaf path are touched.
+ */
+template<class Key, class Value>
+void Treap<Key, Value>::splitNodes(TreapNode<Key, Value>* node, const Key& key,
+                                   TreapNode<Key, Value>*& left, TreapNode<Key, Value>*& right)
+{
+    if (node == nullptr) {
+        left = nullptr;
+        right = nullptr;
+        return;
+    }
+    if (node->getKey() < key) { //node and its left subtree stay on the left
+        TreapNode<Key, Value>* rest = nullptr;
+        splitNodes(node->getRight(), key, rest, right);
+        node->setRight(rest);
+        if (rest != nullptr) {
+            rest->setParent(node);
+        }
+        left = node;
+    } else { //node and its right subtree go right
+        TreapNode<Key, Value>* rest = nullptr;
+        splitNodes(node->getLeft(), key, left, rest);
+        node->setLeft(rest);
+        if (rest != nullptr) {
+            rest->setParent(node);
+        }
+        right = node;
+    }
+}
+
+/*
+ * Helper that joins two subtrees where every key in left is smaller than
+ * every key in right, keeping the higher priority on top.
+ */
+template<class Key, class Value>
+TreapNode<Key, Value>* Treap<Key, Value>::mergeNodes(TreapNode<Key, Value>* left, TreapNode<Key, Value>* right)
+{
+    if (left == nullptr) {
+        return right;
+    }
+    if (right == nullptr) {
+        return left;
+    }
+    if (left->getPriority() > right->getPriority()) {
+        TreapNode<Key, Value>* merged = mergeNodes(left->getRight(), right);
+        left->setRight(merged);
+        merged->setParent(left);
+        return left;
+    } else {
+        TreapNode<Key, Value>* merged = mergeNodes(left, right->getLeft());
+        right->setLeft(merged);
+        merged->setParent(right);
+        return right;
+    }
+}
+
+/**
+* Moves every item with a key >= key into right, which must be empty.
+* Expected O(log n).
+*/
+template<class Key, class Value>
+void Treap<Key, Value>::split(const Key& key, Treap<Key, Value>& right)
+{
+    if (!right.empty()) {
+        throw std::invalid_argument("Treap::split target must be empty");
+    }
+    TreapNode<Key, Value>* low = nullptr;
+    TreapNode<Key, Value>* high = nullptr;
+    splitNodes(getRoot(), key, low, high);
+    this->root_ = low;
+    right.root_ = high;
+    if (low != nullptr) {
+        low->setParent(nullptr);
+    }
+    if (high != nullptr) {
+        high->setParent(nullptr);
+    }
+}
+
+/**
+* Moves every item of right (whose keys must all be greater than the keys in
+* this tree) into this tree, leaving right empty. Expected O(log n).
+*/
+template<class Key, class Value>
+void Treap<Key, Value>::merge(Treap<Key, Value>& right)
+{
+    if (&right == this || right.empty()) {
+        return;
+    }
+    if (!this->empty()) {
+        Node<Key, Value>* largest = this->root_;
+        while (largest->getRight() != nullptr) {
+            largest = largest->getRight();
+        }
+        if (!(largest->getKey() < right.getSmallestNode()->getKey())) {
+            throw std::invalid_argument("Treap::merge ranges overlap");
+        }
+    }
+    this->root_ = mergeNodes(getRoot(), right.getRoot());
+    this->root_->setParent(nullptr);
+    right.root_ = nullptr;
+}
+
+/**
+* Removes every item with lo <= key < hi using two splits and a merge, so
+* only the removed nodes are visited beyond the O(log n) paths.
+*/
+template<class Key, class Value>
+void Treap<Key, Value>::removeRange(const Key& lo, const Key& hi)
+{
+    if (!(lo < hi)) {
+        return;
+    }
+    Treap<Key, Value> middle(seed_);
+    Treap<Key, Value> upper(seed_);
+    split(lo, middle);
+    middle.split(hi, upper);
+    middle.clear();
+    merge(upper);
+}
+
+/**
+* A treap's shape is fixed by its priorities and is already balanced in
+* expectation, so this leaves the tree alone: the base DSW fold would break
+* the heap order.
+*/
+template<class Key, class Value>
+void Treap<Key, Value>::rebalance()
+{
+
+}
+
+#endif
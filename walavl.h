@@ -0,0 +1,603 @@
+#ifndef WALAVL_H
+#define WALAVL_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "avlbst.h"
+
+/**
+* Controls how log records are batched. Records are buffered in memory and
+* written together once groupCommitRecords or groupCommitBytes is reached
+* (a group commit); every syncEvery group commits the log is also fsync'd.
+* syncEvery == 0 leaves syncing to the OS, and commit() always syncs.
+*/
+struct WalOptions
+{
+    WalOptions() : groupCommitRecords(256), groupCommitBytes(1u << 20), syncEvery(1) { }
+
+    size_t groupCommitRecords;
+    size_t groupCommitBytes;
+    size_t syncEvery;
+};
+
+/**
+* An AVLTree whose insert/remove calls can be recorded in an append-only
+* write-ahead log. A mutation is durable once the group commit containing it
+* has been synced (or after commit() returns); on restart, recover() loads the
+* latest snapshot and replays the log on top of it.
+*
+* Keys and values are logged as raw bytes, so both must be trivially copyable.
+*
+* Every change has to reach the log, so values can only be changed with
+* insert() and apply_batch(): only the const operator[] is exposed, and
+* iterators are read-only.
+*/
+template <class Key, class Value>
+class LoggedAVLTree : public AVLTree<Key, Value>
+{
+    static_assert(std::is_trivially_copyable<Key>::value, "logged keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "logged values must be trivially copyable");
+
+public:
+    LoggedAVLTree();
+    virtual ~LoggedAVLTree();
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class LoggedAVLTree<Key, Value>;
+        explicit iterator(const typename AVLTree<Key, Value>::iterator& it);
+
+        typename AVLTree<Key, Value>::iterator it_;
+    };
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+    virtual void apply_batch(const std::vector<BatchUpdate<Key, Value> >& updates, unsigned threads = 1);
+    virtual void clear();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+    Value const & operator[](const Key& key) const;
+
+    void openLog(const std::string& path, const WalOptions& options = WalOptions());
+    void closeLog();
+    bool logging() const;
+    void commit();
+
+    void snapshot(const std::string& snapshotPath);
+    void recover(const std::string& snapshotPath, const std::string& logPath);
+
+protected:
+    enum RecordType { WAL_INSERT = 1, WAL_REMOVE = 2, WAL_CLEAR = 3 };
+
+    virtual void eraseNode(Node<Key, Value>* removeNode);
+    virtual void linkSorted(std::vector<AVLNode<Key, Value>*>& nodes);
+    void appendRecord(uint8_t type, const Key* key, const Value* value);
+    void flushBuffer(bool sync);
+    void replayLog(const std::string& logPath);
+    static uint32_t checksum(const char* data, size_t length);
+    static size_t recordSize(uint8_t type);
+
+private:
+    int fd_;
+    WalOptions options_;
+    std::vector<char> buffer_;
+    size_t buffered_;       // records in buffer_
+    size_t unsynced_;       // group commits written since the last fsync
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LoggedAVLTree::iterator class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+LoggedAVLTree<Key, Value>::iterator::iterator() :
+    it_()
+{
+
+}
+
+template<class Key, class Value>
+LoggedAVLTree<Key, Value>::iterator::iterator(const typename AVLTree<Key, Value>::iterator& it) :
+    it_(it)
+{
+
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>& LoggedAVLTree<Key, Value>::iterator::operator*() const
+{
+    return *it_;
+}
+
+template<class Key, class Value>
+const std::pair<const Key, Value>* LoggedAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(*it_);
+}
+
+template<class Key, class Value>
+bool LoggedAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+template<class Key, class Value>
+bool LoggedAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<class Key, class Value>
+typename LoggedAVLTree<Key, Value>::iterator&
+LoggedAVLTree<Key, Value>::iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the LoggedAVLTree::iterator class.
+  ---------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LoggedAVLTree class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value>
+LoggedAVLTree<Key, Value>::LoggedAVLTree() :
+    fd_(-1), buffered_(0), unsynced_(0)
+{
+
+}
+
+/**
+* Closing flushes and syncs whatever is still buffered.
+*/
+template<class Key, class Value>
+LoggedAVLTree<Key, Value>::~LoggedAVLTree()
+{
+    try {
+        closeLog();
+    } catch (...) {
+        //Never throw from a destructor; the records are lost like in a crash
+    }
+}
+
+/*
+ * A record is: type (1 byte), checksum of the rest (4 bytes), key bytes
+ * (none for a clear), and for inserts the value bytes. A torn or corrupt
+ * tail fails the checksum and ends replay.
+ */
+template<class Key, class Value>
+size_t LoggedAVLTree<Key, Value>::recordSize(uint8_t type)
+{
+    return 1 + sizeof(uint32_t) + (type == WAL_CLEAR ? 0 : sizeof(Key)) + (type == WAL_INSERT ? sizeof(Value) : 0);
+}
+
+//FNV-1a, which is plenty to detect a torn write
+template<class Key, class Value>
+uint32_t LoggedAVLTree<Key, Value>::checksum(const char* data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    if (fd_ >= 0) {
+        appendRecord(WAL_INSERT, &new_item.first, &new_item.second);
+    }
+    AVLTree<Key, Value>::insert(new_item);
+}
+
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::remove(const Key& key)
+{
+    if (fd_ >= 0) {
+        appendRecord(WAL_REMOVE, &key, nullptr);
+    }
+    AVLTree<Key, Value>::remove(key);
+}
+
+/**
+* Logged as a single record, so replay drops everything before it,
+* including what the snapshot holds.
+*/
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::clear()
+{
+    if (fd_ >= 0) {
+        appendRecord(WAL_CLEAR, nullptr, nullptr);
+    }
+    AVLTree<Key, Value>::clear();
+}
+
+/*
+ * Removes that skip the key search (erase by iterator, pop_min/pop_max) are
+ * logged as removes of the node's key. That replays exactly unless multimap
+ * mode left older duplicates of the key in the tree.
+ */
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::eraseNode(Node<Key, Value>* removeNode)
+{
+    if (fd_ >= 0) {
+        appendRecord(WAL_REMOVE, &removeNode->getKey(), nullptr);
+    }
+    AVLTree<Key, Value>::eraseNode(removeNode);
+}
+
+/*
+ * A bulk load into an empty tree (insertSorted) skips insert(), so its
+ * items are logged here, once, after duplicates in the run are folded.
+ * insertSorted on a non-empty tree goes through insert() and is logged
+ * there.
+ */
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::linkSorted(std::vector<AVLNode<Key, Value>*>& nodes)
+{
+    if (fd_ >= 0) {
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            appendRecord(WAL_INSERT, &nodes[i]->getKey(), &nodes[i]->getValue());
+        }
+    }
+    AVLTree<Key, Value>::linkSorted(nodes);
+}
+
+/**
+* Logs the merged updates in batch order. The batch is logged after it is
+* applied, so an unsorted batch (which throws) leaves no records behind;
+* nothing is durable before commit anyway. A multimap tree applies the
+* batch through insert() and remove(), which log each update themselves.
+*/
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::apply_batch(const std::vector<BatchUpdate<Key, Value> >& updates, unsigned threads)
+{
+    AVLTree<Key, Value>::apply_batch(updates, threads);
+    if (fd_ >= 0 && !this->isMultimap()) {
+        for (size_t i = 0; i < updates.size(); ++i) {
+            appendRecord(updates[i].remove ? WAL_REMOVE : WAL_INSERT, &updates[i].key,
+                         updates[i].remove ? nullptr : &updates[i].value);
+        }
+    }
+}
+
+template<class Key, class Value>
+typename LoggedAVLTree<Key, Value>::iterator LoggedAVLTree<Key, Value>::begin() const
+{
+    return iterator(AVLTree<Key, Value>::begin());
+}
+
+template<class Key, class Value>
+typename LoggedAVLTree<Key, Value>::iterator LoggedAVLTree<Key, Value>::end() const
+{
+    return iterator(AVLTree<Key, Value>::end());
+}
+
+template<class Key, class Value>
+typename LoggedAVLTree<Key, Value>::iterator LoggedAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(AVLTree<Key, Value>::find(key));
+}
+
+template<class Key, class Value>
+typename LoggedAVLTree<Key, Value>::iterator LoggedAVLTree<Key, Value>::lower_bound(const Key& key) const
+{
+    return iterator(AVLTree<Key, Value>::lower_bound(key));
+}
+
+template<class Key, class Value>
+typename LoggedAVLTree<Key, Value>::iterator LoggedAVLTree<Key, Value>::upper_bound(const Key& key) const
+{
+    return iterator(AVLTree<Key, Value>::upper_bound(key));
+}
+
+template<class Key, class Value>
+std::pair<typename LoggedAVLTree<Key, Value>::iterator, typename LoggedAVLTree<Key, Value>::iterator>
+LoggedAVLTree<Key, Value>::equal_range(const Key& key) const
+{
+    std::pair<typename AVLTree<Key, Value>::iterator, typename AVLTree<Key, Value>::iterator> range =
+        AVLTree<Key, Value>::equal_range(key);
+    return std::make_pair(iterator(range.first), iterator(range.second));
+}
+
+//Erases go through eraseNode, which logs them
+template<class Key, class Value>
+typename LoggedAVLTree<Key, Value>::iterator LoggedAVLTree<Key, Value>::erase(iterator pos)
+{
+    return iterator(AVLTree<Key, Value>::erase(pos.it_));
+}
+
+template<class Key, class Value>
+typename LoggedAVLTree<Key, Value>::iterator LoggedAVLTree<Key, Value>::erase(iterator first, iterator last)
+{
+    return iterator(AVLTree<Key, Value>::erase(first.it_, last.it_));
+}
+
+template<class Key, class Value>
+Value const & LoggedAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    return AVLTree<Key, Value>::operator[](key);
+}
+
+/**
+* Starts logging mutations to path, appending to whatever is already there.
+*/
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::openLog(const std::string& path, const WalOptions& options)
+{
+    closeLog();
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("LoggedAVLTree: cannot open log " + path);
+    }
+    options_ = options;
+    buffer_.reserve(options_.groupCommitBytes + recordSize(WAL_INSERT));
+}
+
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::closeLog()
+{
+    if (fd_ < 0) {
+        return;
+    }
+    flushBuffer(true);
+    ::close(fd_);
+    fd_ = -1;
+}
+
+template<class Key, class Value>
+bool LoggedAVLTree<Key, Value>::logging() const
+{
+    return fd_ >= 0;
+}
+
+/**
+* Forces a group commit and an fsync: every mutation made so far is durable
+* when this returns.
+*/
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::commit()
+{
+    if (fd_ >= 0) {
+        flushBuffer(true);
+    }
+}
+
+//Helper that encodes one record and group commits when the batch is full
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::appendRecord(uint8_t type, const Key* key, const Value* value)
+{
+    size_t start = buffer_.size();
+    buffer_.resize(start + recordSize(type));
+    char* record = &buffer_[start];
+    char* payload = record + 1 + sizeof(uint32_t);
+
+    record[0] = (char)type;
+    if (key != nullptr) {
+        std::memcpy(payload, key, sizeof(Key));
+    }
+    if (value != nullptr) {
+        std::memcpy(payload + sizeof(Key), value, sizeof(Value));
+    }
+    uint32_t sum = checksum(payload, recordSize(type) - 1 - sizeof(uint32_t));
+    std::memcpy(record + 1, &sum, sizeof(sum));
+
+    if (++buffered_ >= options_.groupCommitRecords || buffer_.size() >= options_.groupCommitBytes) {
+        unsynced_++;
+        flushBuffer(options_.syncEvery != 0 && unsynced_ >= options_.syncEvery);
+    }
+}
+
+/*
+ * Helper that writes the buffered group and optionally syncs it. If a write
+ * fails part way, the bytes already in the log are dropped from buffer_
+ * before throwing, so a later flush does not write them twice.
+ */
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::flushBuffer(bool sync)
+{
+    size_t written = 0;
+    while (written < buffer_.size()) {
+        ssize_t n = ::write(fd_, &buffer_[written], buffer_.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            buffer_.erase(buffer_.begin(), buffer_.begin() + written);
+            throw std::runtime_error("LoggedAVLTree: log write failed");
+        }
+        written += (size_t)n;
+    }
+    buffer_.clear();
+    buffered_ = 0;
+
+    if (sync) {
+        if (fdatasync(fd_) != 0) {
+            throw std::runtime_error("LoggedAVLTree: log sync failed");
+        }
+        unsynced_ = 0;
+    }
+}
+
+/**
+* Writes the whole tree to snapshotPath (atomically, via a rename) and then
+* empties the log, since the snapshot now covers everything in it.
+*/
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::snapshot(const std::string& snapshotPath)
+{
+    commit();
+
+    std::string tmpPath = snapshotPath + ".tmp";
+    int out = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        throw std::runtime_error("LoggedAVLTree: cannot create " + tmpPath);
+    }
+    std::vector<char> chunk;
+    bool ok = true;
+    for (iterator it = begin(); it != end() && ok; ++it) {
+        size_t start = chunk.size();
+        chunk.resize(start + sizeof(Key) + sizeof(Value));
+        std::memcpy(&chunk[start], &it->first, sizeof(Key));
+        std::memcpy(&chunk[start + sizeof(Key)], &it->second, sizeof(Value));
+        if (chunk.size() >= (1u << 20)) {
+            ok = ::write(out, &chunk[0], chunk.size()) == (ssize_t)chunk.size();
+            chunk.clear();
+        }
+    }
+    if (ok && !chunk.empty()) {
+        ok = ::write(out, &chunk[0], chunk.size()) == (ssize_t)chunk.size();
+    }
+    ok = ok && fsync(out) == 0;
+    ::close(out);
+    if (!ok || std::rename(tmpPath.c_str(), snapshotPath.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("LoggedAVLTree: failed writing snapshot " + snapshotPath);
+    }
+
+    //The rename is only durable once the directory entry is, and the log must
+    //not be emptied before then
+    std::string::size_type slash = snapshotPath.rfind('/');
+    std::string dirPath = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : snapshotPath.substr(0, slash));
+    int dir = ::open(dirPath.c_str(), O_RDONLY);
+    bool synced = dir >= 0 && fsync(dir) == 0;
+    if (dir >= 0) {
+        ::close(dir);
+    }
+    if (!synced) {
+        throw std::runtime_error("LoggedAVLTree: cannot sync directory of " + snapshotPath);
+    }
+
+    //A crash before the truncate replays records the snapshot already has.
+    //Without duplicates that rebuilds the same map, since each key ends with
+    //its last logged update; in multimap mode the replayed inserts come back
+    //as extra duplicates.
+    if (fd_ >= 0 && (ftruncate(fd_, 0) != 0 || fdatasync(fd_) != 0)) {
+        throw std::runtime_error("LoggedAVLTree: cannot truncate log");
+    }
+}
+
+/**
+* Rebuilds the tree from snapshotPath (a missing snapshot means "start empty")
+* and replays logPath on top of it. A torn record at the end of the log is cut
+* off so that logging can resume with openLog(logPath).
+*/
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::recover(const std::string& snapshotPath, const std::string& logPath)
+{
+    closeLog();
+    AVLTree<Key, Value>::clear();
+
+    std::FILE* in = std::fopen(snapshotPath.c_str(), "rb");
+    if (in != nullptr) {
+        std::vector<std::pair<Key, Value> > items;
+        std::pair<Key, Value> item;
+        while (std::fread(&item.first, sizeof(Key), 1, in) == 1 &&
+               std::fread(&item.second, sizeof(Value), 1, in) == 1) {
+            items.push_back(item);
+        }
+        std::fclose(in);
+        AVLTree<Key, Value>::insertSorted(items.begin(), items.end()); //Snapshots are written in key order
+    }
+
+    replayLog(logPath);
+}
+
+//Helper that applies every intact log record without logging it again
+template<class Key, class Value>
+void LoggedAVLTree<Key, Value>::replayLog(const std::string& logPath)
+{
+    std::FILE* in = std::fopen(logPath.c_str(), "rb");
+    if (in == nullptr) {
+        return;
+    }
+
+    std::vector<char> record(recordSize(WAL_INSERT));
+    long validEnd = 0;
+    while (std::fread(&record[0], 1, 1, in) == 1) {
+        uint8_t type = (uint8_t)record[0];
+        if (type != WAL_INSERT && type != WAL_REMOVE && type != WAL_CLEAR) {
+            break;
+        }
+        size_t rest = recordSize(type) - 1;
+        if (std::fread(&record[1], 1, rest, in) != rest) {
+            break;
+        }
+        const char* payload = &record[1 + sizeof(uint32_t)];
+        uint32_t sum;
+        std::memcpy(&sum, &record[1], sizeof(sum));
+        if (sum != checksum(payload, rest - sizeof(uint32_t))) {
+            break;
+        }
+
+        if (type == WAL_CLEAR) {
+            AVLTree<Key, Value>::clear();
+            validEnd = std::ftell(in);
+            continue;
+        }
+        Key key;
+        std::memcpy(&key, payload, sizeof(Key));
+        if (type == WAL_INSERT) {
+            Value value;
+            std::memcpy(&value, payload + sizeof(Key), sizeof(Value));
+            AVLTree<Key, Value>::insert(std::make_pair(key, value));
+        } else {
+            AVLTree<Key, Value>::remove(key);
+        }
+        validEnd = std::ftell(in);
+    }
+    std::fclose(in);
+
+    if (truncate(logPath.c_str(), validEnd) != 0) {
+        throw std::runtime_error("LoggedAVLTree: cannot trim log " + logPath);
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the LoggedAVLTree class.
+  ---------------------------------------------
+*/
+
+#endif